@@ -0,0 +1,277 @@
+#include "framesource.h"
+#include <iostream>
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <stdexcept>
+#include <curl/curl.h>
+#include <turbojpeg.h>
+
+namespace cm {
+
+//----------------------------------------------//
+//  Theta (live camera)
+//----------------------------------------------//
+
+struct CurlContext {
+    FrameSource::Sink* sink;
+    const std::atomic<bool>* running;
+};
+
+static size_t curlWrite(void* contents, size_t size, size_t nmemb, void* userp) {
+    auto* ctx = static_cast<CurlContext*>(userp);
+    (*ctx->sink)(static_cast<uint8_t*>(contents), size * nmemb);
+    return size * nmemb;
+}
+
+// called periodically by curl, a non-zero return aborts the transfer
+static int curlProgress(void* userp, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+    auto* ctx = static_cast<CurlContext*>(userp);
+    return ctx->running->load() ? 0 : 1;
+}
+
+void ThetaSource::stream(Sink sink, const std::atomic<bool>& running) {
+    CURL* curl = curl_easy_init();
+    if (!curl) {
+        std::cerr << "Failed to initialize CURL" << std::endl;
+        return;
+    }
+
+    CurlContext ctx {&sink, &running};
+
+    struct curl_slist* headers = nullptr;
+    headers = curl_slist_append(headers, "Content-Type: application/json;charset=utf-8");
+
+    curl_easy_setopt(curl, CURLOPT_URL, cameraUrl.c_str());
+    curl_easy_setopt(curl, CURLOPT_POST, 1L);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, "{\"name\":\"camera.getLivePreview\"}");
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curlWrite);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &ctx);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, curlProgress);
+    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &ctx);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L);  // No timeout, continuous stream
+
+    curl_easy_perform(curl);  // Blocking call, continuously receives data
+
+    curl_slist_free_all(headers);
+    curl_easy_cleanup(curl);
+}
+
+//----------------------------------------------//
+//  Replay
+//----------------------------------------------//
+
+void ReplaySource::stream(Sink sink, const std::atomic<bool>& running) {
+
+    if (frames.empty()) {
+        std::cerr << "[framesource] nothing to replay" << std::endl;
+        return;
+    }
+
+    using clock = std::chrono::steady_clock;
+    using seconds = std::chrono::duration<double>;
+
+    // the time from each frame to the next: as recorded, or the fixed period.
+    // the last frame to the first (when looping) gets the average gap
+    bool recorded = pacing.mode == Pacing::REALTIME && !stamps.empty();
+    double average = recorded && frames.size() > 1 ? (stamps.back() - stamps.front()) / (frames.size() - 1) : 1. / pacing.fps;
+    auto gap = [&](size_t i) {
+        return recorded && i + 1 < frames.size() ? stamps[i + 1] - stamps[i] : average;
+    };
+
+    auto next = clock::now();
+
+    for (size_t i = 0; running.load(); i = (i + 1) % frames.size()) {
+
+        // keep the schedule (not the gaps), so the average rate stays exact
+        if (pacing.mode != Pacing::MAX) {
+            std::this_thread::sleep_until(next);
+            next += std::chrono::duration_cast<clock::duration>(seconds(gap(i)));
+        }
+
+        sink(frames[i].data(), frames[i].size());
+    }
+}
+
+void ReplaySource::stamp(std::vector<double> times) {
+
+    if (times.size() != frames.size() || times.size() < 2) return;
+    if (!std::is_sorted(times.begin(), times.end()) || times.back() <= times.front()) return;
+
+    stamps = times;
+    printf("[framesource] recorded at %.1f fps on average\n",
+           (stamps.size() - 1) / (stamps.back() - stamps.front()));
+}
+
+// reads a whole file into memory
+static std::vector<uint8_t> readfile(std::string filename) {
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("can't open " + filename);
+    }
+
+    std::vector<uint8_t> data((size_t) file.tellg());
+    file.seekg(0);
+    file.read((char*) data.data(), data.size());
+    return data;
+}
+
+MjpegFileSource::MjpegFileSource(std::string filename, Pacing p) : ReplaySource(p) {
+
+    std::vector<uint8_t> data = readfile(filename);
+
+    const uint8_t soi[] = {0xFF, 0xD8};
+    const uint8_t eoi[] = {0xFF, 0xD9};
+
+    // split into frames: from each SOI to the next EOI
+    std::vector<double> times;
+    auto it = data.begin();
+    while (true) {
+        auto start = std::search(it, data.end(), soi, soi + 2);
+        auto end = std::search(start, data.end(), eoi, eoi + 2);
+        if (end == data.end()) break;
+
+        // the part headers before the frame, if it's multipart
+        std::string head(it, start);
+        std::transform(head.begin(), head.end(), head.begin(), ::tolower);
+        size_t ts = head.find("x-timestamp:");
+        if (ts != std::string::npos) {
+            times.push_back(std::strtod(head.c_str() + ts + 12, nullptr));
+        }
+
+        frames.emplace_back(start, end + 2);
+        it = end + 2;
+    }
+
+    printf("[framesource] %zu frames from %s\n", frames.size(), filename.c_str());
+    stamp(times);
+}
+
+JpegDirSource::JpegDirSource(std::string path, Pacing p) : ReplaySource(p) {
+
+    std::vector<std::filesystem::path> files;
+    for (const auto& entry : std::filesystem::directory_iterator(path)) {
+        std::string ext = entry.path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (entry.is_regular_file() && (ext == ".jpg" || ext == ".jpeg")) {
+            files.push_back(entry.path());
+        }
+    }
+    std::sort(files.begin(), files.end());
+
+    std::vector<double> times;
+    for (const auto& f : files) {
+        frames.push_back(readfile(f.string()));
+        auto written = std::filesystem::last_write_time(f).time_since_epoch();
+        times.push_back(std::chrono::duration<double>(written).count());
+    }
+
+    printf("[framesource] %zu frames from %s\n", frames.size(), path.c_str());
+    stamp(times);
+}
+
+SyntheticSource::SyntheticSource(uint32_t width, uint32_t height, Pacing p, uint32_t nframes) : ReplaySource(p) {
+
+    tjhandle encoder = tjInitCompress();
+    std::vector<uint8_t> rgb(width * height * 3);
+
+    for (uint32_t f = 0; f < nframes; f++) {
+
+        // where the sun is this frame
+        float sun_lon = 2 * M_PI * f / nframes;
+        float sun_lat = 0.3;
+
+        for (uint32_t y = 0; y < height; y++) {
+            float lat = M_PI * (0.5 - (y + 0.5) / height);
+            for (uint32_t x = 0; x < width; x++) {
+                float lon = 2 * M_PI * (x + 0.5) / width;
+
+                // angle to the sun
+                float c = std::sin(lat) * std::sin(sun_lat)
+                        + std::cos(lat) * std::cos(sun_lat) * std::cos(lon - sun_lon);
+                float sun = std::pow(std::max(c, 0.f), 64.f);
+
+                // blue-ish sky above the horizon, brown-ish ground below
+                float r = lat > 0 ? 0.4 + 0.2 * lat : 0.3;
+                float g = lat > 0 ? 0.5 + 0.2 * lat : 0.25;
+                float b = lat > 0 ? 0.9 : 0.2;
+
+                uint8_t* px = &rgb[(y * width + x) * 3];
+                px[0] = (uint8_t) std::min(255.f, (r + sun) * 255);
+                px[1] = (uint8_t) std::min(255.f, (g + sun) * 255);
+                px[2] = (uint8_t) std::min(255.f, (b + sun * 0.8f) * 255);
+            }
+        }
+
+        unsigned char* jpeg = nullptr;
+        unsigned long jpegsize = 0;
+        if (tjCompress2(encoder, rgb.data(), width, 0, height, TJPF_RGB,
+                        &jpeg, &jpegsize, TJSAMP_420, 85, 0) != 0) {
+            std::cerr << "[framesource] encode failed: " << tjGetErrorStr2(encoder) << std::endl;
+            break;
+        }
+
+        frames.emplace_back(jpeg, jpeg + jpegsize);
+        tjFree(jpeg);
+    }
+
+    tjDestroy(encoder);
+
+    printf("[framesource] %zu synthetic %ux%u frames\n", frames.size(), width, height);
+}
+
+//----------------------------------------------//
+//  Factory
+//----------------------------------------------//
+
+FrameSource* FrameSource::create(std::string spec) {
+
+    // split off the "@rate" suffix
+    Pacing pacing;
+    size_t at = spec.rfind('@');
+    if (at != std::string::npos && spec.compare(0, 6, "theta:") != 0) {
+        std::string rate = spec.substr(at + 1);
+        spec = spec.substr(0, at);
+
+        if (rate == "max") {
+            pacing.mode = Pacing::MAX;
+        } else if (rate != "rt") {
+            char* end;
+            pacing.mode = Pacing::FIXED;
+            pacing.fps = std::strtod(rate.c_str(), &end);
+
+            // (a rate of 0 would be a frame every 1/0 seconds)
+            if (end == rate.c_str() || *end != '\0' || !std::isfinite(pacing.fps) || pacing.fps <= 0) {
+                throw std::runtime_error("bad frame rate: " + rate);
+            }
+        }
+    }
+
+    // split into kind:argument
+    size_t colon = spec.find(':');
+    std::string kind = spec.substr(0, colon);
+    std::string arg = colon == std::string::npos ? "" : spec.substr(colon + 1);
+
+    if (kind == "theta") {
+        return new ThetaSource(arg.empty() ? "http://192.168.1.1/osc/commands/execute" : arg);
+    }
+    if (kind == "mjpeg") {
+        return new MjpegFileSource(arg, pacing);
+    }
+    if (kind == "dir") {
+        return new JpegDirSource(arg, pacing);
+    }
+    if (kind == "synthetic") {
+        return new SyntheticSource(1024, 512, pacing);
+    }
+
+    throw std::runtime_error("unknown frame source: " + spec);
+}
+
+};
@@ -0,0 +1,93 @@
+#ifndef FRAMESOURCE_H
+#define FRAMESOURCE_H
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <functional>
+#include <cstdint>
+
+namespace cm {
+
+// how fast a recorded or generated source hands out its frames
+struct Pacing {
+    enum Mode {
+        REALTIME, // as recorded: the recording's timestamps, or fps if it has none
+        MAX,      // as fast as the consumer takes them
+        FIXED,    // at a requested rate (fps)
+    } mode = REALTIME;
+    double fps = 30;  // the theta's live preview runs at ~30fps
+};
+
+// A FrameSource feeds MJPEG data to a cm::Webcam.
+// stream() runs on the webcam's background thread, and pushes data
+// into `sink` until `running` goes false. The data doesn't have to be
+// split into frames, the webcam scans it for JPEGs on its own.
+class FrameSource {
+public:
+    using Sink = std::function<void(const uint8_t*, size_t)>;
+
+    virtual ~FrameSource() {}
+    virtual void stream(Sink, const std::atomic<bool>& running) = 0;
+
+    // creates a source from a spec string:
+    //   theta[:url]        the live preview of a ricoh theta (default url: 192.168.1.1)
+    //   mjpeg:file[@rate]  a recorded MJPEG stream, looped
+    //   dir:path[@rate]    a directory of .jpg files in name order, looped
+    //   synthetic[@rate]   generated frames
+    // where rate is `rt` (default), `max` or a number of fps (> 0).
+    static FrameSource* create(std::string);
+};
+
+// the camera itself: POSTs camera.getLivePreview to its OSC endpoint
+class ThetaSource : public FrameSource {
+public:
+    ThetaSource(std::string url) : cameraUrl(url) {}
+    void stream(Sink, const std::atomic<bool>&) override;
+
+    std::string cameraUrl;
+};
+
+// replays a list of in-memory JPEG frames with the given pacing.
+// everything is loaded up front so that disk IO doesn't end up in the measurements.
+class ReplaySource : public FrameSource {
+protected:
+    std::vector<std::vector<uint8_t>> frames;
+    std::vector<double> stamps;  // when each frame was captured (s), empty if unknown
+    Pacing pacing;
+
+    // sets stamps, if there's one per frame and they go forward
+    void stamp(std::vector<double>);
+
+public:
+    ReplaySource(Pacing p) : pacing(p) {}
+    void stream(Sink, const std::atomic<bool>&) override;
+
+    size_t size() const {return frames.size();}
+};
+
+// a recorded MJPEG stream (raw concatenated JPEGs or multipart). the frames are
+// timed by the parts' X-Timestamp headers if there are any, anything else
+// between the frames is ignored
+class MjpegFileSource : public ReplaySource {
+public:
+    MjpegFileSource(std::string filename, Pacing);
+};
+
+// every .jpg/.jpeg file of a directory, sorted by name, timed by the files'
+// modification times
+class JpegDirSource : public ReplaySource {
+public:
+    JpegDirSource(std::string path, Pacing);
+};
+
+// generated equirectangular frames: a sky gradient with a "sun" going around
+// the horizon, encoded once at startup (4:2:0, like the camera)
+class SyntheticSource : public ReplaySource {
+public:
+    SyntheticSource(uint32_t width, uint32_t height, Pacing, uint32_t nframes = 90);
+};
+
+};
+
+#endif // FRAMESOURCE_H
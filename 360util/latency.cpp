@@ -0,0 +1,227 @@
+#include "latency.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <array>
+#include <map>
+#include <chrono>
+#include <algorithm>
+
+namespace cm {
+
+// a stamp, as written by the stamping thread
+struct Event {
+    uint64_t frame;
+    int64_t ns;
+    Latency::Stage stage;
+};
+
+// single producer (the owning thread), single consumer (collect()) ring.
+// when it's full, stamps are dropped rather than blocking the producer.
+struct EventRing {
+    static constexpr size_t SIZE = 1024;
+    Event events[SIZE];
+    std::atomic<uint64_t> head {0};  // written by the producer
+    std::atomic<uint64_t> tail {0};  // written by the consumer
+    std::atomic<uint64_t> dropped {0};
+};
+
+// 0.1ms buckets up to a second, the last one catches everything above
+struct Histogram {
+    static constexpr int BUCKETS = 10000;
+    static constexpr double BUCKET_MS = 0.1;
+    std::vector<uint32_t> buckets = std::vector<uint32_t>(BUCKETS);
+    uint64_t count = 0;
+
+    void add(int64_t ns) {
+        int b = std::clamp<int64_t>(ns / (int64_t) (BUCKET_MS * 1e6), 0, BUCKETS - 1);
+        buckets[b]++;
+        count++;
+    }
+
+    double percentile(double p) const {
+        if (count == 0) return 0;
+        uint64_t rank = std::min<uint64_t>(count - 1, p * count);
+        uint64_t seen = 0;
+        for (int b = 0; b < BUCKETS; b++) {
+            seen += buckets[b];
+            if (seen > rank) return (b + 0.5) * BUCKET_MS;
+        }
+        return BUCKETS * BUCKET_MS;
+    }
+};
+
+using Stamps = std::array<int64_t, Latency::STAGES>;  // 0 if the stage wasn't stamped
+
+// every thread that ever stamped, rings are never freed (threads might still be writing)
+static std::mutex ringsMutex;
+static std::vector<EventRing*> rings;
+static thread_local EventRing* localRing = nullptr;
+
+// only touched by collect() and its callers
+static std::map<uint64_t, Stamps> inflight;
+static uint64_t newest = 0;
+static Histogram histograms[Latency::STAGES];
+static uint64_t presented = 0, lost = 0;
+
+static bool tracing = false;
+static std::string tracePath;
+static std::vector<std::pair<uint64_t, Stamps>> traced;
+
+// a frame that isn't complete by the time this many newer frames showed up never will be
+static constexpr uint64_t MAX_INFLIGHT = 16;
+
+const char* Latency::name(Stage s) {
+    static const char* names[] = {"receive", "soi", "decoded", "uploaded", "blurred", "presented"};
+    return s < STAGES ? names[s] : "?";
+}
+
+int64_t Latency::now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Latency::stamp(uint64_t frame, Stage stage) {
+    stamp(frame, stage, now());
+}
+
+void Latency::stamp(uint64_t frame, Stage stage, int64_t ns) {
+
+    // first stamp on this thread: register its ring
+    if (!localRing) {
+        localRing = new EventRing;
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings.push_back(localRing);
+    }
+
+    EventRing& r = *localRing;
+    uint64_t head = r.head.load(std::memory_order_relaxed);
+    if (head - r.tail.load(std::memory_order_acquire) >= EventRing::SIZE) {
+        r.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    r.events[head % EventRing::SIZE] = {frame, ns, stage};
+    r.head.store(head + 1, std::memory_order_release);
+}
+
+// a frame is done: add it to the histograms (and the trace)
+static void finalize(uint64_t frame, const Stamps& t) {
+
+    if (!t[Latency::PRESENTED]) {
+        lost++;
+        return;
+    }
+
+    presented++;
+    if (t[Latency::RECEIVE]) {
+        for (int s = Latency::SOI; s < Latency::STAGES; s++) {
+            if (t[s]) histograms[s].add(t[s] - t[Latency::RECEIVE]);
+        }
+    }
+
+    if (tracing) traced.push_back({frame, t});
+}
+
+void Latency::collect() {
+
+    std::vector<EventRing*> all;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        all = rings;
+    }
+
+    for (EventRing* r : all) {
+        uint64_t tail = r->tail.load(std::memory_order_relaxed);
+        uint64_t head = r->head.load(std::memory_order_acquire);
+
+        for (; tail != head; tail++) {
+            const Event& e = r->events[tail % EventRing::SIZE];
+
+            // late stamps of an already finalized frame are ignored
+            if (e.frame + MAX_INFLIGHT <= newest) continue;
+
+            Stamps& t = inflight[e.frame];
+            if (!t[e.stage]) t[e.stage] = e.ns;
+            newest = std::max(newest, e.frame);
+        }
+
+        r->tail.store(tail, std::memory_order_release);
+    }
+
+    // finish complete frames, and the ones that fell too far behind
+    for (auto it = inflight.begin(); it != inflight.end();) {
+        bool complete = std::all_of(it->second.begin(), it->second.end(), [](int64_t ns) { return ns != 0; });
+        if (complete || it->first + MAX_INFLIGHT <= newest) {
+            finalize(it->first, it->second);
+            it = inflight.erase(it);
+        } else {
+            it++;
+        }
+    }
+}
+
+double Latency::percentile(Stage s, double p) {
+    return histograms[s].percentile(p);
+}
+
+void Latency::report(FILE* out) {
+
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        for (EventRing* r : rings) dropped += r->dropped.load(std::memory_order_relaxed);
+    }
+
+    fprintf(out, "[latency] %lu frames presented, %lu never presented, %lu stamps dropped\n",
+            presented, lost, dropped);
+    fprintf(out, "[latency] frame age     p50 ms    p99 ms\n");
+    for (int s = SOI; s < STAGES; s++) {
+        fprintf(out, "[latency]   %-10s %8.2f  %8.2f\n", name((Stage) s),
+                histograms[s].percentile(0.5), histograms[s].percentile(0.99));
+    }
+}
+
+void Latency::trace(std::string path) {
+    tracing = true;
+    tracePath = path;
+}
+
+// one "complete" event per step of every frame, frames spread over a few rows
+// so that the ones in flight at the same time don't overlap
+void Latency::finish() {
+
+    collect();
+
+    if (!tracing) return;
+
+    FILE* f = fopen(tracePath.c_str(), "w");
+    if (!f) {
+        fprintf(stderr, "[latency] can't write %s\n", tracePath.c_str());
+        return;
+    }
+
+    int64_t t0 = traced.empty() ? 0 : traced.front().second[RECEIVE];
+
+    // named after what happens between the previous stage and this one
+    static const char* steps[] = {"", "scan", "decode", "upload", "blur", "render"};
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    bool first = true;
+    for (auto& [frame, t] : traced) {
+        for (int s = SOI; s < STAGES; s++) {
+            if (!t[s - 1] || !t[s]) continue;
+            fprintf(f, "%s{\"name\":\"%s\",\"cat\":\"camera\",\"ph\":\"X\",\"pid\":1,\"tid\":%lu,"
+                       "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%lu}}",
+                    first ? "" : ",\n", steps[s], frame % 8,
+                    (t[s - 1] - t0) / 1e3, (t[s] - t[s - 1]) / 1e3, frame);
+            first = false;
+        }
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(f);
+
+    printf("[latency] wrote %zu frames to %s\n", traced.size(), tracePath.c_str());
+}
+
+};
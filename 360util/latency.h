@@ -0,0 +1,59 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace cm {
+
+// Traces how old a camera frame is at each step on its way to the screen.
+//
+// Every frame gets an id when the webcam finds its SOI, and each stage stamps
+// (id, stage, time) into a buffer owned by the calling thread. Stamping never
+// locks or allocates (after the first call on a thread), so it's fine on the
+// streaming thread and in the render loop.
+//
+// collect() (from one thread, eg. once per frame in the main loop) drains the
+// buffers, and once a frame is presented, adds its age at each stage into a
+// histogram and (optionally) keeps it for the chrome trace.
+//
+// Times are std::chrono::steady_clock in ns -- gpu stages are converted with
+// vk::Timestamps.
+class Latency {
+public:
+    enum Stage {
+        RECEIVE,    // the network chunk with the SOI arrived
+        SOI,        // the scanner found the start of the frame
+        DECODED,    // jpeg decoded into the staging buffer
+        UPLOADED,   // copy to device memory done (gpu)
+        BLURRED,    // environment processing done (gpu)
+        PRESENTED,  // handed to the presentation engine
+        STAGES
+    };
+
+    static const char* name(Stage);
+
+    // stamps a stage of a frame, now or at a given time
+    static void stamp(uint64_t frame, Stage);
+    static void stamp(uint64_t frame, Stage, int64_t ns);
+    static int64_t now();
+
+    // drains the per-thread buffers, call from one thread only
+    static void collect();
+
+    // age of the frames at a stage (since RECEIVE), p in [0, 1]. in ms
+    static double percentile(Stage, double p);
+
+    // prints p50/p99 for every stage
+    static void report(FILE*);
+
+    // keep every presented frame from now on, finish() writes them to path
+    // as a chrome trace (chrome://tracing, ui.perfetto.dev)
+    static void trace(std::string path);
+    static void finish();
+};
+
+};
+
+#endif // LATENCY_H
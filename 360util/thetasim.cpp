@@ -0,0 +1,204 @@
+// thetasim - stands in for the theta on loopback.
+//
+// Serves camera.getLivePreview on the OSC endpoint (POST /osc/commands/execute),
+// streaming frames from any cm::FrameSource as multipart MJPEG, the way the camera does.
+// Point the demo at it with
+//
+//   ./thetasim --source mjpeg:recording.mjpeg@30 --chunk 1400 &
+//   ./vkdemo --source theta:http://127.0.0.1:8080/osc/commands/execute
+//
+// --chunk sets how many bytes go out per send(), small values (down to 1) chop
+// the frames and markers at every possible place to stress the webcam's scanner.
+
+#include "framesource.h"
+#include <iostream>
+#include <string>
+#include <cstring>
+#include <csignal>
+#include <atomic>
+
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+static std::atomic<bool> quit(false);
+
+static const char* BOUNDARY = "---osclivepreview---";
+
+// sends everything, returns false when the client is gone
+static bool sendall(int fd, const void* data, size_t size) {
+    const char* p = (const char*) data;
+    while (size > 0) {
+        ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+        if (n <= 0) return false;
+        p += n;
+        size -= n;
+    }
+    return true;
+}
+
+// reads the request headers (and body, if any). returns false on a broken connection
+static bool readrequest(int fd, std::string& head, std::string& body) {
+    std::string req;
+    char buf[1024];
+
+    size_t end;
+    while ((end = req.find("\r\n\r\n")) == std::string::npos) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0 || req.size() > 64 * 1024) return false;
+        req.append(buf, n);
+    }
+
+    head = req.substr(0, end);
+    body = req.substr(end + 4);
+
+    // the json command is in the body
+    size_t length = 0;
+    size_t cl = head.find("Content-Length:");
+    if (cl == std::string::npos) cl = head.find("content-length:");
+    if (cl != std::string::npos) {
+        length = std::stoul(head.substr(cl + 15));
+    }
+
+    while (body.size() < length) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) return false;
+        body.append(buf, n);
+    }
+
+    return true;
+}
+
+static void reply(int fd, const char* status, const char* message) {
+    std::string r = std::string("HTTP/1.1 ") + status + "\r\n"
+                  + "Content-Type: application/json;charset=utf-8\r\n"
+                  + "Content-Length: " + std::to_string(strlen(message)) + "\r\n"
+                  + "Connection: close\r\n\r\n" + message;
+    sendall(fd, r.data(), r.size());
+}
+
+// streams the source to one client, until it disconnects
+static void serve(int fd, cm::FrameSource& source, size_t chunk) {
+
+    std::string head, body;
+    if (!readrequest(fd, head, body)) return;
+
+    if (head.rfind("POST /osc/commands/execute ", 0) != 0) {
+        reply(fd, "404 Not Found", "{\"error\":\"not found\"}");
+        return;
+    }
+    if (body.find("camera.getLivePreview") == std::string::npos) {
+        reply(fd, "400 Bad Request", "{\"state\":\"error\",\"error\":{\"code\":\"unknownCommand\"}}");
+        return;
+    }
+
+    std::string headers = std::string("HTTP/1.1 200 OK\r\n")
+                        + "Content-Type: multipart/x-mixed-replace; boundary=\"" + BOUNDARY + "\"\r\n"
+                        + "Connection: close\r\n\r\n";
+    if (!sendall(fd, headers.data(), headers.size())) return;
+
+    std::atomic<bool> connected(true);
+    uint64_t frames = 0, bytes = 0;
+
+    source.stream([&](const uint8_t* data, size_t size) {
+
+        if (quit.load()) connected.store(false);
+        if (!connected.load()) return;
+
+        // one part per frame, like the camera
+        std::string part = std::string("--") + BOUNDARY + "\r\n"
+                         + "Content-Type: image/jpeg\r\n"
+                         + "Content-Length: " + std::to_string(size) + "\r\n\r\n";
+        part.append((const char*) data, size);
+        part.append("\r\n");
+
+        // in chunks, so that the client sees them as separate reads
+        for (size_t off = 0; off < part.size(); off += chunk) {
+            if (!sendall(fd, part.data() + off, std::min(chunk, part.size() - off))) {
+                connected.store(false);
+                return;
+            }
+        }
+
+        frames++;
+        bytes += part.size();
+    }, connected);
+
+    printf("[thetasim] client gone after %lu frames (%.1f MB)\n", frames, bytes / 1e6);
+}
+
+static void usage(const char* argv0) {
+    printf("usage: %s [--source spec] [--port n] [--chunk bytes]\n", argv0);
+    printf("  --source  frame source to serve, see cm::FrameSource::create (default synthetic)\n");
+    printf("  --port    port to listen on, on 127.0.0.1 (default 8080)\n");
+    printf("  --chunk   bytes per send() (default 16384)\n");
+}
+
+int main(int argc, char** argv) {
+
+    std::string spec = "synthetic";
+    int port = 8080;
+    size_t chunk = 16384;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--source" && i + 1 < argc) {
+            spec = argv[++i];
+        } else if (arg == "--port" && i + 1 < argc) {
+            port = std::stoi(argv[++i]);
+        } else if (arg == "--chunk" && i + 1 < argc) {
+            chunk = std::max(1ul, std::stoul(argv[++i]));
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    // serving the real camera makes no sense
+    if (spec.rfind("theta", 0) == 0) {
+        std::cerr << "[thetasim] can't serve a theta source" << std::endl;
+        return 1;
+    }
+
+    cm::FrameSource* source = cm::FrameSource::create(spec);
+
+    int server = socket(AF_INET, SOCK_STREAM, 0);
+    int yes = 1;
+    setsockopt(server, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+    sockaddr_in addr {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (bind(server, (sockaddr*) &addr, sizeof(addr)) != 0 || listen(server, 1) != 0) {
+        std::cerr << "[thetasim] can't listen on port " << port << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    // ctrl-c stops the current stream, then the accept loop (no SA_RESTART, so accept() returns)
+    struct sigaction sa {};
+    sa.sa_handler = [](int) { quit.store(true); };
+    sigaction(SIGINT, &sa, nullptr);
+
+    printf("[thetasim] serving %s on http://127.0.0.1:%d/osc/commands/execute (%zu byte chunks)\n",
+           spec.c_str(), port, chunk);
+
+    // one client at a time, the webcam only ever opens one stream
+    while (!quit.load()) {
+        int client = accept(server, nullptr, nullptr);
+        if (client < 0) continue;
+
+        // don't let nagle glue the chunks back together
+        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+
+        serve(client, *source, chunk);
+        close(client);
+    }
+
+    close(server);
+    delete source;
+    return 0;
+}
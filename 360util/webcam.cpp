@@ -1,6 +1,5 @@
 #include "webcam.h"
 #include <iostream>
-#include <curl/curl.h>
 #include <vector>
 #include <mutex>
 #include <thread>
@@ -15,79 +14,217 @@ namespace cm {
 const std::vector<uint8_t> JPEG_SOI = {0xFF, 0xD8};  // JPEG Start of Image
 const std::vector<uint8_t> JPEG_EOI = {0xFF, 0xD9};  // JPEG End of Image
 
-size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp) {
-    auto* webcam = static_cast<Webcam*>(userp);
-    size_t totalSize = size * nmemb;
-    auto* data = static_cast<uint8_t*>(contents);
+// a frame was decoded into the head slot: move the ring along
+// and wake up getNextImage(). bufferMutex must be held.
+void Webcam::publish(std::chrono::steady_clock::time_point decode_start) {
 
-    std::lock_guard<std::mutex> lock(webcam->bufferMutex);
+    Latency::stamp(frameId[head], Latency::DECODED);
+
+    framesDecoded++;
+    decodeNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - decode_start).count();
+
+    head = (head + 1) % Webcam::BUFFER_SIZE;
+    if (head == tail) {
+        isBufferFull = true;
+    }
+
+    bufferCondVar.notify_one();
+}
+
+// called by the FrameSource (on the streaming thread) with the next piece of the stream.
+// the pieces can be cut anywhere, even between the two bytes of a marker.
+void Webcam::ingest(const uint8_t* data, size_t totalSize) {
+
+    int64_t received = Latency::now();
+
+    std::lock_guard<std::mutex> lock(bufferMutex);
+
+    bytesIn += totalSize;
 
     // Append incoming data to buffer
-    webcam->streamBuffer.insert(webcam->streamBuffer.end(), data, data + totalSize);
+    streamBuffer.insert(streamBuffer.end(), data, data + totalSize);
 
     // Search for a full JPEG frame
     while (true) {
-        auto itStart = std::search(webcam->streamBuffer.begin(), webcam->streamBuffer.end(), JPEG_SOI.begin(), JPEG_SOI.end());
-        auto itEnd = std::search(webcam->streamBuffer.begin(), webcam->streamBuffer.end(), JPEG_EOI.begin(), JPEG_EOI.end());
 
-        if (itStart != webcam->streamBuffer.end() && itEnd != webcam->streamBuffer.end() && itEnd > itStart) {
-            // Extract JPEG data
-            std::vector<uint8_t> jpgData(itStart, itEnd + 2);
-            
+        // anything before the start of a frame is multipart headers or a broken frame,
+        // drop it. keep a trailing 0xFF, it might be the first half of the SOI
+        auto itStart = std::search(streamBuffer.begin(), streamBuffer.end(), JPEG_SOI.begin(), JPEG_SOI.end());
+        if (itStart == streamBuffer.end()) {
+            bool split = !streamBuffer.empty() && streamBuffer.back() == 0xFF;
+            streamBuffer.erase(streamBuffer.begin(), streamBuffer.end() - split);
+            scanPos = 0;
+            break;
+        }
+        if (itStart != streamBuffer.begin()) {
+            streamBuffer.erase(streamBuffer.begin(), itStart);
+            scanPos = 0;
+        }
+
+        // a new frame: give it an id for the latency tracing
+        if (pendingFrame == 0) {
+            pendingFrame = ++nextFrameId;
+            Latency::stamp(pendingFrame, Latency::RECEIVE, received);
+            Latency::stamp(pendingFrame, Latency::SOI);
+        }
+
+        // the frame starts at 0 now. look for its end after the SOI, continuing
+        // from where the last chunk left off instead of rescanning the whole frame
+        auto itEnd = std::search(streamBuffer.begin() + std::max<size_t>(scanPos, 2), streamBuffer.end(),
+                                 JPEG_EOI.begin(), JPEG_EOI.end());
+        if (itEnd == streamBuffer.end()) {
+            scanPos = streamBuffer.size() - 1;  // the EOI might straddle the chunks
+
+            // no EOI for way too long, the stream is corrupt: resync on the next SOI
+            if (streamBuffer.size() > MAX_FRAME_SIZE) {
+                std::cerr << "[webcam] no end of frame after " << streamBuffer.size() << " bytes, skipping" << std::endl;
+                streamBuffer.erase(streamBuffer.begin(), streamBuffer.begin() + 2);
+                scanPos = 0;
+                pendingFrame = 0;
+                continue;
+            }
+            break;  // Wait for more data if no full frame is found
+        }
+
+        auto decode_start = std::chrono::steady_clock::now();
+
+        const uint8_t* jpgData = streamBuffer.data();
+        size_t jpgSize = itEnd + 2 - streamBuffer.begin();
+
+        // the slot's staging buffer may still be read by its last upload
+        waitUpload(head);
+
+        // gpu path: only unpack the planes, the conversion happens in prepare()
+        if (ycbcr) {
+            if (decodePlanes(jpgData, jpgSize, head)) {
+                frameId[head] = pendingFrame;
+                publish(decode_start);
+            }
+        } else {
             // Decode image using stb_image
             int width, height, channels;
-            // std::cout << "[STB] image with size " << width << "x" << height << "x" << channels << "\n";
-            unsigned char* imgData = stbi_load_from_memory(jpgData.data(), jpgData.size(), &width, &height, &channels, 3);  // Force RGB
+            unsigned char* imgData = stbi_load_from_memory(jpgData, jpgSize, &width, &height, &channels, 3);  // Force RGB
 
-            if (imgData) {
-                // Store in ring buffer
-                webcam->imageBuffer[webcam->head]->mapped( [&](void* mappedMemory) {
-                    for (int i = 0, j = 0; i < width * height * 3; i++) {
-                        ((unsigned char*) mappedMemory)[j] = imgData[i];
-                        if (i%3 == 2) j++;
-                        j++;
-                    }
-                    
-                    // std::memcpy(mappedMemory, imgData, width * height * 3);
-                });
+            if (imgData && (width != Webcam::WIDTH || height != Webcam::HEIGHT)) {
+                std::cerr << "[webcam] unexpected frame size " << width << "x" << height << std::endl;
+                stbi_image_free(imgData);
+                imgData = nullptr;
+            }
 
-                // Update buffer indices
-                webcam->head = (webcam->head + 1) % Webcam::BUFFER_SIZE;
-                if (webcam->head == webcam->tail) {
-                    webcam->isBufferFull = true;
+            if (imgData) {
+                // Store in ring buffer (staging, upload() moves it to the gpu)
+                unsigned char* mappedMemory = (unsigned char*) stagingPtr[head];
+                for (int i = 0, j = 0; i < width * height * 3; i++) {
+                    mappedMemory[j] = imgData[i];
+                    if (i%3 == 2) j++;
+                    j++;
                 }
+                frameBytes[head] = width * height * 4;
 
-                webcam->bufferCondVar.notify_one();
+                // Update buffer indices
+                frameId[head] = pendingFrame;
+                publish(decode_start);
 
                 // Free stb_image buffer
                 stbi_image_free(imgData);
             }
-
-            // Erase processed data
-            webcam->streamBuffer.erase(webcam->streamBuffer.begin(), itEnd + 2);
-        } else {
-            break;  // Wait for more data if no full frame is found
         }
+
+        // Erase processed data
+        streamBuffer.erase(streamBuffer.begin(), itEnd + 2);
+        scanPos = 0;
+        pendingFrame = 0;
+    }
+}
+
+// JPEG stores YCbCr, usually with 4:2:0 subsampled chroma. Decoding straight to the
+// planes skips the cpu color conversion and uploads less than half of the BGRA bytes.
+// Returns false if the frame couldn't be decoded.
+bool Webcam::decodePlanes(const uint8_t* jpg, size_t size, size_t slot) {
+
+    int width, height, samp, colorspace;
+    if (tjDecompressHeader3(decoder, jpg, size, &width, &height, &samp, &colorspace) != 0) {
+        std::cerr << "[webcam] bad jpeg header: " << tjGetErrorStr2(decoder) << std::endl;
+        return false;
     }
 
-    return totalSize;
+    if (colorspace != TJCS_YCbCr && colorspace != TJCS_GRAY) {
+        std::cerr << "[webcam] unsupported jpeg colorspace " << colorspace << std::endl;
+        return false;
+    }
+
+    int nplanes = samp == TJSAMP_GRAY ? 1 : 3;
+
+    PlaneLayout layout {
+        .size = {width, height},
+        .csize = {tjPlaneWidth(1, width, samp), tjPlaneHeight(1, height, samp)},
+        .shift = {std::countr_zero((unsigned) tjMCUWidth[samp] / 8),
+                  std::countr_zero((unsigned) tjMCUHeight[samp] / 8)},
+        .cboff = -1,
+        .croff = -1,
+        .ystride = tjPlaneWidth(0, width, samp),
+    };
+
+    // planes are packed back to back: Y, Cb, Cr
+    unsigned long ysize = tjPlaneSizeYUV(0, width, 0, height, samp);
+    unsigned long csize = nplanes == 3 ? tjPlaneSizeYUV(1, width, 0, height, samp) : 0;
+
+    if (ysize + 2 * csize > stagingBuffer[slot]->getsize()) {
+        std::cerr << "[webcam] frame too large (" << width << "x" << height << ")" << std::endl;
+        return false;
+    }
+
+    if (nplanes == 3) {
+        layout.cboff = ysize;
+        layout.croff = ysize + csize;
+    }
+
+    unsigned char* base = (unsigned char*) stagingPtr[slot];
+    unsigned char* planes[3] = {base, base + ysize, base + ysize + csize};
+
+    if (tjDecompressToYUVPlanes(decoder, jpg, size, planes, width, nullptr, height, 0) != 0) {
+        std::cerr << "[webcam] decode failed: " << tjGetErrorStr2(decoder) << std::endl;
+        return false;
+    }
+
+    planeLayout[slot] = layout;
+    frameBytes[slot] = ysize + 2 * csize;
+    return true;
 }
 
-Webcam::Webcam(vk::Device& d)
-    : running(false), head(0), tail(0), isBufferFull(false),
-      cameraUrl("http://192.168.1.1/osc/commands/execute") {
+Webcam::Webcam(vk::Device& d, vk::Queue& transfer, bool ycbcr, FrameSource* source)
+    : running(false), head(0), tail(0), current(0), isBufferFull(false), ycbcr(ycbcr),
+      transfer(transfer), source(source) {
+
+    // by default, stream from the camera
+    if (this->source == nullptr) {
+        this->source = FrameSource::create("theta");
+    }
+
+    uploads = new vk::Timeline(d);
+    frameBytes.resize(BUFFER_SIZE);
+    slotUpload.resize(BUFFER_SIZE, 0);
+    readers.resize(BUFFER_SIZE);
+    frameId.resize(BUFFER_SIZE);
+    uploadStamps = new vk::Timestamps(d, transfer, BUFFER_SIZE);
+    uploadPending.resize(BUFFER_SIZE);
+    uploadFrame.resize(BUFFER_SIZE);
     
     for (int i = 0; i < BUFFER_SIZE; i++) {
 
+        // shared between the transfer queue that fills it and the queues that read it
         vk::Image* img = new vk::Image(
             d, {
                 .imageType = VK_IMAGE_TYPE_2D,
                 .format = VK_FORMAT_B8G8R8A8_UNORM,
-                .extent = {1024, 512, 1},
-                .tiling = VK_IMAGE_TILING_LINEAR,
-                .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT
+                .extent = {WIDTH, HEIGHT, 1},
+                .tiling = VK_IMAGE_TILING_OPTIMAL,
+                .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+                       | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,  // read back by tests/ycbcr_test.cpp and --env-ref
+                .sharingMode = VK_SHARING_MODE_CONCURRENT,
             },
-            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT
         );
 
         img->view({
@@ -98,8 +235,95 @@ Webcam::Webcam(vk::Device& d)
         });
 
         imageBuffer.push_back(img);
+
+        // staging memory stays mapped for the lifetime of the webcam.
+        // BGRA on the cpu path, planes big enough for 4:4:4 on the gpu path
+        vk::Buffer* staging = new vk::Buffer(d, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+            WIDTH * HEIGHT * (ycbcr ? 3 : 4));
+
+        stagingBuffer.push_back(staging);
+        stagingPtr.push_back(staging->map());
     }
 
+    if (!ycbcr) return;
+
+    // gpu path: a device-local plane buffer per ring slot
+    decoder = tjInitDecompress();
+    planeLayout.resize(BUFFER_SIZE);
+
+    for (int i = 0; i < BUFFER_SIZE; i++) {
+        planeBuffer.push_back(new vk::Buffer(d, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, WIDTH * HEIGHT * 3));
+    }
+
+    // JFIF (full range BT.601) YCbCr -> RGB, with the same triangle-filtered
+    // chroma upsampling as libjpeg/stb_image so that it matches the cpu path.
+    // writes the channels swapped, like the cpu path does.
+    yuv_sh = new vk::ShaderModule(d, "ycbcr.comp",
+    SHADERCODE(
+        layout (binding = 0) readonly buffer Planes { uint data[]; } planes;
+        layout (binding = 1, rgba8) uniform writeonly image2D dest;
+
+        layout (push_constant) uniform config {
+            ivec2 size;
+            ivec2 csize;
+            ivec2 shift;
+            int cboff;
+            int croff;
+            int ystride;
+        } cfg;
+
+        layout(local_size_x = 16, local_size_y = 16) in;
+
+        float fetch(int i) {
+            return float((planes.data[i >> 2] >> ((i & 3) * 8)) & 0xffu);
+        }
+
+        float chroma(int off, ivec2 coord) {
+
+            if (off < 0) return 128.;
+
+            // chroma sample positions are centered between the luma samples they cover
+            vec2 pos = (vec2(coord) + 0.5) / vec2(1 << cfg.shift.x, 1 << cfg.shift.y) - 0.5;
+            ivec2 c0 = ivec2(floor(pos));
+            vec2 f = pos - vec2(c0);
+
+            // csize is padded to the MCU, the edge is where the image ends
+            ivec2 last = ((cfg.size + (1 << cfg.shift) - 1) >> cfg.shift) - 1;
+            ivec2 lo = clamp(c0, ivec2(0), last);
+            ivec2 hi = clamp(c0 + 1, ivec2(0), last);
+
+            float c00 = fetch(off + lo.y * cfg.csize.x + lo.x);
+            float c10 = fetch(off + lo.y * cfg.csize.x + hi.x);
+            float c01 = fetch(off + hi.y * cfg.csize.x + lo.x);
+            float c11 = fetch(off + hi.y * cfg.csize.x + hi.x);
+
+            return mix(mix(c00, c10, f.x), mix(c01, c11, f.x), f.y);
+        }
+
+        void main() {
+
+            ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+            if (any(greaterThanEqual(coord, min(cfg.size, imageSize(dest))))) return;
+
+            float y  = fetch(coord.y * cfg.ystride + coord.x);
+            float cb = chroma(cfg.cboff, coord) - 128.;
+            float cr = chroma(cfg.croff, coord) - 128.;
+
+            vec3 rgb = vec3(
+                y + 1.402 * cr,
+                y - 0.344136 * cb - 0.714136 * cr,
+                y + 1.772 * cb
+            );
+
+            rgb = clamp(round(rgb), 0., 255.) / 255.;
+            imageStore(dest, coord, vec4(rgb.bgr, 1.));
+        }
+    )
+    );
+
+    yuv = &vk::Pipeline::Compute(d, *yuv_sh, true);
 }
 
 Webcam::~Webcam() {
@@ -107,6 +331,19 @@ Webcam::~Webcam() {
     for (auto& img : imageBuffer) {
         delete img;
     }
+    for (size_t i = 0; i < stagingBuffer.size(); i++) {
+        stagingBuffer[i]->unmap(stagingPtr[i]);
+        delete stagingBuffer[i];
+    }
+    for (auto& buf : planeBuffer) {
+        delete buf;
+    }
+    delete yuv;
+    delete yuv_sh;
+    delete uploadStamps;
+    delete uploads;
+    if (decoder) tjDestroy(decoder);
+    delete source;
 }
 
 void Webcam::startStreaming() {
@@ -127,33 +364,158 @@ vk::Image& Webcam::getNextImage() {
     std::unique_lock<std::mutex> lock(bufferMutex);
     bufferCondVar.wait(lock, [this] { return head != tail || isBufferFull; });
 
+    current = tail;
     vk::Image* nextImage = imageBuffer[tail];
     tail = (tail + 1) % BUFFER_SIZE;
     isBufferFull = false;
     return *nextImage;
 }
 
+vk::Image* Webcam::tryNextImage() {
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    if (head == tail && !isBufferFull) return nullptr;
+
+    current = tail;
+    vk::Image* nextImage = imageBuffer[tail];
+    tail = (tail + 1) % BUFFER_SIZE;
+    isBufferFull = false;
+    return nextImage;
+}
+
+uint64_t Webcam::frame() {
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    return frameId[current];
+}
+
 void Webcam::fetchFrames() {
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        std::cerr << "Failed to initialize CURL" << std::endl;
-        return;
+    source->stream([this](const uint8_t* data, size_t size) { ingest(data, size); }, running);
+}
+
+uint64_t Webcam::upload() {
+
+    vk::Image& img = *imageBuffer[current];
+
+    uint32_t bytes;
+    std::vector<uint64_t> ids;
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        bytes = frameBytes[current];
+        ids = frameId;
     }
 
-    struct curl_slist* headers = nullptr;
-    headers = curl_slist_append(headers, "Content-Type: application/json;charset=utf-8");
+    // pick up the upload times of the earlier frames
+    for (size_t i = 0; i < BUFFER_SIZE; i++) {
+        int64_t ns;
+        if (uploadPending[i] && uploadStamps->read(i, ns)) {
+            Latency::stamp(uploadFrame[i], Latency::UPLOADED, ns);
+            uploadPending[i] = false;
+        }
+    }
 
-    curl_easy_setopt(curl, CURLOPT_URL, cameraUrl.c_str());
-    curl_easy_setopt(curl, CURLOPT_POST, 1L);
-    curl_easy_setopt(curl, CURLOPT_POSTFIELDS, "{\"name\":\"camera.getLivePreview\"}");
-    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, this);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT, 0L);  // No timeout, continuous stream
+    // (if the slot's last query is somehow still pending, this frame goes untimed)
+    bool stamped = !uploadPending[current];
+    if (stamped) {
+        uploadPending[current] = true;
+        uploadFrame[current] = ids[current];
+    }
+
+    vk::CommandBuffer& cmd = transfer.command() << [&](vk::CommandBuffer& cmd) {
+
+        // gpu path: the planes go to device-local memory, prepare() converts them
+        if (ycbcr) {
+            cmd.copyBuffer(*stagingBuffer[current], *planeBuffer[current], bytes);
+            if (stamped) uploadStamps->write(cmd, current, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+            return;
+        }
+
+        // the whole image gets overwritten, so discard the old contents.
+        // it was last used on other queues (the draw, or compute), at stages this one
+        // may not have. the submit waits for those readers (see readBy()), the barrier
+        // only has to come after the earlier work on this queue
+        img.assume(VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT);
+        cmd.use(img, vk::Image::TRANSFER_DST, true);
+
+        cmd.copyBufferToImage(*stagingBuffer[current], img, {WIDTH, HEIGHT, 1}, VK_IMAGE_ASPECT_COLOR_BIT);
+
+        // leave it ready for compute, the timeline wait makes the write visible
+        // (by hand, use() would wait at the compute stage, which a transfer queue doesn't have)
+        cmd.imageTransition(img,
+            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+            VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+            VK_IMAGE_ASPECT_COLOR_BIT
+        );
+
+        if (stamped) uploadStamps->write(cmd, current, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    };
+
+    // this overwrites what the gpu read the slot's last frame from (the image, or the
+    // planes on the gpu path, where prepare() then waits for this), so it waits for those
+    uint64_t value = uploads->next();
+    transfer.submit(cmd, readers[current], {uploads->at(value)});
+    readers[current].clear();
+
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    slotUpload[current] = value;
+    return value;
+}
+
+void Webcam::readBy(vk::Image& img, vk::Sync sync) {
+
+    size_t slot = std::find(imageBuffer.begin(), imageBuffer.end(), &img) - imageBuffer.begin();
+    if (slot == imageBuffer.size()) return;
+
+    // one point per semaphore, the later value covers the earlier ones
+    sync.stage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+    for (vk::Sync& s : readers[slot]) {
+        if (s.semaphore == sync.semaphore) {
+            s.value = std::max(s.value, sync.value);
+            return;
+        }
+    }
+    readers[slot].push_back(sync);
+}
+
+// called with bufferMutex held, by the decoder
+void Webcam::waitUpload(size_t slot) {
+
+    if (slotUpload[slot] != 0) uploads->wait(slotUpload[slot]);
+}
+
+void Webcam::prepare(vk::CommandBuffer& cmd) {
+
+    // the cpu path is ready to go once upload() is done
+    if (!ycbcr) return;
 
-    curl_easy_perform(curl);  // Blocking call, continuously receives data
+    vk::Image& img = *imageBuffer[current];
+
+    PlaneLayout layout;
+    {
+        std::lock_guard<std::mutex> lock(bufferMutex);
+        layout = planeLayout[current];
+    }
+
+    // the whole image gets overwritten, so discard the old contents
+    cmd.use(img, vk::Image::STORAGE_WRITE, true);
+
+    // pushed, so a frame that's still in flight keeps the last ones
+    yuv->writeDescriptor(0, 0, *planeBuffer[current], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    yuv->writeDescriptor(0, 1, img, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+
+    cmd.bindPipeline(*yuv);
+    cmd.setPcr(*yuv, 0, layout);
+    cmd.dispatch((WIDTH + 15) / 16, (HEIGHT + 15) / 16, 1);
+
+    // make the rgb result visible to the following compute passes
+    cmd.use(img, vk::Image::STORAGE_READ);
+}
 
-    curl_easy_cleanup(curl);
+Webcam::Stats Webcam::stats() {
+    std::lock_guard<std::mutex> lock(bufferMutex);
+    return {
+        .frames = framesDecoded,
+        .bytes = bytesIn,
+        .decode_ms = framesDecoded ? decodeNs / 1e6 / framesDecoded : 0.,
+    };
 }
 
 std::vector<VkImageView> Webcam::allimageviews() {
@@ -10,49 +10,142 @@
 #include <condition_variable>
 #include <atomic>
 #include <string>
+#include <chrono>
+#include <turbojpeg.h>
+
+#include "framesource.h"
+#include "latency.h"
 
 #ifndef HEADER
     #define HEADER
         #include "../vk/device.h"
         #include "../vk/image.h"
+        #include "../vk/timestamps.h"
+        #include "../vk/timeline.h"
     #undef HEADER
 #else
     #include "../vk/device.h"
     #include "../vk/image.h"
+    #include "../vk/timestamps.h"
+    #include "../vk/timeline.h"
 #endif
 
 namespace cm {
 
+// layout of a decoded YCbCr frame inside its plane buffer.
+// mirrors the push constants of the ycbcr.comp shader.
+struct PlaneLayout {
+    int32_t size[2];   // luma plane size
+    int32_t csize[2];  // chroma plane size
+    int32_t shift[2];  // log2 of the chroma subsampling (x, y)
+    int32_t cboff;     // byte offset of the Cb plane (-1 for grayscale)
+    int32_t croff;     // byte offset of the Cr plane (-1 for grayscale)
+    int32_t ystride;   // luma row stride, the width rounded up to the MCU
+};
+
 class Webcam {
 public:
-    Webcam(vk::Device&);
+    // transfer - queue to upload the frames on (ideally a dedicated transfer queue,
+    //            it may also be the draw's, see Queue::shares())
+    // ycbcr - decode to planar YCbCr and convert to RGB on the gpu (see prepare())
+    //         instead of converting to BGRA on the cpu
+    // source - where the frames come from, the webcam takes ownership.
+    //          defaults to the theta's live preview.
+    Webcam(vk::Device&, vk::Queue& transfer, bool ycbcr = false, FrameSource* source = nullptr);
     ~Webcam();
 
     void startStreaming();
     void stopStreaming();
     vk::Image& getNextImage();
 
+    // getNextImage() without the wait: nullptr if there's no new frame yet
+    vk::Image* tryNextImage();
+
+    // id of the frame returned by getNextImage(), for cm::Latency
+    uint64_t frame();
+
+    // submits the copy of the frame returned by getNextImage() from its staging
+    // buffer to the gpu, on the transfer queue. returns the value that timeline()
+    // reaches when the copy is done -- wait on that before using the frame.
+    // also stamps Latency::UPLOADED for the earlier uploads that finished.
+    // the copy waits for the last readers of the slot, see readBy().
+    uint64_t upload();
+    vk::Timeline& timeline() {return *uploads;}
+
+    // the gpu reads img (one of the ring's images) until sync is reached:
+    // the next upload into its slot waits for that. (same thread as upload())
+    void readBy(vk::Image& img, vk::Sync sync);
+
+    // records everything needed to make the uploaded frame readable by compute in
+    // VK_IMAGE_LAYOUT_GENERAL. on the gpu path that's the YCbCr->RGB conversion,
+    // on the cpu path upload() already did it.
+    void prepare(vk::CommandBuffer&);
+
     static constexpr size_t BUFFER_SIZE = 5;  // Ring buffer size
+    static constexpr uint32_t WIDTH = 1024;   // probe image size
+    static constexpr uint32_t HEIGHT = 512;
+    static constexpr size_t MAX_FRAME_SIZE = 16 << 20;  // give up on a frame without EOI after this
 
     std::vector<VkImageView> allimageviews();
 
+    // ingest counters, for benchmarking
+    struct Stats {
+        uint64_t frames;   // frames decoded
+        uint64_t bytes;    // bytes received from the source
+        double decode_ms;  // average decode time
+    };
+    Stats stats();
+
 private:
     void fetchFrames();  // Background thread function
+    void ingest(const uint8_t*, size_t);  // scans the stream for jpegs and decodes them
+    void publish(std::chrono::steady_clock::time_point);
+    bool decodePlanes(const uint8_t*, size_t, size_t);  // jpeg -> YCbCr planes in a ring slot
+    void waitUpload(size_t);  // until the slot's staging buffer can be written again
 
     std::thread streamingThread;
     std::mutex bufferMutex;
     std::condition_variable bufferCondVar;
     std::atomic<bool> running;
 
-    std::vector<vk::Image*> imageBuffer;
+    std::vector<vk::Image*> imageBuffer;     // device-local, optimal tiling
+    std::vector<vk::Buffer*> stagingBuffer;  // persistently mapped, the decoder writes here
+    std::vector<void*> stagingPtr;
+    std::vector<uint32_t> frameBytes;        // bytes used in each staging buffer
+
+    vk::Queue& transfer;
+    vk::Timeline* uploads;  // signaled by every upload()
+    std::vector<uint64_t> slotUpload;  // value of the last upload out of each staging buffer
+    std::vector<std::vector<vk::Sync>> readers;  // what the next upload into each slot waits for
+
+    // latency tracing
+    std::vector<uint64_t> frameId;    // frame id in each ring slot
+    uint64_t nextFrameId = 0;
+    uint64_t pendingFrame = 0;        // id of the frame being received, 0 if none
+    vk::Timestamps* uploadStamps;     // one query per slot, at the end of its upload
+    std::vector<bool> uploadPending;  // the slot's query was written but not read yet
+    std::vector<uint64_t> uploadFrame;  // frame id the slot's query belongs to
+
     size_t head;
     size_t tail;
+    size_t current;  // slot last returned by getNextImage()
     bool isBufferFull;
 
-    std::string cameraUrl;
-    std::vector<uint8_t> streamBuffer;  // Buffer for incoming data
+    // gpu YCbCr path
+    bool ycbcr;
+    tjhandle decoder = nullptr;
+    std::vector<vk::Buffer*> planeBuffer;    // device-local copy of the staged planes
+    std::vector<PlaneLayout> planeLayout;
+    vk::ShaderModule* yuv_sh = nullptr;
+    vk::Pipeline* yuv = nullptr;
+
+    FrameSource* source;
+    std::vector<uint8_t> streamBuffer;  // Buffer for incoming data, starts at a SOI when mid-frame
+    size_t scanPos = 0;                 // how far streamBuffer has been searched for the EOI
 
-    friend size_t WriteCallback(void* contents, size_t size, size_t nmemb, void* userp);
+    uint64_t framesDecoded = 0;
+    uint64_t bytesIn = 0;
+    uint64_t decodeNs = 0;
 };
 
 };
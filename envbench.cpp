@@ -0,0 +1,128 @@
+// envbench - runs the environment pipeline on the cpu (sc::EnvironmentRef), no gpu needed.
+//
+// Decodes frames from any cm::FrameSource and prefilters them with both the
+// AVX2 and the scalar path, then prints how long each step took on average
+// and how far apart the two paths' results are.
+// Only the cpu side is built in (no vulkan needed):
+//
+//   make envbench
+//   ./envbench --source mjpeg:recording.mjpeg --frames 100 --threads 4
+
+#define HEADER
+#include "sc/envref.cpp"
+#undef HEADER
+#include "360util/framesource.h"
+
+#include <iostream>
+#include <string>
+#include <algorithm>
+#include <cmath>
+#include <turbojpeg.h>
+
+static void usage(const char* argv0) {
+    printf("usage: %s [--source spec] [--frames n] [--threads n]\n", argv0);
+    printf("  --source   frame source, see cm::FrameSource::create (default synthetic@max)\n");
+    printf("  --frames   how many frames to run (default 30)\n");
+    printf("  --threads  worker threads (default every core)\n");
+}
+
+int main(int argc, char** argv) {
+
+    std::string spec = "synthetic@max";
+    int frames = 30;
+    unsigned threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--source" && i + 1 < argc) {
+            spec = argv[++i];
+        } else if (arg == "--frames" && i + 1 < argc) {
+            frames = std::max(1, std::stoi(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    const uint32_t width = 1024, height = 512;  // the probe's size, cm::Webcam::WIDTH/HEIGHT
+    const uint32_t levels = 7;                  // what sc::Environment makes of it, see mipLevels()
+
+    sc::EnvironmentRef simd(width, height, levels), scalar(width, height, levels);
+    simd.simd = true;
+    scalar.simd = false;
+    if (threads) simd.threads = scalar.threads = threads;
+
+    printf("[envbench] %u levels, %u threads, avx2 %s\n",
+           simd.levels, simd.threads, sc::EnvironmentRef::avx2() ? "available" : "not available");
+
+    tjhandle decoder = tjInitDecompress();
+    std::vector<uint8_t> frame(width * height * 4);
+
+    sc::EnvironmentRef::Timing tsimd {}, tscalar {};
+    int done = 0, maxdiff = 0;
+    float sherr = 0;
+
+    // every jpeg the source hands out (they come whole from the replay sources)
+    std::atomic<bool> running(true);
+    cm::FrameSource* source = cm::FrameSource::create(spec);
+    source->stream([&](const uint8_t* data, size_t size) {
+
+        if (!running.load()) return;
+
+        int w, h, sub, cs;
+        if (tjDecompressHeader3(decoder, data, size, &w, &h, &sub, &cs) != 0
+            || (uint32_t) w != width || (uint32_t) h != height) {
+            std::cerr << "[envbench] skipping a frame that isn't a " << width << "x" << height << " jpeg" << std::endl;
+            return;
+        }
+        tjDecompress2(decoder, data, size, frame.data(), width, 0, height, TJPF_BGRA, 0);
+
+        simd.process(frame.data(), width * 4);
+        scalar.process(frame.data(), width * 4);
+
+        tsimd.chain_ms += simd.timing.chain_ms;
+        tsimd.cube_ms += simd.timing.cube_ms;
+        tsimd.sh_ms += simd.timing.sh_ms;
+        tscalar.chain_ms += scalar.timing.chain_ms;
+        tscalar.cube_ms += scalar.timing.cube_ms;
+        tscalar.sh_ms += scalar.timing.sh_ms;
+
+        // the two should only differ by rounding
+        auto compare = [&](const sc::EnvImage& a, const sc::EnvImage& b) {
+            for (size_t i = 0; i < a.px.size(); i++) {
+                int d = std::abs((int) std::lround(a.px[i] * 255) - (int) std::lround(b.px[i] * 255));
+                maxdiff = std::max(maxdiff, d);
+            }
+        };
+        for (uint32_t l = 0; l < simd.levels; l++) {
+            compare(simd.chain[l], scalar.chain[l]);
+            for (int f = 0; f < 6; f++) compare(simd.cube[l][f], scalar.cube[l][f]);
+        }
+        for (int i = 0; i < 9; i++) {
+            for (int c = 0; c < 3; c++) {
+                sherr = std::max(sherr, std::abs(simd.lighting.sh[i][c] - scalar.lighting.sh[i][c]));
+            }
+        }
+
+        if (++done >= frames) running.store(false);
+    }, running);
+
+    tjDestroy(decoder);
+    delete source;
+
+    if (!done) {
+        std::cerr << "[envbench] no frames" << std::endl;
+        return 1;
+    }
+
+    printf("[envbench] %d frames, average ms   chain    cube      sh\n", done);
+    printf("[envbench]   %-6s             %7.2f %7.2f %7.2f\n", sc::EnvironmentRef::avx2() ? "avx2" : "(none)",
+           tsimd.chain_ms / done, tsimd.cube_ms / done, tsimd.sh_ms / done);
+    printf("[envbench]   scalar             %7.2f %7.2f %7.2f\n",
+           tscalar.chain_ms / done, tscalar.cube_ms / done, tscalar.sh_ms / done);
+    printf("[envbench] avx2 vs scalar: max diff %d/255, sh %.2e\n", maxdiff, sherr);
+
+    return 0;
+}
@@ -7,6 +7,7 @@
     #include "mesh.cpp"
     #include "material.cpp"
     #include "camera.cpp"
+    #include "environment.cpp"
     #undef HEADER
 #endif
 
@@ -15,14 +16,21 @@
 
 namespace sc {
 
+// the camera and the lighting, as a uni_Camera_t in the heap: written once per
+// frame (per eye), and every draw points at it
+class CameraBuffer {
 
-struct uni_Transform_t {
-    glm::mat4 model;
-    glm::mat4 norm;
-    glm::mat4 view;
-    glm::mat4 proj;
-    glm::vec3 camerapos;
-    float t;
+    std::vector<vk::Buffer*> buffers;
+    std::vector<uint32_t> heap_idx;  // where each of them is in the heap
+    uint32_t idx = 0;
+    float t = 0;
+
+public:
+    CameraBuffer(vk::Device& d, vk::Heap& heap);
+    ~CameraBuffer();
+
+    // fills the next buffer with the global camera and lighting, returns its index in the heap
+    uint32_t update();
 };
 
 // represents an entity in the scene.
@@ -32,7 +40,9 @@ class Entity {
     Mesh& mesh;
     Material& mat;
 
+    // only if the material doesn't push them
     std::vector<vk::Buffer*> transforms;
+    std::vector<uint32_t> tbuf_heap;  // where each of them is in the material's heap
     uint32_t tbuf_idx;
 
 public:
@@ -44,59 +54,101 @@ public:
 
     ~Entity();
 
-    void set_transforms(vk::CommandBuffer&);
-    void draw(vk::CommandBuffer&);
+    // the model (and normal) matrix
+    uni_Transform_t get_transforms() const;
+
+    // fills the next transforms buffer, returns its index in the heap
+    uint32_t set_transforms();
+
+    // draws it, from the camera (see CameraBuffer::update())
+    void draw(vk::CommandBuffer&, uint32_t camera);
 };
 
 }; // end of instance.h file
 #ifndef HEADER
 namespace sc {
 
+CameraBuffer::CameraBuffer(vk::Device& d, vk::Heap& heap) {
+    for (int i = 0; i < 8; i++) {
+        buffers.push_back(
+            new vk::Buffer(d, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT,
+                sizeof(uni_Camera_t))
+        );
+        heap_idx.push_back(heap.add(*buffers.back()));
+    }
+}
+
+uint32_t CameraBuffer::update() {
+    uni_Camera_t* cam = (uni_Camera_t*) buffers[idx]->map();
+
+    t += 1./60;
+    cam->view = camera.view();
+    cam->proj = camera.proj();
+    cam->camerapos = camera.pos;
+    cam->t = t;
+    for (int i = 0; i < 9; i++) cam->sh[i] = lighting.sh[i];
+
+    uint32_t ret = heap_idx[idx];
+
+    // use the next buffer next time
+    idx = (idx + 1) % 8;
+    return ret;
+}
+
+CameraBuffer::~CameraBuffer() {
+    for (auto i : buffers) {
+        delete i;
+    }
+}
+
 // initialize the entity with the mesh, material, and make buffers for the transforms
 Entity::Entity(vk::Device& d, Mesh& mh, Material& mt): mesh(mh), mat(mt)  {
 
+    tbuf_idx = 0;
+    if (mt.pushes()) return;
+
+    // they stay in the heap, the draw only pushes which one
     for (int i = 0; i < 8; i++) {
         transforms.push_back(
-            new vk::Buffer(d, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+            new vk::Buffer(d, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
                 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT, 
                 sizeof(uni_Transform_t))
         );
+        tbuf_heap.push_back(mt.heap().add(*transforms.back()));
     }
-    tbuf_idx = 0;
 }
 
-// sets descriptor (set=0, binding=0) to the model's transforms. must call descriptorSet(0) beforehand.
-void Entity::set_transforms(vk::CommandBuffer& cmd) {
-    uni_Transform_t* tf = (uni_Transform_t*) transforms[tbuf_idx]->map();
-    
-    // set up the transforms
-    tf->model = glm::translate(
+uni_Transform_t Entity::get_transforms() const {
+    uni_Transform_t tf;
+    tf.model = glm::translate(
                     glm::mat4_cast(rotation) *
                         glm::scale(glm::mat4(1.0), scaling),
                     position
                     );
-    tf->norm = glm::transpose(glm::inverse(tf->model));
-    tf->view = camera.view();
-    tf->proj = camera.proj();
-    tf->camerapos = camera.pos;
-    tf->t += 1./60;
-    
-    // send it off to the shaders
-    mat.writeDescriptor(0, 0, *transforms[tbuf_idx], VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    tf.norm = glm::transpose(glm::inverse(tf.model));
+    return tf;
+}
+
+uint32_t Entity::set_transforms() {
+    *(uni_Transform_t*) transforms[tbuf_idx]->map() = get_transforms();
+
+    uint32_t heap_idx = tbuf_heap[tbuf_idx];
 
     // use the next buffer next time
     tbuf_idx = (tbuf_idx + 1) % 8;
+    return heap_idx;
 }
 
 // draw the current entity
-void Entity::draw(vk::CommandBuffer& cmd) {
-
-    // send it off to the shaders
-    mat.descriptorSet(0);
-    set_transforms(cmd);
+void Entity::draw(vk::CommandBuffer& cmd, uint32_t camera) {
 
-    // now bind the pipeline
-    mat.bind(cmd);
+    // bind the pipeline, and send the transforms off to the shaders
+    if (mat.pushes()) {
+        mat.bind(cmd, camera, get_transforms());
+    } else {
+        mat.bind(cmd, camera, set_transforms());
+    }
 
     // we're all set to draw the mesh now
     mesh.draw(cmd);
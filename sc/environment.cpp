@@ -0,0 +1,839 @@
+#ifndef ENVIRONMENT_CPP
+#define ENVIRONMENT_CPP
+
+#ifndef HEADER
+    #define HEADER
+    #include "../vk/vklib.h"
+    #undef HEADER
+#endif
+
+#include "lighting.h"
+#include <map>
+
+namespace sc {
+
+// the global lighting used by the renderer
+extern Lighting lighting;
+
+// Turns the camera's equirectangular frame into the maps used for lighting:
+// a prefiltered cubemap, level 0 is the frame itself and every level above
+// is half the size and blurred twice as wide (in angle) as the one below, so
+// a material picks its roughness with the lod of a single textureLod().
+// The levels are filtered in equirect and then resampled into the cube's faces.
+// And the frame's irradiance, projected onto spherical harmonics, for the diffuse.
+//
+// It runs as an async compute job: submit() puts the work on the compute queue,
+// into one of two sets of outputs (cube and sh), while the graphics queue draws
+// with the other one, see pick(). The two queues hand the outputs back and forth
+// with timeline semaphores, and the cube's ownership is transferred between the
+// queue families when they differ.
+//
+// The work is recorded once per (camera image, output) into a command buffer of
+// its own, and the same one is submitted every time the pair comes round again,
+// so nothing gets recorded while the camera ring goes around.
+// It's timed with gpu timestamps (read them back with timing() once it's done).
+class Environment {
+
+    vk::Device& device;
+    vk::Queue& compute;
+    vk::Queue& graphics;
+    uint32_t slots;
+    uint32_t width, height;
+    uint32_t levels;
+
+    vk::ShaderModule* reduce_sh;
+    vk::Pipeline* reduce;
+    vk::ShaderModule* blur_sh;
+    std::map<std::pair<int, int>, vk::Pipeline*> blurs;  // by axis and radius
+
+    vk::Pipeline& blur(int axis);
+
+    vk::Image* chain;    // the prefiltered levels, equirect
+    vk::Image* scratch;  // row pass results, same levels
+
+    // the original roughblur kernel, made the first time it's used
+    vk::ShaderModule* legacy_sh = nullptr;
+    vk::Pipeline* legacy = nullptr;
+
+    void blurLegacy(vk::CommandBuffer&, uint32_t level);
+    vk::ShaderModule* tocube_sh;
+    vk::Pipeline* tocube;
+    vk::Image* cube[2];  // the prefiltered levels, as a cubemap
+    uint32_t face;       // size of level 0 of the cube
+
+    vk::ShaderModule* project_sh;
+    vk::Pipeline* project;
+    vk::ShaderModule* sum_sh;
+    vk::Pipeline* sum;
+
+    uint32_t groups;      // workgroups of the projection
+    vk::Buffer* partials; // 9 sums per workgroup
+    vk::Buffer* coeffs[2]; // the final 9, host visible
+
+    vk::Timestamps* stamps;   // start, end of the processing, a pair per output
+    uint64_t stamped[2] {};   // the job each pair is from, 0 once it's been read
+
+    // job n (from 1) fills output (n - 1) % 2, and signals done at n once it's finished.
+    // every pick() signals drawn at the next value once its draw is finished
+    vk::Timeline* done;
+    vk::Timeline* drawn;
+    uint64_t jobs = 0;        // submitted
+    uint64_t settled = 0;     // jobs submitted before the last pick()
+    uint64_t shown = 0;       // the job pick() picked
+    bool changed = false;     // shown is another output than the pick() before
+    uint64_t draws = 0;
+    uint64_t lastdraw[2] {};  // the last draw that read each output
+    vk::Image* sources[2] {}; // the camera image each output was made from
+
+    // the recorded command buffers, by the probe image they read and the output they fill
+    std::map<std::pair<VkImage, uint32_t>, vk::CommandBuffer*> recorded;
+
+    void record(vk::CommandBuffer&, vk::Image& probe, uint32_t out);
+
+public:
+    static constexpr uint32_t MAX_LEVELS = 7;  // 1024x512 down to 16x8, faces of 256 down to 4
+
+    enum Kernel {
+        TILED,   // separable, rows then columns, through shared memory
+        LEGACY,  // the original one-pass-per-axis imageLoad kernel, for comparison
+    };
+
+    Kernel kernel = TILED;  // set before any work is recorded, it's baked into the recordings
+
+    // gaussian radius of each level's blur, in pixels of that level
+    // (at the equator, rows get wider towards the poles).
+    // it's compiled into the blur, every radius used gets its own pipelines.
+    // 0 leaves the levels as they were reduced (the passes only copy), below 0 counts as 0
+    int radius = 2;
+
+    // compute - the queue the processing runs on
+    // graphics - the queue that draws with the outputs
+    // slots - how many different probe images there are (the camera's ring)
+    Environment(vk::Device&, vk::Queue& compute, vk::Queue& graphics,
+                uint32_t width, uint32_t height, uint32_t slots = 1);
+    ~Environment();
+
+    // submits the processing of probe (GENERAL, readable by compute, once the
+    // compute queue gets to it) into the output that isn't drawn with.
+    // after - more compute work that reads the outputs (eg. copies of equirect()),
+    //         submitted before they're handed to graphics
+    void submit(vk::Image& probe, vk::CommandBuffer* after = nullptr);
+
+    // picks the output the next draw uses, before the draw is submitted (or recorded).
+    // latest - the job submitted since the last pick(), in lock-step with compute.
+    //          otherwise the one before it, so that this draw overlaps the processing
+    //          of the newest frame. (the first job is always taken)
+    // returns true if it's a different output than the last pick(), in which case
+    // source() is still GENERAL.
+    // the draw has to be submitted waiting on ready() and signaling finished()
+    bool pick(bool latest);
+
+    // records the picked output's acquire into the draw's cmd (graphics)
+    void acquire(vk::CommandBuffer& cmd);
+
+    // what the draw of the last pick() waits on (at the fragment shader), and signals
+    vk::Sync ready() const {return done->at(shown, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);}
+    vk::Sync finished() const {return drawn->at(draws);}
+
+    // the job pick() picked, counting from 1
+    uint64_t job() const {return shown;}
+
+    // where the last submit()'s job is done
+    vk::Sync submitted() const {return done->at(jobs);}
+
+    // gpu start and end of a finished job that wasn't read yet (the older one first),
+    // on the steady_clock in ns, and which job it was (counting from 1, see job()).
+    // false if there's none (or they weren't timed)
+    bool timing(int64_t& start, int64_t& end, uint64_t& job);
+
+    // copies the coefficients of the newest finished job into l
+    void irradiance(Lighting& l);
+
+    // the cubemap picked by pick(), VK_IMAGE_VIEW_TYPE_CUBE, SHADER_READ_ONLY
+    vk::Image& prefiltered() {return *cube[(shown - 1) % 2];}
+
+    // the camera image it was made from
+    vk::Image& source() {return *sources[(shown - 1) % 2];}
+
+    // the equirect levels of the last submitted job (GENERAL, compute)
+    vk::Image& equirect() {return *chain;}
+
+    uint32_t mipLevels() {return levels;}
+};
+
+}; // end of environment header
+#ifndef HEADER
+#include <cstring>
+#include <stdexcept>
+
+namespace sc {
+
+Lighting lighting {};
+
+// storage image for one of the processing steps, with mip levels
+static vk::Image* envimage(vk::Device& d, uint32_t width, uint32_t height, uint32_t levels) {
+    vk::Image* img = new vk::Image(d, {
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = vk_COLOR_FORMAT,
+        .extent = {width, height, 1},
+        .mipLevels = levels,
+        .tiling = VK_IMAGE_TILING_OPTIMAL,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+    },  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    img->view({
+        .viewType = VK_IMAGE_VIEW_TYPE_2D,
+        .format = vk_COLOR_FORMAT,
+        .subresourceRange = {
+        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+        .levelCount = levels}
+    });
+
+    return img;
+}
+
+// makes the writes of the previous dispatch visible to the next one
+static void computeBarrier(vk::CommandBuffer& cmd, vk::Image& img) {
+    cmd.use(img, vk::Image::STORAGE_WRITE);
+}
+
+Environment::Environment(vk::Device& d, vk::Queue& compute, vk::Queue& graphics,
+                         uint32_t width, uint32_t height, uint32_t slots)
+    : device(d), compute(compute), graphics(graphics), slots(slots), width(width), height(height) {
+
+    // down to 8ish pixels on the short side
+    levels = 1;
+    while (levels < MAX_LEVELS && (std::min(width, height) >> levels) >= 8) levels++;
+
+    chain = envimage(d, width, height, levels);
+    scratch = envimage(d, width, height, levels);
+
+    // a face covers a quarter of the equator
+    face = width / 4;
+
+    // two of them, one gets drawn with while the other is being filled
+    for (int i = 0; i < 2; i++) {
+        cube[i] = new vk::Image(d, {
+            .flags = VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT,
+            .imageType = VK_IMAGE_TYPE_2D,
+            .format = vk_COLOR_FORMAT,
+            .extent = {face, face, 1},
+            .mipLevels = levels,
+            .arrayLayers = 6,
+            .tiling = VK_IMAGE_TILING_OPTIMAL,
+            .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+        },  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+        cube[i]->view({
+            .viewType = VK_IMAGE_VIEW_TYPE_CUBE,
+            .format = vk_COLOR_FORMAT,
+            .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .levelCount = levels,
+            .layerCount = 6}
+        });
+        cube[i]->sampler();
+    }
+
+    stamps = new vk::Timestamps(d, compute, 4);
+    done = new vk::Timeline(d);
+    drawn = new vk::Timeline(d);
+
+    // box filters the source down to the destination's size (or copies it, if it's the same size)
+    reduce_sh = new vk::ShaderModule(d, "envreduce.comp",
+    SHADERCODE(
+        layout (binding = 0, rgba8) uniform readonly image2D source;
+        layout (binding = 1, rgba8) uniform writeonly image2D dest;
+
+        layout(local_size_x = 16, local_size_y = 16) in;
+
+        void main() {
+
+            ivec2 size = imageSize(dest);
+            ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+            if (any(greaterThanEqual(coord, size))) return;
+
+            ivec2 scale = max(imageSize(source) / size, ivec2(1));
+            vec4 sum = vec4(0.);
+            for (int y = 0; y < scale.y; y++) {
+                for (int x = 0; x < scale.x; x++) {
+                    sum += imageLoad(source, coord * scale + ivec2(x, y));
+                }
+            }
+
+            imageStore(dest, coord, sum / float(scale.x * scale.y));
+        }
+    )
+    );
+
+    reduce = &vk::Pipeline::Compute(d, *reduce_sh, true);
+
+    // gaussian blur along one axis. a workgroup does 256 pixels of a row (or column):
+    // it loads them, plus the apron the taps reach into, into shared memory once,
+    // and all the taps read from there.
+    // rows wrap around (longitude), columns clamp at the poles.
+    blur_sh = new vk::ShaderModule(d, "envblur.comp",
+    SHADERCODE(
+        layout (binding = 0, rgba8) uniform readonly image2D source;
+        layout (binding = 1, rgba8) uniform writeonly image2D dest;
+
+        layout (constant_id = 0) const int AXIS = 0;  // 0: rows, 1: columns
+        layout (constant_id = 1) const int RADIUS = 2;
+
+        const int TILE = 256;
+        const int APRON = 64;  // furthest a tap can reach
+        const float PI = 3.14159265;
+
+        // a column's reach is the radius, known when it's compiled (its taps can be
+        // unrolled). a row's depends on the latitude, it's only known at runtime
+        const int COLUMN_REACH = RADIUS > APRON ? APRON : RADIUS > 1 ? RADIUS : 1;
+
+        layout(local_size_x = 256) in;
+
+        shared vec3 line[TILE + 2 * APRON];
+
+        vec3 load(int p, int other, ivec2 size) {
+            if (AXIS == 0) {
+                return imageLoad(source, ivec2((p % size.x + size.x) % size.x, other)).rgb;
+            }
+            return imageLoad(source, ivec2(other, clamp(p, 0, size.y - 1))).rgb;
+        }
+
+        void main() {
+
+            ivec2 size = imageSize(source);
+            int len = AXIS == 0 ? size.x : size.y;
+            int lane = int(gl_LocalInvocationID.x);
+            int start = int(gl_WorkGroupID.x) * TILE;
+            int other = int(gl_WorkGroupID.y);  // the row (or column) this workgroup is on
+
+            // no blur, the pass is a copy
+            if (RADIUS <= 0) {
+                ivec2 coord = AXIS == 0 ? ivec2(start + lane, other) : ivec2(other, start + lane);
+                if (start + lane < len) imageStore(dest, coord, vec4(imageLoad(source, coord).rgb, 1.));
+                return;
+            }
+
+            // a pixel of a row covers less of the sphere towards the poles, so widen
+            // the row blur by 1/cos(latitude), as far as the apron allows
+            float radius = max(float(RADIUS), 0.5);
+            float stretch = 1.;
+            if (AXIS == 0) {
+                float lat = ((float(other) + 0.5) / float(size.y) - 0.5) * PI;
+                stretch = min(1. / max(cos(lat), 1e-3), float(APRON) / radius);
+            }
+            int reach = AXIS == 0 ? min(int(ceil(radius * stretch)), APRON) : COLUMN_REACH;
+
+            // tile + apron, strided over the workgroup
+            for (int i = lane; i < TILE + 2 * reach; i += TILE) {
+                line[i] = load(start - reach + i, other, size);
+            }
+
+            barrier();
+
+            if (start + lane >= len) return;
+
+            // sigma = radius / 2, in unstretched pixels
+            float k = -2. / (radius * radius * stretch * stretch);
+            vec3 sum = vec3(0.);
+            float wsum = 0.;
+            for (int o = -reach; o <= reach; o++) {
+                float w = exp(k * float(o * o));
+                sum += line[lane + reach + o] * w;
+                wsum += w;
+            }
+
+            ivec2 coord = AXIS == 0 ? ivec2(start + lane, other) : ivec2(other, start + lane);
+            imageStore(dest, coord, vec4(sum / wsum, 1.));
+        }
+    )
+    );
+
+    // the pipelines, one per axis and radius, are made by blur() once they're needed
+
+    // resamples a level of the equirect chain into the same level of the cube's faces,
+    // bilinear, wrapping around in longitude
+    tocube_sh = new vk::ShaderModule(d, "envcube.comp",
+    SHADERCODE(
+        layout (binding = 0, rgba8) uniform readonly image2D source;
+        layout (binding = 1, rgba8) uniform writeonly image2DArray dest;
+
+        const float PI = 3.14159265;
+
+        layout(local_size_x = 8, local_size_y = 8) in;
+
+        vec4 load(ivec2 p, ivec2 size) {
+            return imageLoad(source, ivec2((p.x % size.x + size.x) % size.x, clamp(p.y, 0, size.y - 1)));
+        }
+
+        void main() {
+
+            int size = imageSize(dest).x;
+            ivec3 coord = ivec3(gl_GlobalInvocationID.xyz);
+            if (coord.x >= size || coord.y >= size) return;
+
+            // direction through the middle of the texel, faces in the order (and orientation) the sampler picks them
+            vec2 st = (vec2(coord.xy) + 0.5) / float(size) * 2. - 1.;
+            vec3 dir;
+            if (coord.z == 0) dir = vec3( 1., -st.y, -st.x);
+            if (coord.z == 1) dir = vec3(-1., -st.y,  st.x);
+            if (coord.z == 2) dir = vec3(st.x,  1.,  st.y);
+            if (coord.z == 3) dir = vec3(st.x, -1., -st.y);
+            if (coord.z == 4) dir = vec3(st.x, -st.y,  1.);
+            if (coord.z == 5) dir = vec3(-st.x, -st.y, -1.);
+            dir = normalize(dir);
+
+            // the same mapping as the frame's: longitude along x, latitude along y
+            ivec2 esize = imageSize(source);
+            vec2 uv = vec2(atan(dir.z, dir.x) / (2. * PI) + 0.5, asin(dir.y) / PI + 0.5);
+            vec2 p = uv * vec2(esize) - 0.5;
+            ivec2 i = ivec2(floor(p));
+            vec2 f = p - vec2(i);
+
+            vec4 c = mix(mix(load(i, esize),              load(i + ivec2(1, 0), esize), f.x),
+                         mix(load(i + ivec2(0, 1), esize), load(i + ivec2(1, 1), esize), f.x), f.y);
+
+            imageStore(dest, coord, c);
+        }
+    )
+    );
+
+    // one per level
+    tocube = &vk::Pipeline::Compute(d, *tocube_sh, true);
+
+    // projects the frame onto the sh basis. every invocation does 2x2 pixels, weighted by
+    // the solid angle they cover, and the workgroup's 32x32 pixels get summed in shared memory.
+    // sum.comp adds up the workgroups.
+    groups = ((width + 31) / 32) * ((height + 31) / 32);
+    partials = new vk::Buffer(d, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, groups * 9 * sizeof(glm::vec4));
+    for (int i = 0; i < 2; i++) {
+        coeffs[i] = new vk::Buffer(d, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, 9 * sizeof(glm::vec4));
+
+        // no light until the first frame is done
+        coeffs[i]->mapped([](void* ptr) { memset(ptr, 0, 9 * sizeof(glm::vec4)); });
+    }
+
+    project_sh = new vk::ShaderModule(d, "envsh.comp",
+    SHADERCODE(
+        layout (binding = 0, rgba8) uniform readonly image2D source;
+        layout (binding = 1) writeonly buffer Partials { vec4 partials[]; };
+
+        const float PI = 3.14159265;
+
+        layout(local_size_x = 16, local_size_y = 16) in;
+
+        shared vec3 red[256];
+
+        // real sh basis up to l = 2
+        void basis(vec3 d, out float Y[9]) {
+            Y[0] = 0.282095;
+            Y[1] = 0.488603 * d.y;
+            Y[2] = 0.488603 * d.z;
+            Y[3] = 0.488603 * d.x;
+            Y[4] = 1.092548 * d.x * d.y;
+            Y[5] = 1.092548 * d.y * d.z;
+            Y[6] = 0.315392 * (3. * d.z * d.z - 1.);
+            Y[7] = 1.092548 * d.x * d.z;
+            Y[8] = 0.546274 * (d.x * d.x - d.y * d.y);
+        }
+
+        void main() {
+
+            ivec2 size = imageSize(source);
+            uint lane = gl_LocalInvocationIndex;
+
+            vec3 acc[9];
+            for (int i = 0; i < 9; i++) acc[i] = vec3(0.);
+
+            ivec2 base = ivec2(gl_WorkGroupID.xy) * 32 + ivec2(gl_LocalInvocationID.xy) * 2;
+            for (int y = 0; y < 2; y++) {
+                for (int x = 0; x < 2; x++) {
+                    ivec2 p = base + ivec2(x, y);
+                    if (p.x >= size.x || p.y >= size.y) continue;
+
+                    // the same mapping as the materials' lookups
+                    float lat = ((float(p.y) + 0.5) / float(size.y) - 0.5) * PI;
+                    float lon = (float(p.x) + 0.5) / float(size.x) * 2. * PI - PI;
+                    vec3 d = vec3(cos(lat) * cos(lon), sin(lat), cos(lat) * sin(lon));
+
+                    // a pixel covers less of the sphere towards the poles
+                    float w = cos(lat) * (2. * PI / float(size.x)) * (PI / float(size.y));
+                    vec3 c = imageLoad(source, p).bgr * w;
+
+                    float Y[9];
+                    basis(d, Y);
+                    for (int i = 0; i < 9; i++) acc[i] += c * Y[i];
+                }
+            }
+
+            // sum each coefficient over the workgroup
+            uint group = gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x;
+            for (int i = 0; i < 9; i++) {
+                red[lane] = acc[i];
+                barrier();
+                for (uint s = 128; s > 0; s >>= 1) {
+                    if (lane < s) red[lane] += red[lane + s];
+                    barrier();
+                }
+                if (lane == 0) partials[group * 9 + i] = vec4(red[0], 0.);
+                barrier();
+            }
+        }
+    )
+    );
+
+    project = &vk::Pipeline::Compute(d, *project_sh, true);
+
+    // adds up the workgroups' sums, and convolves them with the cosine lobe (over pi)
+    sum_sh = new vk::ShaderModule(d, "envshsum.comp",
+    SHADERCODE(
+        layout (binding = 0) readonly buffer Partials { vec4 partials[]; };
+        layout (binding = 1) writeonly buffer Coeffs { vec4 sh[9]; };
+
+        layout (push_constant) uniform config { uint groups; } cfg;
+
+        layout(local_size_x = 256) in;
+
+        shared vec3 red[256];
+
+        void main() {
+
+            uint lane = gl_LocalInvocationIndex;
+            const float band[3] = float[](1., 2. / 3., 1. / 4.);
+
+            for (int i = 0; i < 9; i++) {
+                vec3 s = vec3(0.);
+                for (uint g = lane; g < cfg.groups; g += 256) s += partials[g * 9 + i].xyz;
+
+                red[lane] = s;
+                barrier();
+                for (uint n = 128; n > 0; n >>= 1) {
+                    if (lane < n) red[lane] += red[lane + n];
+                    barrier();
+                }
+                if (lane == 0) sh[i] = vec4(red[0] * band[i == 0 ? 0 : i < 4 ? 1 : 2], 0.);
+                barrier();
+            }
+        }
+    )
+    );
+
+    sum = &vk::Pipeline::Compute(d, *sum_sh, true);
+}
+
+void Environment::submit(vk::Image& probe, vk::CommandBuffer* after) {
+
+    uint32_t out = jobs % 2;
+
+    // recorded the first time this pair comes up.
+    // the descriptors are pushed, so they're part of the recording.
+    // (without push descriptors the sets only last the frame, it's recorded every time)
+    auto key = std::make_pair((VkImage) probe, out);
+    if (!device.pushDescriptors()) {
+        recorded[key] = &(compute.command() << [&](vk::CommandBuffer& cmd) {
+            record(cmd, probe, out);
+        });
+    } else if (!recorded.count(key)) {
+        if (recorded.size() == slots * 2) {
+            throw std::runtime_error("sc::Environment: more probe images than slots");
+        }
+        recorded[key] = &(compute.dedicated() << [&](vk::CommandBuffer& cmd) {
+            record(cmd, probe, out);
+        });
+    }
+
+    jobs = done->next();
+    sources[out] = &probe;
+
+    // a new job overwrites its output's stamps, read or not
+    stamped[out] = jobs;
+
+    // the last draw with this output has to be done before it gets overwritten,
+    // and the output goes to graphics after the last thing that reads it
+    vk::Sync reusable = drawn->at(lastdraw[out], VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+    if (after) {
+        compute.submit(*recorded[key], {reusable}, {});
+        compute.submit(*after, {}, {done->at(jobs)});
+    } else {
+        compute.submit(*recorded[key], {reusable}, {done->at(jobs)});
+    }
+}
+
+bool Environment::pick(bool latest) {
+
+    uint64_t picked = latest || !settled ? jobs : settled;
+    settled = jobs;
+    draws = drawn->next();
+
+    changed = picked != shown;
+    shown = picked;
+    if (!shown) return false;
+
+    lastdraw[(shown - 1) % 2] = draws;
+    return changed;
+}
+
+void Environment::acquire(vk::CommandBuffer& cmd) {
+
+    if (!shown) return;
+    uint32_t out = (shown - 1) % 2;
+
+    // the second half of the release at the end of record()
+    if (changed && compute.getfamily() != graphics.getfamily()) {
+        cmd.imageTransition(*cube[out],
+            VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
+            VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+            VK_IMAGE_ASPECT_COLOR_BIT,
+            compute.getfamily(), graphics.getfamily()
+        );
+    }
+}
+
+// the blur along an axis at the current radius. both are specialization constants,
+// so the shader's branches on the axis are folded when it's compiled, and so are
+// the columns' taps. the rows' tap count still varies with the latitude
+vk::Pipeline& Environment::blur(int axis) {
+
+    int r = std::max(radius, 0);
+    vk::Pipeline*& p = blurs[{axis, r}];
+    if (p) return *p;
+
+    vk::Specialization spec;
+    spec.set(0, axis).set(1, r);
+    p = &vk::Pipeline::Compute(device, *blur_sh, true, spec);
+    return *p;
+}
+
+void Environment::record(vk::CommandBuffer& cmd, vk::Image& probe, uint32_t out) {
+
+    vk::Image& cube = *this->cube[out];
+
+    // submitted over and over, so the queries are reset on the gpu first
+    stamps->reset(cmd, out * 2, 2);
+    stamps->write(cmd, out * 2, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    // submitted again after other jobs on this queue, which can still be reading
+    // and writing the same images (and partials), so wait for whatever compute did
+    // before, not for what was tracked when this was recorded
+    for (vk::Image* im : {&cube, chain, scratch}) {
+        im->assume(VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT);
+    }
+    cmd.memoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT);
+
+    // all get fully overwritten
+    cmd.use({
+        {&cube, vk::Image::STORAGE_WRITE, true},
+        {chain, vk::Image::STORAGE_WRITE, true},
+        {scratch, vk::Image::STORAGE_WRITE, true},
+    });
+
+    // irradiance: frame -> per workgroup sums -> coefficients
+    project->writeDescriptor(0, 0, probe, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    project->writeDescriptor(0, 1, *partials, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    cmd.bindPipeline(*project);
+    cmd.dispatch((width + 31) / 32, (height + 31) / 32, 1);
+
+    cmd.memoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT);
+
+    sum->writeDescriptor(0, 0, *partials, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    sum->writeDescriptor(0, 1, *coeffs[out], VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+    cmd.bindPipeline(*sum);
+    cmd.setPcr(*sum, 0, groups);
+    cmd.dispatch(1, 1, 1);
+
+    // read back on the cpu, once the frame is done
+    cmd.memoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                      VK_PIPELINE_STAGE_HOST_BIT, VK_ACCESS_HOST_READ_BIT);
+
+    // level 0 is the frame as it is
+    reduce->writeDescriptor(0, 0, probe, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+    reduce->writeDescriptor(0, 1, *chain, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 0);
+    cmd.bindPipeline(*reduce);
+    cmd.dispatch((width + 15) / 16, (height + 15) / 16, 1);
+
+    // every other level: half the last one, then blur it.
+    // the blur is the same number of pixels on every level, so twice the angle of the last
+    vk::Pipeline& rows = blur(0);
+    vk::Pipeline& columns = blur(1);
+    for (uint32_t l = 1; l < levels; l++) {
+        VkExtent3D size = chain->extent(l);
+
+        // level l-1 -> level l
+        computeBarrier(cmd, *chain);
+        reduce->writeDescriptor(0, 0, *chain, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l - 1);
+        reduce->writeDescriptor(0, 1, *chain, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l);
+        cmd.bindPipeline(*reduce);
+        cmd.dispatch((size.width + 15) / 16, (size.height + 15) / 16, 1);
+
+        if (kernel == LEGACY) {
+            computeBarrier(cmd, *chain);
+            blurLegacy(cmd, l);
+            continue;
+        }
+
+        // rows: chain -> scratch
+        computeBarrier(cmd, *chain);
+        rows.writeDescriptor(0, 0, *chain, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l);
+        rows.writeDescriptor(0, 1, *scratch, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l);
+        cmd.bindPipeline(rows);
+        cmd.dispatch((size.width + 255) / 256, size.height, 1);
+
+        // columns: scratch -> chain
+        computeBarrier(cmd, *scratch);
+        columns.writeDescriptor(0, 0, *scratch, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l);
+        columns.writeDescriptor(0, 1, *chain, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l);
+        cmd.bindPipeline(columns);
+        cmd.dispatch((size.height + 255) / 256, size.width, 1);
+    }
+
+    // every level into the cube
+    computeBarrier(cmd, *chain);
+    for (uint32_t l = 0; l < levels; l++) {
+        uint32_t size = std::max(1u, face >> l);
+        tocube->writeDescriptor(0, 0, *chain, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l);
+        tocube->writeDescriptor(0, 1, cube, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l);
+        cmd.bindPipeline(*tocube);
+        cmd.dispatch((size + 7) / 8, (size + 7) / 8, 6);
+    }
+
+    // hand the cube to graphics, acquire() records the other half if it's another family
+    cmd.imageTransition(cube,
+        VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+        VK_IMAGE_ASPECT_COLOR_BIT,
+        compute.getfamily(), graphics.getfamily()
+    );
+
+    stamps->write(cmd, out * 2 + 1, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+}
+
+// the original roughblur kernel on a level, chain -> scratch -> chain.
+// as it always was (Y pass first, no barrier in between, every third tap), only
+// sized for the level instead of the screen. it's there to compare the gpu time,
+// the result is as wrong as it was (and its X pass now races the Y pass on the level)
+void Environment::blurLegacy(vk::CommandBuffer& cmd, uint32_t l) {
+
+    if (!legacy) {
+        legacy_sh = new vk::ShaderModule(device, "roughblur.comp",
+        SHADERCODE(
+            layout (binding = 0, rgba8) uniform readonly image2D source;
+            layout (binding = 1, rgba8) uniform           image2D halfway;
+            layout (binding = 2, rgba8) uniform writeonly image2D dest;
+
+            layout (push_constant) uniform config { int rad; } cfg;
+
+            layout(local_size_x = 32, local_size_y = 32) in;
+
+            void main() {
+
+                ivec2 maxres = imageSize(halfway);
+                const int step = 3;
+
+                ivec2 coord = ivec2(gl_GlobalInvocationID.xy);
+                vec4 color = vec4(0., 0., 0., 1.);
+                float sc = abs(cfg.rad) * 2 + 1;
+                      sc = float(step) / sc;
+
+                float xstp = float(coord.y) / float(maxres.y);
+                      xstp = (xstp - 0.5) * 2 * 3.14159;
+                      xstp = abs(sin(xstp)) + 1.;
+
+                vec2 dir = cfg.rad > 0 ? vec2(xstp, 0.) : vec2(0., 1.);
+
+                for (int i = -abs(cfg.rad); i <= abs(cfg.rad); i+=step) {
+                    vec2 jcoord = vec2(coord) + dir * i;
+                    ivec2 icoord;
+                          icoord.x = int(mod(jcoord.x + maxres.x, maxres.x));
+                          icoord.y = int(mod(jcoord.y + maxres.y, maxres.y));
+                    if (cfg.rad > 0) {
+                        color.rgb += imageLoad(source, icoord).bgr * sc;
+                    } else {
+                        color.rgb += imageLoad(halfway, icoord).bgr * sc;
+                    }
+                }
+
+                if (cfg.rad > 0) {
+                    imageStore(halfway, coord, color);
+                } else {
+                    imageStore(dest, coord, color);
+                }
+
+            }
+        )
+        );
+
+        legacy = &vk::Pipeline::Compute(device, *legacy_sh, true);
+    }
+
+    VkExtent3D size = chain->extent(l);
+
+    legacy->writeDescriptor(0, 0, *chain, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l);
+    legacy->writeDescriptor(0, 1, *scratch, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l);
+    legacy->writeDescriptor(0, 2, *chain, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, l);
+
+    cmd.bindPipeline(*legacy);
+
+    uint32_t groupCountX = (size.width + 31) / 32;
+    uint32_t groupCountY = (size.height + 31) / 32;
+
+    cmd.setPcr(*legacy, 0, -radius); // Y-blur
+    cmd.dispatch(groupCountX, groupCountY, 1);
+    cmd.setPcr(*legacy, 0, radius);  // X-blur
+    cmd.dispatch(groupCountX, groupCountY, 1);
+}
+
+void Environment::irradiance(Lighting& l) {
+    uint64_t finished = done->value();
+    if (!finished) return;
+    memcpy(l.sh, coeffs[(finished - 1) % 2]->map(), sizeof(l.sh));
+}
+
+bool Environment::timing(int64_t& start, int64_t& end, uint64_t& job) {
+    uint64_t finished = done->value();
+
+    // the older output first, each one's queries only hold the job that wrote them last
+    uint32_t out = stamped[0] && (!stamped[1] || stamped[0] < stamped[1]) ? 0 : 1;
+    for (int i = 0; i < 2; i++, out ^= 1) {
+        if (!stamped[out] || stamped[out] > finished) continue;
+
+        // the end is written last, once it's there so is the start
+        if (!stamps->read(out * 2 + 1, end) || !stamps->read(out * 2, start)) continue;
+        job = stamped[out];
+        stamped[out] = 0;
+        return true;
+    }
+    return false;
+}
+
+Environment::~Environment() {
+    delete tocube;
+    delete tocube_sh;
+    delete cube[0];
+    delete cube[1];
+    delete project;
+    delete project_sh;
+    delete sum;
+    delete sum_sh;
+    delete partials;
+    delete coeffs[0];
+    delete coeffs[1];
+    delete reduce;
+    delete reduce_sh;
+    for (auto& [k, p] : blurs) delete p;
+    delete blur_sh;
+    delete legacy;
+    delete legacy_sh;
+    delete stamps;
+    delete done;
+    delete drawn;
+    delete chain;
+    delete scratch;
+}
+
+};
+#endif
+#endif
@@ -0,0 +1,625 @@
+#ifndef ENVREF_CPP
+#define ENVREF_CPP
+
+#include "lighting.h"
+
+#include <vector>
+#include <array>
+#include <cstdint>
+
+namespace sc {
+
+// an rgba float image, 4 floats per pixel, rows tightly packed
+struct EnvImage {
+    uint32_t width = 0, height = 0;
+    std::vector<float> px;
+
+    float* row(uint32_t y) {return px.data() + (size_t) y * width * 4;}
+    const float* row(uint32_t y) const {return px.data() + (size_t) y * width * 4;}
+};
+
+// The cpu version of sc::Environment, for checking the gpu's results and for
+// running the lighting without a gpu.
+//
+// Does the same steps with the same math: the equirect chain (reduce, then the
+// latitude-stretched row and column blur), the cube faces and the sh projection.
+// Every step rounds its output to 8 bits like the gpu's rgba8 images do, so the
+// images come out within a unit or so of the gpu's.
+//
+// Every step has an AVX2 version (used if the cpu has it, and simd is on), and
+// is split over threads by rows. Nothing in it needs vulkan, envbench builds it
+// on its own.
+class EnvironmentRef {
+
+    uint32_t width, height;
+
+public:
+    uint32_t levels;
+    uint32_t face;  // size of level 0 of the cube
+
+    int radius = 2;        // same as Environment::radius (0 doesn't blur)
+    bool simd = true;      // use AVX2 when it's there
+    unsigned threads;      // defaults to every core
+
+    // the results of the last process()
+    std::vector<EnvImage> chain;             // equirect levels
+    std::vector<std::array<EnvImage, 6>> cube;  // faces of every level
+    Lighting lighting;
+
+    // time spent in each step of the last process(), in ms
+    struct Timing {
+        double chain_ms, cube_ms, sh_ms;
+    } timing {};
+
+    // levels - of the chain, the same as the gpu's (Environment::mipLevels())
+    EnvironmentRef(uint32_t width, uint32_t height, uint32_t levels);
+
+    // runs everything on a frame in the probe image's layout (4 bytes per pixel,
+    // stride in bytes). channels stay in the frame's order, like on the gpu.
+    void process(const uint8_t* frame, size_t stride);
+
+    // whether the steps can use AVX2 here
+    static bool avx2();
+};
+
+}; // end of envref header
+#ifndef HEADER
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <immintrin.h>
+
+namespace sc {
+
+static constexpr int APRON = 64;  // furthest a blur tap can reach, as in envblur.comp
+static constexpr float PI = 3.14159265f;
+
+// what an rgba8 image does to a value written into it
+static inline float unorm8(float v) {
+    return std::round(std::clamp(v, 0.f, 1.f) * 255.f) / 255.f;
+}
+
+// runs fn(begin, end) over [0, n) split into one piece per thread
+template <typename func_t>
+static void parallel(uint32_t n, unsigned threads, func_t fn) {
+    threads = std::max(1u, std::min<unsigned>(threads, n));
+    if (threads == 1) {
+        fn(0u, n);
+        return;
+    }
+
+    std::vector<std::thread> pool;
+    for (unsigned t = 0; t < threads; t++) {
+        uint32_t begin = (uint64_t) n * t / threads;
+        uint32_t end = (uint64_t) n * (t + 1) / threads;
+        pool.emplace_back([=] { fn(begin, end); });
+    }
+    for (auto& th : pool) th.join();
+}
+
+static EnvImage envimage(uint32_t width, uint32_t height) {
+    EnvImage img;
+    img.width = width;
+    img.height = height;
+    img.px.resize((size_t) width * height * 4);
+    return img;
+}
+
+//----------------------------------------------//
+//  Blur taps
+//----------------------------------------------//
+
+// the gaussian of one row (or all columns), normalized. as envblur.comp computes it
+struct Taps {
+    int reach;
+    float w[2 * APRON + 1];
+};
+
+static Taps taps(int radius_px, float stretch) {
+    Taps t;
+    if (radius_px <= 0) {  // no blur, one tap
+        t.reach = 0;
+        t.w[0] = 1.f;
+        return t;
+    }
+    float radius = std::max((float) radius_px, 0.5f);
+    stretch = std::min(stretch, (float) APRON / radius);
+    t.reach = std::min((int) std::ceil(radius * stretch), APRON);
+
+    float k = -2.f / (radius * radius * stretch * stretch);
+    float wsum = 0;
+    for (int o = -t.reach; o <= t.reach; o++) {
+        t.w[o + t.reach] = std::exp(k * (float) (o * o));
+        wsum += t.w[o + t.reach];
+    }
+    for (int o = 0; o <= 2 * t.reach; o++) t.w[o] /= wsum;
+    return t;
+}
+
+// out[x] = sum of w[o] * line[x + o], x in [0, n). line is n + 2 * reach pixels
+static void blurLine(const float* line, float* out, uint32_t n, const Taps& t) {
+    for (uint32_t x = 0; x < n; x++) {
+        float s[4] = {0, 0, 0, 0};
+        for (int o = 0; o <= 2 * t.reach; o++) {
+            const float* p = line + (x + o) * 4;
+            for (int c = 0; c < 4; c++) s[c] += t.w[o] * p[c];
+        }
+        for (int c = 0; c < 4; c++) out[x * 4 + c] = unorm8(s[c]);
+        out[x * 4 + 3] = 1.f;
+    }
+}
+
+// rounds 8 floats to 8 bits, like unorm8(). halves round up, as std::round does
+// with positive values (the rounding instruction would take them to even)
+__attribute__((target("avx2,fma")))
+static inline __m256 unorm8_avx2(__m256 v) {
+    const __m256 scale = _mm256_set1_ps(255.f);
+    v = _mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(1.f));
+    v = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(v, scale), _mm256_set1_ps(0.5f)));
+    return _mm256_div_ps(v, scale);
+}
+
+// blurLine, two pixels (8 floats) at a time
+__attribute__((target("avx2,fma")))
+static void blurLine_avx2(const float* line, float* out, uint32_t n, const Taps& t) {
+    const __m256 alpha = _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1));
+    const __m256 one = _mm256_set1_ps(1.f);
+
+    uint32_t x = 0;
+    for (; x + 2 <= n; x += 2) {
+        __m256 s = _mm256_setzero_ps();
+        for (int o = 0; o <= 2 * t.reach; o++) {
+            s = _mm256_fmadd_ps(_mm256_set1_ps(t.w[o]), _mm256_loadu_ps(line + (x + o) * 4), s);
+        }
+        _mm256_storeu_ps(out + x * 4, _mm256_blendv_ps(unorm8_avx2(s), one, alpha));
+    }
+    if (x < n) blurLine(line + x * 4, out + x * 4, n - x, t);
+}
+
+// a column pass over a block of rows: out row y = sum of w[o] * in row clamp(y + o)
+static void blurColumns(const EnvImage& in, EnvImage& out, uint32_t y0, uint32_t y1, const Taps& t) {
+    uint32_t n = in.width * 4;
+    std::vector<float> s(n);
+    for (uint32_t y = y0; y < y1; y++) {
+        std::fill(s.begin(), s.end(), 0.f);
+        for (int o = -t.reach; o <= t.reach; o++) {
+            const float* r = in.row(std::clamp<int>(y + o, 0, in.height - 1));
+            for (uint32_t i = 0; i < n; i++) s[i] += t.w[o + t.reach] * r[i];
+        }
+        float* dst = out.row(y);
+        for (uint32_t i = 0; i < n; i++) dst[i] = (i & 3) == 3 ? 1.f : unorm8(s[i]);
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void blurColumns_avx2(const EnvImage& in, EnvImage& out, uint32_t y0, uint32_t y1, const Taps& t) {
+    const __m256 alpha = _mm256_castsi256_ps(_mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1));
+    const __m256 one = _mm256_set1_ps(1.f);
+
+    // whole image rows are always a multiple of 2 pixels here (the widths are powers of two)
+    uint32_t n = in.width * 4;
+    for (uint32_t y = y0; y < y1; y++) {
+        float* dst = out.row(y);
+        for (uint32_t i = 0; i + 8 <= n; i += 8) {
+            __m256 s = _mm256_setzero_ps();
+            for (int o = -t.reach; o <= t.reach; o++) {
+                const float* r = in.row(std::clamp<int>(y + o, 0, in.height - 1));
+                s = _mm256_fmadd_ps(_mm256_set1_ps(t.w[o + t.reach]), _mm256_loadu_ps(r + i), s);
+            }
+            _mm256_storeu_ps(dst + i, _mm256_blendv_ps(unorm8_avx2(s), one, alpha));
+        }
+    }
+}
+
+//----------------------------------------------//
+//  Steps
+//----------------------------------------------//
+
+// one pixel of envreduce.comp: the average of the sx by sy block under it
+static void reducePixel(const EnvImage& in, EnvImage& out, uint32_t x, uint32_t y, uint32_t sx, uint32_t sy) {
+    float s[4] = {0, 0, 0, 0};
+    for (uint32_t j = 0; j < sy; j++) {
+        const float* p = in.row(y * sy + j) + x * sx * 4;
+        for (uint32_t i = 0; i < sx * 4; i++) s[i & 3] += p[i];
+    }
+    for (int c = 0; c < 4; c++) out.row(y)[x * 4 + c] = unorm8(s[c] / (sx * sy));
+}
+
+// halving, two output pixels (two 2x2 blocks) at a time
+__attribute__((target("avx2,fma")))
+static void reduceHalf_avx2(const EnvImage& in, EnvImage& out, uint32_t y0, uint32_t y1) {
+    const __m256 n = _mm256_set1_ps(4.f);
+    for (uint32_t y = y0; y < y1; y++) {
+        const float* top = in.row(y * 2);
+        const float* bottom = in.row(y * 2 + 1);
+        float* dst = out.row(y);
+
+        uint32_t x = 0;
+        for (; x + 2 <= out.width; x += 2) {
+            // the left and the right pixels of both blocks, summed in reducePixel()'s order
+            __m256 a = _mm256_loadu_ps(top + x * 8), b = _mm256_loadu_ps(top + x * 8 + 8);
+            __m256 c = _mm256_loadu_ps(bottom + x * 8), d = _mm256_loadu_ps(bottom + x * 8 + 8);
+            __m256 s = _mm256_add_ps(_mm256_permute2f128_ps(a, b, 0x20), _mm256_permute2f128_ps(a, b, 0x31));
+            s = _mm256_add_ps(s, _mm256_permute2f128_ps(c, d, 0x20));
+            s = _mm256_add_ps(s, _mm256_permute2f128_ps(c, d, 0x31));
+            _mm256_storeu_ps(dst + x * 4, unorm8_avx2(_mm256_div_ps(s, n)));
+        }
+        for (; x < out.width; x++) reducePixel(in, out, x, y, 2, 2);
+    }
+}
+
+// box filters in down to out's size, as envreduce.comp
+static void reduce(const EnvImage& in, EnvImage& out, bool simd, unsigned threads) {
+    uint32_t sx = std::max(1u, in.width / out.width);
+    uint32_t sy = std::max(1u, in.height / out.height);
+    parallel(out.height, threads, [&](uint32_t y0, uint32_t y1) {
+        if (simd && sx == 2 && sy == 2) {
+            reduceHalf_avx2(in, out, y0, y1);
+            return;
+        }
+        for (uint32_t y = y0; y < y1; y++) {
+            for (uint32_t x = 0; x < out.width; x++) reducePixel(in, out, x, y, sx, sy);
+        }
+    });
+}
+
+// the row pass then the column pass of envblur.comp, in -> scratch -> in
+static void blur(EnvImage& img, EnvImage& scratch, int radius, bool simd, unsigned threads) {
+
+    // rows: wrap around, the taps widen towards the poles
+    parallel(img.height, threads, [&](uint32_t y0, uint32_t y1) {
+        std::vector<float> line;
+        for (uint32_t y = y0; y < y1; y++) {
+            float lat = (((float) y + 0.5f) / (float) img.height - 0.5f) * PI;
+            Taps t = taps(radius, 1.f / std::max(std::cos(lat), 1e-3f));
+
+            int w = img.width;
+            line.resize((w + 2 * t.reach) * 4);
+            for (int i = 0; i < w + 2 * t.reach; i++) {
+                int x = ((i - t.reach) % w + w) % w;
+                std::copy_n(img.row(y) + x * 4, 4, line.data() + i * 4);
+            }
+
+            if (simd) blurLine_avx2(line.data(), scratch.row(y), w, t);
+            else      blurLine(line.data(), scratch.row(y), w, t);
+        }
+    });
+
+    // columns: clamp at the poles
+    Taps t = taps(radius, 1.f);
+    parallel(img.height, threads, [&](uint32_t y0, uint32_t y1) {
+        if (simd && img.width % 2 == 0) blurColumns_avx2(scratch, img, y0, y1, t);
+        else                            blurColumns(scratch, img, y0, y1, t);
+    });
+}
+
+// bilinear, wrapping in x, clamping in y
+static void sample(const EnvImage& img, float u, float v, float* out) {
+    float px = u * img.width - 0.5f;
+    float py = v * img.height - 0.5f;
+    int x = (int) std::floor(px), y = (int) std::floor(py);
+    float fx = px - x, fy = py - y;
+
+    auto at = [&](int x, int y) {
+        x = (x % (int) img.width + img.width) % img.width;
+        y = std::clamp<int>(y, 0, img.height - 1);
+        return img.row(y) + x * 4;
+    };
+
+    const float *a = at(x, y), *b = at(x + 1, y), *c = at(x, y + 1), *d = at(x + 1, y + 1);
+    for (int i = 0; i < 4; i++) {
+        float top = a[i] + (b[i] - a[i]) * fx;
+        float bottom = c[i] + (d[i] - c[i]) * fx;
+        out[i] = unorm8(top + (bottom - top) * fy);
+    }
+}
+
+// sample, 4 channels at a time
+__attribute__((target("avx2,fma")))
+static void sample_sse(const EnvImage& img, float u, float v, float* out) {
+    float px = u * img.width - 0.5f;
+    float py = v * img.height - 0.5f;
+    int x = (int) std::floor(px), y = (int) std::floor(py);
+    __m128 fx = _mm_set1_ps(px - x), fy = _mm_set1_ps(py - y);
+
+    auto at = [&](int x, int y) {
+        x = (x % (int) img.width + img.width) % img.width;
+        y = std::clamp<int>(y, 0, img.height - 1);
+        return _mm_loadu_ps(img.row(y) + x * 4);
+    };
+
+    __m128 a = at(x, y), b = at(x + 1, y), c = at(x, y + 1), d = at(x + 1, y + 1);
+    __m128 top = _mm_fmadd_ps(_mm_sub_ps(b, a), fx, a);
+    __m128 bottom = _mm_fmadd_ps(_mm_sub_ps(d, c), fx, c);
+    __m128 r = _mm_fmadd_ps(_mm_sub_ps(bottom, top), fy, top);
+
+    const __m128 scale = _mm_set1_ps(255.f);
+    r = _mm_min_ps(_mm_max_ps(r, _mm_setzero_ps()), _mm_set1_ps(1.f));
+    r = _mm_floor_ps(_mm_add_ps(_mm_mul_ps(r, scale), _mm_set1_ps(0.5f)));
+    _mm_storeu_ps(out, _mm_div_ps(r, scale));
+}
+
+// atan2 of 8 at a time, to within 2e-6 (a few thousandths of a pixel here)
+__attribute__((target("avx2,fma")))
+static inline __m256 atan2_avx2(__m256 y, __m256 x) {
+    const __m256 sign = _mm256_set1_ps(-0.f);
+    __m256 ax = _mm256_andnot_ps(sign, x), ay = _mm256_andnot_ps(sign, y);
+
+    // atan of the ratio in [0, 1]
+    __m256 a = _mm256_div_ps(_mm256_min_ps(ax, ay), _mm256_max_ps(_mm256_max_ps(ax, ay), _mm256_set1_ps(1e-30f)));
+    __m256 s = _mm256_mul_ps(a, a);
+    __m256 p = _mm256_set1_ps(-0.01172120f);
+    p = _mm256_fmadd_ps(p, s, _mm256_set1_ps(0.05265332f));
+    p = _mm256_fmadd_ps(p, s, _mm256_set1_ps(-0.11643287f));
+    p = _mm256_fmadd_ps(p, s, _mm256_set1_ps(0.19354346f));
+    p = _mm256_fmadd_ps(p, s, _mm256_set1_ps(-0.33262347f));
+    p = _mm256_fmadd_ps(p, s, _mm256_set1_ps(0.99997726f));
+    p = _mm256_mul_ps(p, a);
+
+    // then back out to the octant and the quadrant
+    p = _mm256_blendv_ps(p, _mm256_sub_ps(_mm256_set1_ps(PI / 2), p), _mm256_cmp_ps(ay, ax, _CMP_GT_OQ));
+    p = _mm256_blendv_ps(p, _mm256_sub_ps(_mm256_set1_ps(PI), p), x);
+    return _mm256_or_ps(p, _mm256_and_ps(y, sign));
+}
+
+// the direction through a texel of a face, not normalized
+static void faceDir(uint32_t f, float s, float t, float* d) {
+    switch (f) {
+        case 0: d[0] =  1; d[1] = -t; d[2] = -s; break;
+        case 1: d[0] = -1; d[1] = -t; d[2] =  s; break;
+        case 2: d[0] =  s; d[1] =  1; d[2] =  t; break;
+        case 3: d[0] =  s; d[1] = -1; d[2] = -t; break;
+        case 4: d[0] =  s; d[1] = -t; d[2] =  1; break;
+        default: d[0] = -s; d[1] = -t; d[2] = -1; break;
+    }
+}
+
+// one texel of envcube.comp
+static void cubeTexel(const EnvImage& in, std::array<EnvImage, 6>& faces, uint32_t f, uint32_t x, uint32_t y) {
+    uint32_t size = faces[0].width;
+    float s = ((float) x + 0.5f) / size * 2.f - 1.f;
+    float t = ((float) y + 0.5f) / size * 2.f - 1.f;
+    float d[3];
+    faceDir(f, s, t, d);
+    float len = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    float u = std::atan2(d[2], d[0]) / (2 * PI) + 0.5f;
+    float v = std::asin(d[1] / len) / PI + 0.5f;
+    sample(in, u, v, faces[f].row(y) + x * 4);
+}
+
+// rows r0 to r1 of the faces (stacked), 8 texels' coordinates at a time.
+// asin(y / len) is taken as atan2(y, the length in xz)
+__attribute__((target("avx2,fma")))
+static void tocube_avx2(const EnvImage& in, std::array<EnvImage, 6>& faces, uint32_t r0, uint32_t r1) {
+    uint32_t size = faces[0].width;
+    const __m256 lane = _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f);
+    const __m256 n = _mm256_set1_ps((float) size);
+    const __m256 one = _mm256_set1_ps(1.f);
+
+    for (uint32_t r = r0; r < r1; r++) {
+        uint32_t f = r / size, y = r % size;
+        float t = ((float) y + 0.5f) / size * 2.f - 1.f;
+
+        uint32_t x = 0;
+        for (; x + 8 <= size; x += 8) {
+            // as cubeTexel() does it, so the face centers come out exactly 0
+            __m256 s = _mm256_div_ps(_mm256_add_ps(_mm256_set1_ps((float) x), lane), n);
+            s = _mm256_fmsub_ps(s, _mm256_set1_ps(2.f), one);
+
+            // faceDir() with s in the lanes
+            __m256 d[3];
+            __m256 nt = _mm256_set1_ps(-t), pt = _mm256_set1_ps(t), ns = _mm256_sub_ps(_mm256_setzero_ps(), s);
+            switch (f) {
+                case 0: d[0] = one; d[1] = nt; d[2] = ns; break;
+                case 1: d[0] = _mm256_set1_ps(-1.f); d[1] = nt; d[2] = s; break;
+                case 2: d[0] = s; d[1] = one; d[2] = pt; break;
+                case 3: d[0] = s; d[1] = _mm256_set1_ps(-1.f); d[2] = nt; break;
+                case 4: d[0] = s; d[1] = nt; d[2] = one; break;
+                default: d[0] = ns; d[1] = nt; d[2] = _mm256_set1_ps(-1.f); break;
+            }
+
+            __m256 xz = _mm256_sqrt_ps(_mm256_fmadd_ps(d[0], d[0], _mm256_mul_ps(d[2], d[2])));
+            __m256 u = _mm256_fmadd_ps(atan2_avx2(d[2], d[0]), _mm256_set1_ps(1.f / (2 * PI)), _mm256_set1_ps(0.5f));
+            __m256 v = _mm256_fmadd_ps(atan2_avx2(d[1], xz), _mm256_set1_ps(1.f / PI), _mm256_set1_ps(0.5f));
+
+            alignas(32) float us[8], vs[8];
+            _mm256_store_ps(us, u);
+            _mm256_store_ps(vs, v);
+            float* dst = faces[f].row(y) + x * 4;
+            for (int i = 0; i < 8; i++) sample_sse(in, us[i], vs[i], dst + i * 4);
+        }
+        for (; x < size; x++) cubeTexel(in, faces, f, x, y);
+    }
+}
+
+// a level of the chain into the faces, as envcube.comp
+static void tocube(const EnvImage& in, std::array<EnvImage, 6>& faces, bool simd, unsigned threads) {
+    uint32_t size = faces[0].width;
+    parallel(6 * size, threads, [&](uint32_t r0, uint32_t r1) {
+        if (simd) {
+            tocube_avx2(in, faces, r0, r1);
+            return;
+        }
+        for (uint32_t r = r0; r < r1; r++) {
+            for (uint32_t x = 0; x < size; x++) cubeTexel(in, faces, r / size, x, r % size);
+        }
+    });
+}
+
+// one pixel of envsh.comp, added to acc (9 coefficients by 3 channels)
+static void shPixel(const uint8_t* row, uint32_t x, uint32_t width, float lat, float w, double* acc) {
+    float lon = ((float) x + 0.5f) / width * 2 * PI - PI;
+    float dx = std::cos(lat) * std::cos(lon), dy = std::sin(lat), dz = std::cos(lat) * std::sin(lon);
+    float Y[9] = {
+        0.282095f,
+        0.488603f * dy, 0.488603f * dz, 0.488603f * dx,
+        1.092548f * dx * dy, 1.092548f * dy * dz,
+        0.315392f * (3 * dz * dz - 1),
+        1.092548f * dx * dz,
+        0.546274f * (dx * dx - dy * dy),
+    };
+    // .bgr of the B8G8R8A8 components, like the shader: the bytes in memory order
+    float c[3] = {row[x * 4 + 0] / 255.f * w, row[x * 4 + 1] / 255.f * w, row[x * 4 + 2] / 255.f * w};
+    for (int i = 0; i < 9; i++) {
+        for (int ch = 0; ch < 3; ch++) acc[i * 3 + ch] += c[ch] * Y[i];
+    }
+}
+
+// a row of shPixel(), 8 pixels at a time. the longitudes' sines and cosines come
+// from a table, the row's sums are kept in floats and added to acc once per row
+__attribute__((target("avx2,fma")))
+static void shRow_avx2(const uint8_t* row, uint32_t width, float lat, float w,
+                       const float* coslon, const float* sinlon, double* acc) {
+
+    __m256 sum[27];
+    for (__m256& s : sum) s = _mm256_setzero_ps();
+
+    const __m256 cl = _mm256_set1_ps(std::cos(lat));
+    const __m256 dy = _mm256_set1_ps(std::sin(lat));
+    const __m256 scale = _mm256_set1_ps(255.f);
+    const __m256 weight = _mm256_set1_ps(w);
+    const __m256i byte = _mm256_set1_epi32(0xff);
+    const __m256 c1 = _mm256_set1_ps(0.488603f), c2 = _mm256_set1_ps(1.092548f);
+    const __m256 c3 = _mm256_set1_ps(0.315392f), c4 = _mm256_set1_ps(0.546274f);
+    const __m256 three = _mm256_set1_ps(3.f), one = _mm256_set1_ps(1.f);
+
+    uint32_t x = 0;
+    for (; x + 8 <= width; x += 8) {
+        __m256 dx = _mm256_mul_ps(cl, _mm256_loadu_ps(coslon + x));
+        __m256 dz = _mm256_mul_ps(cl, _mm256_loadu_ps(sinlon + x));
+        __m256 Y[9] = {
+            _mm256_set1_ps(0.282095f),
+            _mm256_mul_ps(c1, dy), _mm256_mul_ps(c1, dz), _mm256_mul_ps(c1, dx),
+            _mm256_mul_ps(c2, _mm256_mul_ps(dx, dy)), _mm256_mul_ps(c2, _mm256_mul_ps(dy, dz)),
+            _mm256_mul_ps(c3, _mm256_fmsub_ps(three, _mm256_mul_ps(dz, dz), one)),
+            _mm256_mul_ps(c2, _mm256_mul_ps(dx, dz)),
+            _mm256_mul_ps(c4, _mm256_fmsub_ps(dx, dx, _mm256_mul_ps(dy, dy))),
+        };
+
+        __m256i px = _mm256_loadu_si256((const __m256i*) (row + x * 4));
+        for (int ch = 0; ch < 3; ch++) {
+            __m256 c = _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(px, 8 * ch), byte));
+            c = _mm256_mul_ps(_mm256_div_ps(c, scale), weight);
+            for (int i = 0; i < 9; i++) sum[i * 3 + ch] = _mm256_fmadd_ps(c, Y[i], sum[i * 3 + ch]);
+        }
+    }
+
+    for (int i = 0; i < 27; i++) {
+        alignas(32) float lanes[8];
+        _mm256_store_ps(lanes, sum[i]);
+        for (float f : lanes) acc[i] += f;
+    }
+    for (; x < width; x++) shPixel(row, x, width, lat, w, acc);
+}
+
+// the sh projection of envsh.comp and envshsum.comp, straight from the frame
+static void project(const uint8_t* frame, size_t stride, uint32_t width, uint32_t height,
+                    Lighting& l, bool simd, unsigned threads) {
+
+    threads = std::max(1u, std::min(threads, height));
+    std::vector<std::array<double, 27>> sums(threads);
+
+    std::vector<float> coslon(width), sinlon(width);
+    for (uint32_t x = 0; x < width; x++) {
+        float lon = ((float) x + 0.5f) / width * 2 * PI - PI;
+        coslon[x] = std::cos(lon);
+        sinlon[x] = std::sin(lon);
+    }
+
+    parallel(threads, threads, [&](uint32_t t0, uint32_t t1) {
+        for (uint32_t t = t0; t < t1; t++) {
+            std::array<double, 27>& acc = sums[t];
+            acc.fill(0);
+            for (uint32_t y = (uint64_t) height * t / threads; y < (uint64_t) height * (t + 1) / threads; y++) {
+                float lat = (((float) y + 0.5f) / height - 0.5f) * PI;
+                float w = std::cos(lat) * (2 * PI / width) * (PI / height);
+                const uint8_t* row = frame + y * stride;
+
+                if (simd) {
+                    shRow_avx2(row, width, lat, w, coslon.data(), sinlon.data(), acc.data());
+                } else {
+                    for (uint32_t x = 0; x < width; x++) shPixel(row, x, width, lat, w, acc.data());
+                }
+            }
+        }
+    });
+
+    const float band[3] = {1.f, 2.f / 3.f, 1.f / 4.f};
+    for (int i = 0; i < 9; i++) {
+        double s[3] = {0, 0, 0};
+        for (auto& acc : sums) {
+            for (int ch = 0; ch < 3; ch++) s[ch] += acc[i * 3 + ch];
+        }
+        float b = band[i == 0 ? 0 : i < 4 ? 1 : 2];
+        l.sh[i] = glm::vec4(s[0] * b, s[1] * b, s[2] * b, 0.f);
+    }
+}
+
+//----------------------------------------------//
+//  EnvironmentRef
+//----------------------------------------------//
+
+bool EnvironmentRef::avx2() {
+    static bool has = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    return has;
+}
+
+EnvironmentRef::EnvironmentRef(uint32_t width, uint32_t height, uint32_t levels)
+    : width(width), height(height), levels(levels) {
+
+    threads = std::max(1u, std::thread::hardware_concurrency());
+    face = width / 4;
+
+    for (uint32_t l = 0; l < levels; l++) {
+        chain.push_back(envimage(std::max(1u, width >> l), std::max(1u, height >> l)));
+        cube.emplace_back();
+        for (auto& f : cube.back()) f = envimage(std::max(1u, face >> l), std::max(1u, face >> l));
+    }
+}
+
+void EnvironmentRef::process(const uint8_t* frame, size_t stride) {
+
+    using clock = std::chrono::steady_clock;
+    auto ms = [](clock::time_point a, clock::time_point b) {
+        return std::chrono::duration<double, std::milli>(b - a).count();
+    };
+
+    bool vec = simd && avx2();
+
+    auto t0 = clock::now();
+
+    // level 0 is the frame as it is
+    parallel(height, threads, [&](uint32_t y0, uint32_t y1) {
+        for (uint32_t y = y0; y < y1; y++) {
+            const uint8_t* src = frame + y * stride;
+            float* dst = chain[0].row(y);
+            for (uint32_t i = 0; i < width * 4; i++) dst[i] = src[i] / 255.f;
+        }
+    });
+
+    EnvImage scratch;
+    for (uint32_t l = 1; l < levels; l++) {
+        reduce(chain[l - 1], chain[l], vec, threads);
+        scratch = envimage(chain[l].width, chain[l].height);
+        blur(chain[l], scratch, radius, vec, threads);
+    }
+
+    auto t1 = clock::now();
+
+    for (uint32_t l = 0; l < levels; l++) {
+        tocube(chain[l], cube[l], vec, threads);
+    }
+
+    auto t2 = clock::now();
+
+    project(frame, stride, width, height, lighting, vec, threads);
+
+    auto t3 = clock::now();
+
+    timing = {ms(t0, t1), ms(t1, t2), ms(t2, t3)};
+}
+
+};
+#endif
+#endif
@@ -0,0 +1,17 @@
+#ifndef LIGHTING_H
+#define LIGHTING_H
+
+#include <glm/glm.hpp>
+
+namespace sc {
+
+// the diffuse lighting of the scene: the irradiance as 9 (L2) spherical harmonics,
+// already convolved with the cosine lobe and divided by pi, so that
+// diffuse = albedo * sum(sh[i] * Y_i(normal)), y up
+// (on its own, the cpu side of the environment builds without vulkan)
+struct Lighting {
+    glm::vec4 sh[9] {};
+};
+
+};
+#endif
@@ -12,94 +12,327 @@
     };
 #endif
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+
 namespace sc {
 
+// a few threads that build materials in the background, see Material
+class Compiler {
+
+    std::vector<std::thread> threads;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping = false;
+
+    void work();
+
+public:
+    Compiler(unsigned threads);
+    ~Compiler();  // finishes the jobs that are left first
+
+    // runs job on one of the threads
+    std::future<void> submit(std::function<void()> job);
+
+    // the one materials use
+    static Compiler& get();
+};
+
+
+// what every draw of a frame (of an eye) shares, see CameraBuffer
+struct uni_Camera_t {
+    glm::mat4 view;
+    glm::mat4 proj;
+    glm::vec3 camerapos;
+    float t;
+    glm::vec4 sh[9];  // the lighting's irradiance
+};
+
+// what's different for every draw, see Entity
+struct uni_Transform_t {
+    glm::mat4 model;
+    glm::mat4 norm;
+};
+
+// what a material's shaders get as push constants: where their things are in
+// the heap, and the draw's transforms, if the device takes push constants that big
+struct DrawConstants {
+    uint32_t camera;       // the frame's uni_Camera_t
+    uint32_t transforms;   // the entity's uni_Transform_t, when they aren't pushed
+    uint32_t textures[3];  // whatever the material was given with texture()
+    alignas(16) uni_Transform_t tf;
+};
 
 // represents a material.
 // contains a (graphics) Pipeline, made with
 // a vert and frag shader.
+// everything it uses is in the heap (set 0): both shaders get the heap's arrays,
+// the push constants as `ids`, and the camera's and the entity's transforms as
+// `tf`, declared before their own code.
+// the transforms are pushed with every draw if they fit in maxPushConstantsSize,
+// otherwise they're in a storage buffer in the heap, like the camera.
+//
+// made with a fallback, the shaders and the pipeline are built on the Compiler's
+// threads, and until they're done it draws with the fallback's pipeline (every
+// material takes the same push constants). the pipeline is swapped in as a whole
+// once it's ready, the next bind() picks it up.
 class Material {
 
     vk::Device& device;
-    vk::Pipeline* pipe;
-    vk::ShaderModule* vs;
-    vk::ShaderModule* fs;
+    vk::Heap& _heap;
+    std::atomic<vk::Pipeline*> pipe {nullptr};
+    vk::ShaderModule* vs = nullptr;
+    vk::ShaderModule* fs = nullptr;
+    Material* fallback = nullptr;
+    std::future<void> compiling;
+
+    DrawConstants ids {};
+    bool _pushes;
+
+    void build(vk::RenderPass&, std::string name, std::string vscode, std::string fscode);
 
 public:
-    Material(vk::Device& d, vk::RenderPass& pass, std::string name, std::string vscode, std::string fscode);
+    Material(vk::Device& d, vk::RenderPass& pass, vk::Heap& heap, std::string name, std::string vscode, std::string fscode);
+
+    // compiles in the background, draws with fallback (which has to stay around) till then
+    Material(vk::Device& d, vk::RenderPass& pass, vk::Heap& heap, std::string name, std::string vscode, std::string fscode,
+             Material& fallback);
+
     ~Material();
 
-    void bind(vk::CommandBuffer&);
+    // whether its own pipeline is in use
+    bool ready() const {return pipe.load() != nullptr;}
+
+    // what bind() binds: its own pipeline, or the fallback's till it's ready
+    vk::Pipeline& pipeline();
+
+    // whether the transforms are pushed
+    bool pushes() const {return _pushes;}
 
-    void descriptorSet(uint32_t);
-    void writeDescriptor(uint32_t, uint32_t, vk::Buffer&, VkDescriptorType);
+    // binds the pipeline, with the camera (a uni_Camera_t in the heap) and the
+    // transforms: pushed, or a uni_Transform_t in the heap if they don't fit
+    void bind(vk::CommandBuffer&, uint32_t camera, const uni_Transform_t&);
+    void bind(vk::CommandBuffer&, uint32_t camera, uint32_t transforms);
 
-    operator vk::Pipeline&() {return *pipe;};
+    // what ids.textures[i] points to. adds it to the heap the first time it's seen,
+    // after that it's just a lookup
+    void texture(uint32_t i, vk::Image&);
+
+    vk::Heap& heap() {return _heap;}
+
+    operator vk::Pipeline&() {return pipeline();};
 };
 
 }; // end of instance.h file
 #ifndef HEADER
 namespace sc {
 
-Material::Material (vk::Device& d, vk::RenderPass& pass, std::string name, std::string vscode, std::string fscode): device(d) {
+// the same for every material, see uni_Camera_t, uni_Transform_t and DrawConstants.
+// tf puts the two together, whichever way the transforms come in
+static std::string _material_prelude(bool pushes) {
+    std::string sb = std::to_string(vk::Heap::STORAGE_BUFFER);
+    std::string from = pushes ? "ids" : "heap_transforms[ids.transforms]";
 
-    vs = new vk::ShaderModule(d, "_"+name+".vert", vscode),
-    fs = new vk::ShaderModule(d, "_"+name+".frag", fscode),
-    
-    pipe = &vk::Pipeline::Graphics(
-        d, 
-        { // descriptor inputs
-            {{.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .stageFlags = VK_SHADER_STAGE_ALL},
-             {.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT},  // theres the texture
-             {.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT}}, // theres the texture again
-            // single uniform for everything, for now
-            // RGB textures in the future
-        }, {}, // no push constants
-        {{ // vertex inputs
-            .stride = sizeof(Vertex),
-            .rate = VK_VERTEX_INPUT_RATE_VERTEX,
-            .attr = {
-                {.format=VK_FORMAT_R32G32B32_SFLOAT}, // position
-                {.format=VK_FORMAT_R32G32B32_SFLOAT, .offset=offsetof(Vertex, norm)}, // normal
-                {.format=VK_FORMAT_R32G32_SFLOAT,    .offset=offsetof(Vertex, uv)},  // texture coords
-            }
-        }},
-        *vs, pass, *fs
-    );
+    return
+    "layout (set = 0, binding = " + sb + ") readonly buffer Cameras {\n"
+    "    mat4 view;\n"
+    "    mat4 proj;\n"
+    "    vec3 camerapos;\n"
+    "    float t;\n"
+    "    vec4 sh[9];\n"
+    "} heap_cameras[];\n"
+    "layout (set = 0, binding = " + sb + ") readonly buffer Transforms {\n"
+    "    mat4 model;\n"
+    "    mat4 norm;\n"
+    "} heap_transforms[];\n"
+    "layout (push_constant) uniform Draw {\n"
+    "    uint camera;\n"
+    "    uint transforms;\n"
+    "    uint textures[3];\n"
+    + (pushes ?
+    "    mat4 model;\n"
+    "    mat4 norm;\n" : "") +
+    "} ids;\n"
+    "struct Transform_t {\n"
+    "    mat4 model;\n"
+    "    mat4 norm;\n"
+    "    mat4 view;\n"
+    "    mat4 proj;\n"
+    "    vec3 camerapos;\n"
+    "    float t;\n"
+    "    vec4 sh[9];\n"
+    "};\n"
+    "Transform_t _transforms() {\n"
+    "    Transform_t r;\n"
+    "    r.model = " + from + ".model;\n"
+    "    r.norm = " + from + ".norm;\n"
+    "    r.view = heap_cameras[ids.camera].view;\n"
+    "    r.proj = heap_cameras[ids.camera].proj;\n"
+    "    r.camerapos = heap_cameras[ids.camera].camerapos;\n"
+    "    r.t = heap_cameras[ids.camera].t;\n"
+    "    r.sh = heap_cameras[ids.camera].sh;\n"
+    "    return r;\n"
+    "}\n"
+    "#define tf _transforms()\n";
+}
 
-    if (pipe == nullptr) {
-        printf("[ERROR] bald 1\n");
+Compiler::Compiler(unsigned n) {
+    for (unsigned i = 0; i < n; i++) {
+        threads.emplace_back(&Compiler::work, this);
     }
 }
-void Material::bind (vk::CommandBuffer& cmd) {
 
-    if (pipe == nullptr) {
-        printf("[ERROR] bald 2\n");
+Compiler::~Compiler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
     }
-
-    cmd.bindPipeline(*pipe);
+    cv.notify_all();
+    for (auto& t : threads) t.join();
 }
 
-void Material::descriptorSet(uint32_t i) {
+void Compiler::work() {
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [&] {return stopping || !jobs.empty();});
+            if (jobs.empty()) return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        job();
+    }
+}
 
-    if (pipe == nullptr) {
-        printf("[ERROR] bald 3\n");
+std::future<void> Compiler::submit(std::function<void()> job) {
+    auto task = std::make_shared<std::packaged_task<void()>>(job);
+    std::future<void> ret = task->get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back([task] {(*task)();});
     }
+    cv.notify_one();
+    return ret;
+}
+
+// glslc is a process of its own, a couple of them at a time is plenty
+Compiler& Compiler::get() {
+    static Compiler compiler(std::clamp(std::thread::hardware_concurrency() / 2, 1u, 4u));
+    return compiler;
+}
+
+// push the transforms too, if they fit (128 bytes is all that's guaranteed)
+static bool _material_pushes(vk::Device& d) {
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(d, &props);
+    return sizeof(DrawConstants) <= props.limits.maxPushConstantsSize;
+}
+
+Material::Material (vk::Device& d, vk::RenderPass& pass, vk::Heap& heap, std::string name, std::string vscode, std::string fscode): device(d), _heap(heap) {
 
-    pipe->descriptorSet(i);
+    _pushes = _material_pushes(d);
+    build(pass, name, vscode, fscode);
 }
 
-void Material::writeDescriptor(uint32_t i, uint32_t j, vk::Buffer& b, VkDescriptorType t) {
+Material::Material (vk::Device& d, vk::RenderPass& pass, vk::Heap& heap, std::string name, std::string vscode, std::string fscode,
+                    Material& fb): device(d), _heap(heap), fallback(&fb) {
+
+    _pushes = _material_pushes(d);
+    compiling = Compiler::get().submit([=, this, &pass] {
+        try {
+            build(pass, name, vscode, fscode);
+        } catch (std::exception& e) {
+            printf("[material] %s failed, it stays on the fallback: %s\n", name.c_str(), e.what());
+        }
+    });
+}
+
+// the shaders and the pipeline, on whatever thread it's called on
+void Material::build(vk::RenderPass& pass, std::string name, std::string vscode, std::string fscode) {
+
+    auto start = std::chrono::steady_clock::now();
+    // (without the transforms, the glsl block ends at the indices, before tf's alignment)
+    uint32_t pcsize = _pushes ? sizeof(DrawConstants) : offsetof(DrawConstants, tf);
+
+    std::string prelude = vk::Heap::glsl(0) + _material_prelude(_pushes);
+    vs = new vk::ShaderModule(device, "_"+name+".vert", prelude + vscode);
+    fs = new vk::ShaderModule(device, "_"+name+".frag", prelude + fscode);
+
+    // the sets are the shaders' own (none, just the heap). the push constants and
+    // the vertex inputs are what bind() pushes and what a mesh has, the shaders are
+    // checked against them: they can use less of them (or the optimizer took out
+    // what they didn't use), but nothing else
+    vk::Reflection refl = vs->reflection();
+    refl.merge(fs->reflection());
+
+    uint32_t pushed = refl.pushconstants.empty() ? 0 : refl.pushconstants[0].size;
+    if (pushed > pcsize) {
+        throw std::runtime_error(name + "'s push constants don't match DrawConstants");
+    }
 
-    if (pipe == nullptr) {
-        printf("[ERROR] bald 4\n");
+    vk::VertexInputBinding vertex {
+        .stride = sizeof(Vertex),
+        .rate = VK_VERTEX_INPUT_RATE_VERTEX,
+        .attr = {
+            {.format=VK_FORMAT_R32G32B32_SFLOAT}, // position
+            {.format=VK_FORMAT_R32G32B32_SFLOAT, .offset=offsetof(Vertex, norm)}, // normal
+            {.format=VK_FORMAT_R32G32_SFLOAT,    .offset=offsetof(Vertex, uv)},  // texture coords
+        }
+    };
+    for (const vk::Reflection::Input& in : refl.inputs) {
+        if (in.location >= vertex.attr.size() || in.format != vertex.attr[in.location].format) {
+            throw std::runtime_error(name + "'s vertex input at location " + std::to_string(in.location) + " isn't in a Vertex");
+        }
     }
 
-    pipe->writeDescriptor(i, j, b, t);
+    pipe = &vk::Pipeline::Graphics(
+        device, refl.sets(true),
+        {{.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, .size = pcsize}},
+        {vertex}, *vs, pass, *fs, &_heap
+    );
+
+    printf("[material] %s compiled in %.1f ms%s\n", name.c_str(),
+           std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(),
+           fallback ? " (in the background)" : "");
+}
+
+vk::Pipeline& Material::pipeline() {
+    vk::Pipeline* p = pipe.load();
+    return p ? *p : fallback->pipeline();
+}
+void Material::bind (vk::CommandBuffer& cmd, uint32_t camera, const uni_Transform_t& tf) {
+
+    ids.camera = camera;
+    ids.tf = tf;
+    vk::Pipeline& p = pipeline();
+    cmd.bindPipeline(p);
+    cmd.setPcr(p, 0, ids);
+}
+
+void Material::bind (vk::CommandBuffer& cmd, uint32_t camera, uint32_t transforms) {
+
+    ids.camera = camera;
+    ids.transforms = transforms;
+    vk::Pipeline& p = pipeline();
+    cmd.bindPipeline(p);
+    cmd.setPcr(p, 0, ids);  // (only as much as the range, the indices)
+}
+
+void Material::texture(uint32_t i, vk::Image& img) {
+    ids.textures[i] = _heap.add(img);
 }
 
 Material::~Material() {
-    delete pipe;
+    if (compiling.valid()) compiling.wait();
+    delete pipe.load();
     delete vs;
     delete fs;
 }
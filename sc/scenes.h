@@ -8,6 +8,8 @@
 #include "mesh.cpp"
 #include "material.cpp"
 #include "camera.cpp"
+#include "environment.cpp"
+#include "envref.cpp"
 #include "entity.cpp"
 
 #endif
\ No newline at end of file
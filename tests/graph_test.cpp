@@ -0,0 +1,93 @@
+// graph_test - compiles a small vk::Graph as a dry run (no gpu needed) and
+// checks the plan: what's culled, which queue and batch every pass is on, and
+// which transients share memory.
+//
+//   make graph_test && ./graph_test
+
+#include "../vk/vklib.h"
+
+#include <cstdio>
+
+static int failed = 0;
+
+#define CHECK(x) do { \
+    if (!(x)) { \
+        printf("[graph_test] %s:%d: %s failed\n", __FILE__, __LINE__, #x); \
+        failed++; \
+    } \
+} while (0)
+
+int main() {
+
+    vk::Graph graph;
+
+    VkImageCreateInfo info {
+        .imageType = VK_IMAGE_TYPE_2D,
+        .format = VK_FORMAT_R16G16B16A16_SFLOAT,
+        .extent = {1024, 512, 1},
+        .samples = VK_SAMPLE_COUNT_1_BIT,
+        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+    };
+
+    auto swap = graph.import("swapchain");
+    auto history = graph.import("history");
+    auto debug = graph.transient("debug", info);
+    auto blurred = graph.transient("blurred", info);
+    auto mask = graph.transient("mask", info);
+    graph.output(swap, vk::Image::PRESENT);
+
+    auto none = [](vk::CommandBuffer&) {};
+
+    // nothing reads what it writes
+    auto& unused = graph.pass("debug", none)
+        .write(debug, vk::Image::COLOR_ATTACHMENT, true);
+
+    // blurred lives in steps 0-1, mask in 2-3: they can share memory
+    auto& blur = graph.pass("blur", none)
+        .write(blurred, vk::Image::STORAGE_WRITE, true);
+    auto& copy = graph.pass("copy", none)
+        .read(blurred, vk::Image::TRANSFER_SRC)
+        .write(history, vk::Image::TRANSFER_DST, true);
+    auto& masking = graph.pass("mask", none)
+        .read(history, vk::Image::STORAGE_READ)
+        .write(mask, vk::Image::STORAGE_WRITE, true);
+    auto& shade = graph.pass("shade", none)
+        .read(mask, vk::Image::SAMPLED_FRAGMENT)
+        .write(swap, vk::Image::COLOR_ATTACHMENT, true);
+
+    graph.compile();
+    graph.describe(stdout);
+
+    CHECK(unused.culled());
+    CHECK(!blur.culled() && !copy.culled() && !masking.culled() && !shade.culled());
+
+    CHECK(blur.queue() == vk::Graph::COMPUTE);
+    CHECK(copy.queue() == vk::Graph::TRANSFER);
+    CHECK(masking.queue() == vk::Graph::COMPUTE);
+    CHECK(shade.queue() == vk::Graph::GRAPHICS);
+
+    // every pass switches queues, so each is its own batch
+    CHECK(blur.batch() == 0);
+    CHECK(copy.batch() == 1);
+    CHECK(masking.batch() == 2);
+    CHECK(shade.batch() == 3);
+
+    // the culled pass's transient is never made
+    CHECK(graph.slot(debug) == UINT32_MAX);
+    CHECK(graph.slot(blurred) != UINT32_MAX);
+    CHECK(graph.slot(blurred) == graph.slot(mask));
+    CHECK(graph.memory() * 2 == graph.unaliased());
+
+    // and it runs, printing the submits. the second frame's blur waits for the
+    // first's shade, it reuses the memory mask had
+    graph.execute();
+    CHECK(graph.waited(blur, vk::Graph::GRAPHICS) == 0);
+    graph.execute();
+    CHECK(graph.waited(blur, vk::Graph::GRAPHICS) == 1);
+    CHECK(graph.waited(blur, vk::Graph::COMPUTE) == 0 && graph.waited(blur, vk::Graph::TRANSFER) == 0);
+    CHECK(graph.waited(copy, vk::Graph::GRAPHICS) == 0);
+    CHECK(graph.waited(masking, vk::Graph::GRAPHICS) == 0);
+
+    printf("[graph_test] %s\n", failed ? "FAILED" : "ok");
+    return failed ? 1 : 0;
+}
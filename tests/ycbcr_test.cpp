@@ -0,0 +1,179 @@
+// Compares the webcam's gpu YCbCr -> RGB conversion with the cpu path
+// (stb_image), on generated frames in every subsampling. Besides the probe
+// size, the frames also come in sizes that aren't a multiple of the MCU,
+// where TurboJPEG pads the planes.
+// Fails if any channel is off by more than 1.
+//
+// Needs a gpu (and a display, for the vk::Instance):
+//     make ycbcr_test && ./ycbcr_test
+
+#include "../vk/vklib.h"
+#include "../360util/webcam.h"
+#include "../.util/stb_image.h"
+
+#include <iostream>
+#include <vector>
+#include <cstdlib>
+#include <mutex>
+#include <condition_variable>
+
+// hands the webcam one frame at a time, whenever the test has the next one
+class Feed : public cm::FrameSource {
+    std::mutex mutex;
+    std::condition_variable ready;
+    std::vector<uint8_t> next;
+
+public:
+    void push(std::vector<uint8_t> jpg) {
+        std::lock_guard<std::mutex> lock(mutex);
+        next = std::move(jpg);
+        ready.notify_one();
+    }
+
+    void stream(Sink sink, const std::atomic<bool>& running) override {
+        while (running.load()) {
+            std::vector<uint8_t> jpg;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait_for(lock, std::chrono::milliseconds(10), [&] { return !next.empty(); });
+                jpg.swap(next);
+            }
+            if (!jpg.empty()) sink(jpg.data(), jpg.size());
+        }
+    }
+};
+
+// smooth gradients for the upsampling, hard edges and noise for the rest
+std::vector<uint8_t> pattern(int width, int height) {
+
+    std::vector<uint8_t> rgb(width * height * 3);
+    srand(42);
+
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            uint8_t* p = &rgb[(y * width + x) * 3];
+            bool check = ((x / 13) + (y / 7)) % 2;
+            p[0] = x * 255 / width;
+            p[1] = check ? 230 : y * 255 / height;
+            p[2] = (x ^ y) & 0xff;
+            if (x % 64 < 8) p[2] = rand() & 0xff;
+        }
+    }
+
+    return rgb;
+}
+
+std::vector<uint8_t> encode(tjhandle encoder, const std::vector<uint8_t>& rgb, int width, int height, int samp) {
+
+    unsigned char* jpg = nullptr;
+    unsigned long size = 0;
+    if (tjCompress2(encoder, rgb.data(), width, 0, height, TJPF_RGB, &jpg, &size, samp, 90, 0) != 0) {
+        std::cerr << "encode failed: " << tjGetErrorStr2(encoder) << std::endl;
+        exit(1);
+    }
+
+    std::vector<uint8_t> out(jpg, jpg + size);
+    tjFree(jpg);
+    return out;
+}
+
+int main() {
+
+    vk::Instance& instance = *new vk::Instance("ycbcr test", 256, 256);
+    vk::Device& dev = *new vk::Device(instance);
+    vk::Queue& compute = dev.create_queue(VK_QUEUE_COMPUTE_BIT);
+    vk::Queue& transfer = dev.create_queue(VK_QUEUE_TRANSFER_BIT | VK_QUEUE_DEDICATED_BIT);
+    dev.init();
+
+    Feed* feed = new Feed();
+    cm::Webcam& cam = *new cm::Webcam(dev, transfer, true, feed);  // (takes the feed)
+    cam.startStreaming();
+    VkFence fence = dev.fence();
+
+    const uint32_t W = cm::Webcam::WIDTH, H = cm::Webcam::HEIGHT;
+    vk::Buffer& readback = *new vk::Buffer(dev, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+        VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, W * H * 4);
+    tjhandle encoder = tjInitCompress();
+
+    const char* names[] = {"4:4:4", "4:2:2", "4:2:0", "gray"};
+    int samps[] = {TJSAMP_444, TJSAMP_422, TJSAMP_420, TJSAMP_GRAY};
+    int sizes[][2] = {{(int) W, (int) H}, {1000, 500}, {1017, 509}};
+
+    bool failed = false;
+
+    for (int s = 0; s < 4; s++) {
+        for (auto& size : sizes) {
+
+            int width = size[0], height = size[1];
+            std::vector<uint8_t> jpg = encode(encoder, pattern(width, height), width, height, samps[s]);
+
+            // cpu: what the cpu path decodes
+            int w, h, channels;
+            unsigned char* ref = stbi_load_from_memory(jpg.data(), jpg.size(), &w, &h, &channels, 3);
+
+            // gpu: decoded to planes, uploaded, converted by prepare()
+            feed->push(jpg);
+            vk::Image& img = cam.getNextImage();
+            uint64_t uploaded = cam.upload();
+
+            vk::CommandBuffer& cmd = compute.command();
+            cmd << [&](vk::CommandBuffer& cmd) {
+                cam.prepare(cmd);
+
+                cmd.imageTransition(img,
+                    VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+                    VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+                    VK_IMAGE_ASPECT_COLOR_BIT
+                );
+
+                VkBufferImageCopy region {
+                    .imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1},
+                    .imageExtent = {W, H, 1},
+                };
+                vkCmdCopyImageToBuffer(cmd, img, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, readback, 1, &region);
+
+                VkMemoryBarrier host {
+                    .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+                    .srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+                    .dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+                };
+                vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+                                     1, &host, 0, nullptr, 0, nullptr);
+            };
+            compute.submit(cmd, {cam.timeline().at(uploaded, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)}, {}, fence);
+            dev.wait(fence);
+
+            // the gpu stores the channels swapped (like the cpu path), so the bytes are r, g, b
+            int maxdiff = 0, off = 0;
+            readback.mapped( [&](void* mapped) {
+                for (int y = 0; y < height; y++) {
+                    uint8_t* row = (uint8_t*) mapped + y * W * 4;
+                    for (int x = 0; x < width; x++) {
+                        int worst = 0;
+                        for (int c = 0; c < 3; c++) {
+                            worst = std::max(worst, abs(row[x * 4 + c] - ref[(y * width + x) * 3 + c]));
+                        }
+                        maxdiff = std::max(maxdiff, worst);
+                        if (worst > 1) off++;
+                    }
+                }
+            });
+            stbi_image_free(ref);
+
+            std::cout << names[s] << " " << width << "x" << height << ": max diff " << maxdiff;
+            if (off) std::cout << ", " << off << " pixels off by more than 1";
+            std::cout << std::endl;
+
+            failed |= maxdiff > 1;
+        }
+    }
+
+    tjDestroy(encoder);
+    cam.stopStreaming();
+    dev.idle();
+    delete &readback;
+    delete &cam;
+
+    std::cout << (failed ? "FAILED" : "ok") << std::endl;
+    return failed;
+}
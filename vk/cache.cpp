@@ -0,0 +1,415 @@
+#include "vklib.h"
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace vk {
+
+// the bytes of a create info, and everything it points to. field by field,
+// so padding never gets in
+struct Key {
+    Cache& cache;
+    std::string bytes;
+    bool cacheable = true;
+    std::vector<uint64_t> passes;  // render passes in it, see Cache::forget()
+
+    Key(Cache& c) : cache(c) {}
+
+    template <typename T>
+    Key& operator<< (const T& v) {
+        static_assert(std::is_scalar_v<T>);
+        bytes.append((const char*) &v, sizeof(T));
+        return *this;
+    }
+
+    Key& str(const char* s) {
+        if (s) bytes.append(s);
+        bytes.push_back('\0');
+        return *this;
+    }
+
+    Key& data(const void* p, size_t n) {
+        *this << n;
+        if (p) bytes.append((const char*) p, n);
+        return *this;
+    }
+
+    // whether a pointer is set, the ones that aren't don't add anything else
+    Key& has(const void* p) {
+        return *this << (uint8_t) (p != nullptr);
+    }
+
+    // any extension struct, and it's made as is
+    Key& next(const void* p) {
+        if (p) cacheable = false;
+        return *this;
+    }
+
+    // something the cache made, by what it was made from. one it didn't make
+    // can't be told apart from whatever gets its handle next
+    Key& dep(Cache::Kind kind, uint64_t handle) {
+        std::string key;
+        if (handle && !cache.keyOf(kind, handle, key)) cacheable = false;
+        has((const void*) handle);
+        if (handle) data(key.data(), key.size());
+        return *this;
+    }
+
+    // a render pass, by its handle
+    Key& pass(VkRenderPass p) {
+        *this << p;
+        if (p) passes.push_back((uint64_t) p);
+        return *this;
+    }
+
+    // handles there's nothing to go by, it's made as is
+    Key& unkeyed(const void* p) {
+        if (p) cacheable = false;
+        return *this;
+    }
+};
+
+static void add(Key& k, const VkDescriptorSetLayoutBinding& b) {
+    k << b.binding << b.descriptorType << b.descriptorCount << b.stageFlags;
+    k.unkeyed(b.pImmutableSamplers);
+}
+
+static void add(Key& k, const VkPipelineShaderStageCreateInfo& s) {
+    k.next(s.pNext) << s.flags << s.stage;
+    k.dep(Cache::SHADER, (uint64_t) s.module);
+    k.str(s.pName);
+
+    const VkSpecializationInfo* spec = s.pSpecializationInfo;
+    k.has(spec);
+    if (spec) {
+        k << spec->mapEntryCount;
+        for (uint32_t i = 0; i < spec->mapEntryCount; i++) {
+            k << spec->pMapEntries[i].constantID << spec->pMapEntries[i].offset << spec->pMapEntries[i].size;
+        }
+        k.data(spec->pData, spec->dataSize);
+    }
+}
+
+static void add(Key& k, const VkStencilOpState& s) {
+    k << s.failOp << s.passOp << s.depthFailOp << s.compareOp << s.compareMask << s.writeMask << s.reference;
+}
+
+static void add(Key& k, const VkGraphicsPipelineCreateInfo& info) {
+
+    k.next(info.pNext) << info.flags << info.stageCount;
+    for (uint32_t i = 0; i < info.stageCount; i++) add(k, info.pStages[i]);
+
+    k.has(info.pVertexInputState);
+    if (info.pVertexInputState) {
+        const VkPipelineVertexInputStateCreateInfo& s = *info.pVertexInputState;
+        k.next(s.pNext) << s.flags << s.vertexBindingDescriptionCount << s.vertexAttributeDescriptionCount;
+        for (uint32_t i = 0; i < s.vertexBindingDescriptionCount; i++) {
+            const VkVertexInputBindingDescription& b = s.pVertexBindingDescriptions[i];
+            k << b.binding << b.stride << b.inputRate;
+        }
+        for (uint32_t i = 0; i < s.vertexAttributeDescriptionCount; i++) {
+            const VkVertexInputAttributeDescription& a = s.pVertexAttributeDescriptions[i];
+            k << a.location << a.binding << a.format << a.offset;
+        }
+    }
+
+    k.has(info.pInputAssemblyState);
+    if (info.pInputAssemblyState) {
+        const VkPipelineInputAssemblyStateCreateInfo& s = *info.pInputAssemblyState;
+        k.next(s.pNext) << s.flags << s.topology << s.primitiveRestartEnable;
+    }
+
+    k.has(info.pTessellationState);
+    if (info.pTessellationState) {
+        const VkPipelineTessellationStateCreateInfo& s = *info.pTessellationState;
+        k.next(s.pNext) << s.flags << s.patchControlPoints;
+    }
+
+    k.has(info.pViewportState);
+    if (info.pViewportState) {
+        const VkPipelineViewportStateCreateInfo& s = *info.pViewportState;
+        k.next(s.pNext) << s.flags << s.viewportCount << s.scissorCount;
+        k.has(s.pViewports);
+        if (s.pViewports) {
+            for (uint32_t i = 0; i < s.viewportCount; i++) {
+                const VkViewport& v = s.pViewports[i];
+                k << v.x << v.y << v.width << v.height << v.minDepth << v.maxDepth;
+            }
+        }
+        k.has(s.pScissors);
+        if (s.pScissors) {
+            for (uint32_t i = 0; i < s.scissorCount; i++) {
+                const VkRect2D& r = s.pScissors[i];
+                k << r.offset.x << r.offset.y << r.extent.width << r.extent.height;
+            }
+        }
+    }
+
+    k.has(info.pRasterizationState);
+    if (info.pRasterizationState) {
+        const VkPipelineRasterizationStateCreateInfo& s = *info.pRasterizationState;
+        k.next(s.pNext) << s.flags << s.depthClampEnable << s.rasterizerDiscardEnable << s.polygonMode
+          << s.cullMode << s.frontFace << s.depthBiasEnable << s.depthBiasConstantFactor
+          << s.depthBiasClamp << s.depthBiasSlopeFactor << s.lineWidth;
+    }
+
+    k.has(info.pMultisampleState);
+    if (info.pMultisampleState) {
+        const VkPipelineMultisampleStateCreateInfo& s = *info.pMultisampleState;
+        k.next(s.pNext) << s.flags << s.rasterizationSamples << s.sampleShadingEnable << s.minSampleShading
+          << s.alphaToCoverageEnable << s.alphaToOneEnable;
+        k.has(s.pSampleMask);
+        if (s.pSampleMask) {
+            for (uint32_t i = 0; i < (s.rasterizationSamples + 31) / 32; i++) k << s.pSampleMask[i];
+        }
+    }
+
+    k.has(info.pDepthStencilState);
+    if (info.pDepthStencilState) {
+        const VkPipelineDepthStencilStateCreateInfo& s = *info.pDepthStencilState;
+        k.next(s.pNext) << s.flags << s.depthTestEnable << s.depthWriteEnable << s.depthCompareOp
+          << s.depthBoundsTestEnable << s.stencilTestEnable << s.minDepthBounds << s.maxDepthBounds;
+        add(k, s.front);
+        add(k, s.back);
+    }
+
+    k.has(info.pColorBlendState);
+    if (info.pColorBlendState) {
+        const VkPipelineColorBlendStateCreateInfo& s = *info.pColorBlendState;
+        k.next(s.pNext) << s.flags << s.logicOpEnable << s.logicOp << s.attachmentCount;
+        for (uint32_t i = 0; i < s.attachmentCount; i++) {
+            const VkPipelineColorBlendAttachmentState& a = s.pAttachments[i];
+            k << a.blendEnable << a.srcColorBlendFactor << a.dstColorBlendFactor << a.colorBlendOp
+              << a.srcAlphaBlendFactor << a.dstAlphaBlendFactor << a.alphaBlendOp << a.colorWriteMask;
+        }
+        for (float c : s.blendConstants) k << c;
+    }
+
+    k.has(info.pDynamicState);
+    if (info.pDynamicState) {
+        const VkPipelineDynamicStateCreateInfo& s = *info.pDynamicState;
+        k.next(s.pNext) << s.flags << s.dynamicStateCount;
+        for (uint32_t i = 0; i < s.dynamicStateCount; i++) k << s.pDynamicStates[i];
+    }
+
+    k.dep(Cache::PIPELINE_LAYOUT, (uint64_t) info.layout);
+    k.pass(info.renderPass) << info.subpass << info.basePipelineIndex;
+    k.unkeyed(info.basePipelineHandle);
+}
+
+Cache::Cache(Device& d) : device(d) {}
+
+// whatever's left (nobody released it), destroyed in the order they depend on each other
+Cache::~Cache() {
+    for (auto& [key, e] : entries[PIPELINE]) vkDestroyPipeline(device, (VkPipeline) e.handle, nullptr);
+    for (auto& [key, e] : entries[PIPELINE_LAYOUT]) vkDestroyPipelineLayout(device, (VkPipelineLayout) e.handle, nullptr);
+    for (auto& [key, e] : entries[SET_LAYOUT]) vkDestroyDescriptorSetLayout(device, (VkDescriptorSetLayout) e.handle, nullptr);
+    for (auto& [key, e] : entries[SHADER]) vkDestroyShaderModule(device, (VkShaderModule) e.handle, nullptr);
+}
+
+// the one made with key, with one more user
+bool Cache::find(Kind kind, const std::string& key, uint64_t& handle, std::vector<uint32_t>* code) {
+    std::lock_guard<std::mutex> lock(mutex);
+    _stats.asked[kind]++;
+
+    auto it = entries[kind].find(key);
+    if (it == entries[kind].end()) return false;
+
+    it->second.refs++;
+    handle = it->second.handle;
+    if (code) *code = it->second.code;
+    return true;
+}
+
+// the one to use: handle, or the same one another thread made in the meantime
+// (then handle is the caller's to destroy)
+uint64_t Cache::insert(Kind kind, const std::string& key, uint64_t handle, const std::vector<uint64_t>& passes,
+                       std::vector<uint32_t>* code) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto it = entries[kind].find(key);
+    if (it != entries[kind].end()) {
+        it->second.refs++;
+        return it->second.handle;
+    }
+
+    _stats.made[kind]++;
+    entries[kind][key] = {handle, 1, passes, code ? *code : std::vector<uint32_t>()};
+    keys[kind][handle] = key;
+    return handle;
+}
+
+// whether handle should be destroyed now: it was its last user, or it was never shared
+bool Cache::drop(Kind kind, uint64_t handle) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto k = keys[kind].find(handle);
+    if (k == keys[kind].end()) return true;
+
+    Entry& e = entries[kind][k->second];
+    if (--e.refs > 0) return false;
+
+    entries[kind].erase(k->second);
+    keys[kind].erase(k);
+    return true;
+}
+
+// what a handle the cache made was made from
+bool Cache::keyOf(Kind kind, uint64_t handle, std::string& key) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto k = keys[kind].find(handle);
+    if (k == keys[kind].end()) return false;
+    key = k->second;
+    return true;
+}
+
+void Cache::forget(VkRenderPass p) {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (auto it = entries[PIPELINE].begin(); it != entries[PIPELINE].end();) {
+        const std::vector<uint64_t>& passes = it->second.passes;
+        if (std::find(passes.begin(), passes.end(), (uint64_t) p) == passes.end()) {
+            ++it;
+            continue;
+        }
+        // (drop() destroys it with the last release then, like one that was never shared)
+        keys[PIPELINE].erase(it->second.handle);
+        it = entries[PIPELINE].erase(it);
+    }
+}
+
+VkShaderModule Cache::shader(const std::string& source, std::function<std::vector<char>()> compile,
+                             std::vector<uint32_t>& spirv) {
+
+    uint64_t h;
+    if (find(SHADER, source, h, &spirv)) return (VkShaderModule) h;
+
+    std::vector<char> code = compile();
+    spirv.resize(code.size() / 4);
+    memcpy(spirv.data(), code.data(), spirv.size() * 4);
+
+    VkShaderModuleCreateInfo info {
+        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+        .codeSize = spirv.size() * 4,
+        .pCode = spirv.data()
+    };
+
+    VkShaderModule module;
+    VK_ASSERT( vkCreateShaderModule(device, &info, nullptr, &module) );
+    // (if another thread made it first, that one's code is the same anyway)
+    VkShaderModule ret = (VkShaderModule) insert(SHADER, source, (uint64_t) module, {}, &spirv);
+    if (ret != module) vkDestroyShaderModule(device, module, nullptr);
+    return ret;
+}
+
+VkDescriptorSetLayout Cache::setLayout(const VkDescriptorSetLayoutCreateInfo& info) {
+
+    Key k(*this);
+    k << info.flags << info.bindingCount;
+    for (uint32_t i = 0; i < info.bindingCount; i++) add(k, info.pBindings[i]);
+
+    // the binding flags (see Heap) are the one extension that's looked at
+    auto flags = (const VkDescriptorSetLayoutBindingFlagsCreateInfo*) info.pNext;
+    if (flags && flags->sType == VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO) {
+        k.next(flags->pNext) << flags->bindingCount;
+        for (uint32_t i = 0; i < flags->bindingCount; i++) k << flags->pBindingFlags[i];
+    } else {
+        k.next(info.pNext);
+    }
+
+    uint64_t h;
+    if (k.cacheable && find(SET_LAYOUT, k.bytes, h)) return (VkDescriptorSetLayout) h;
+
+    VkDescriptorSetLayout layout;
+    VK_ASSERT( vkCreateDescriptorSetLayout(device, &info, nullptr, &layout) );
+    if (!k.cacheable) return layout;
+
+    VkDescriptorSetLayout ret = (VkDescriptorSetLayout) insert(SET_LAYOUT, k.bytes, (uint64_t) layout);
+    if (ret != layout) vkDestroyDescriptorSetLayout(device, layout, nullptr);
+    return ret;
+}
+
+VkPipelineLayout Cache::pipelineLayout(const VkPipelineLayoutCreateInfo& info) {
+
+    Key k(*this);
+    k.next(info.pNext) << info.flags << info.setLayoutCount << info.pushConstantRangeCount;
+    for (uint32_t i = 0; i < info.setLayoutCount; i++) k.dep(SET_LAYOUT, (uint64_t) info.pSetLayouts[i]);
+    for (uint32_t i = 0; i < info.pushConstantRangeCount; i++) {
+        const VkPushConstantRange& r = info.pPushConstantRanges[i];
+        k << r.stageFlags << r.offset << r.size;
+    }
+
+    uint64_t h;
+    if (k.cacheable && find(PIPELINE_LAYOUT, k.bytes, h)) return (VkPipelineLayout) h;
+
+    VkPipelineLayout layout;
+    VK_ASSERT( vkCreatePipelineLayout(device, &info, nullptr, &layout) );
+    if (!k.cacheable) return layout;
+
+    VkPipelineLayout ret = (VkPipelineLayout) insert(PIPELINE_LAYOUT, k.bytes, (uint64_t) layout);
+    if (ret != layout) vkDestroyPipelineLayout(device, layout, nullptr);
+    return ret;
+}
+
+VkPipeline Cache::graphics(const VkGraphicsPipelineCreateInfo& info) {
+
+    Key k(*this);
+    k << (uint8_t) VK_PIPELINE_BIND_POINT_GRAPHICS;
+    add(k, info);
+
+    uint64_t h;
+    if (k.cacheable && find(PIPELINE, k.bytes, h)) return (VkPipeline) h;
+
+    VkPipeline pipeline;
+    VK_ASSERT( vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &info, nullptr, &pipeline) );
+    if (!k.cacheable) return pipeline;
+
+    VkPipeline ret = (VkPipeline) insert(PIPELINE, k.bytes, (uint64_t) pipeline, k.passes);
+    if (ret != pipeline) vkDestroyPipeline(device, pipeline, nullptr);
+    return ret;
+}
+
+VkPipeline Cache::compute(const VkComputePipelineCreateInfo& info) {
+
+    Key k(*this);
+    k << (uint8_t) VK_PIPELINE_BIND_POINT_COMPUTE;
+    k.next(info.pNext) << info.flags;
+    add(k, info.stage);
+    k.dep(PIPELINE_LAYOUT, (uint64_t) info.layout) << info.basePipelineIndex;
+    k.unkeyed(info.basePipelineHandle);
+
+    uint64_t h;
+    if (k.cacheable && find(PIPELINE, k.bytes, h)) return (VkPipeline) h;
+
+    VkPipeline pipeline;
+    VK_ASSERT( vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &info, nullptr, &pipeline) );
+    if (!k.cacheable) return pipeline;
+
+    VkPipeline ret = (VkPipeline) insert(PIPELINE, k.bytes, (uint64_t) pipeline);
+    if (ret != pipeline) vkDestroyPipeline(device, pipeline, nullptr);
+    return ret;
+}
+
+void Cache::release(VkShaderModule m) {
+    if (drop(SHADER, (uint64_t) m)) vkDestroyShaderModule(device, m, nullptr);
+}
+
+void Cache::release(VkDescriptorSetLayout l) {
+    if (drop(SET_LAYOUT, (uint64_t) l)) vkDestroyDescriptorSetLayout(device, l, nullptr);
+}
+
+void Cache::release(VkPipelineLayout l) {
+    if (drop(PIPELINE_LAYOUT, (uint64_t) l)) vkDestroyPipelineLayout(device, l, nullptr);
+}
+
+void Cache::release(VkPipeline p) {
+    if (drop(PIPELINE, (uint64_t) p)) vkDestroyPipeline(device, p, nullptr);
+}
+
+const char* Cache::name(Kind k) {
+    static const char* names[KINDS] {"shader modules", "set layouts", "pipeline layouts", "pipelines"};
+    return names[k];
+}
+
+};
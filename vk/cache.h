@@ -0,0 +1,105 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "vklib.h"
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+
+namespace vk {
+
+class Device;
+struct Key;
+
+// Shares the objects that only depend on what they're made from: shader
+// modules, descriptor set layouts, pipeline layouts and pipelines. Asking for
+// one with the same create info (everything it points to, compared by
+// contents) as one that's still around hands out that one again, so two
+// materials with the same vertex shader share its module and their layouts,
+// and two with the same shaders and state share the whole pipeline.
+// Shader modules go by their glsl, so a shader that's already there isn't
+// even compiled again.
+//
+// The modules and layouts a create info points to go by what they were made
+// from too, not their handles (a destroyed one's handle can come back as
+// something else). So they have to be the cache's, with one that isn't (or
+// with immutable samplers, or a base pipeline) it always makes a new one.
+// Render passes are the exception, they go by their handle and forget() them
+// once they're destroyed (RenderPass does).
+//
+// Everything is counted, release() destroys it when the last user lets go.
+// Create infos with a pNext chain aren't looked at, they always make a new one
+// (except a set layout's binding flags).
+// It can be used from any thread (see Material's background compiles).
+//
+// The Device has one, used by ShaderModule and Pipeline.
+class Cache {
+
+    friend struct Key;
+
+public:
+
+    enum Kind {SHADER, SET_LAYOUT, PIPELINE_LAYOUT, PIPELINE, KINDS};
+
+    // how many were asked for, and how many of those were made
+    struct Stats {
+        uint64_t asked[KINDS] {};
+        uint64_t made[KINDS] {};
+    };
+
+private:
+
+    Device& device;
+
+    struct Entry {
+        uint64_t handle;
+        uint32_t refs;
+        std::vector<uint64_t> passes;  // render passes it was made with
+        std::vector<uint32_t> code;    // a shader module's spir-v
+    };
+    std::unordered_map<std::string, Entry> entries[KINDS];   // by the create info's bytes
+    std::unordered_map<uint64_t, std::string> keys[KINDS];   // the other way around
+
+    Stats _stats;
+    std::mutex mutex;  // for the maps, making things happens outside of it
+
+    bool find(Kind, const std::string& key, uint64_t& handle, std::vector<uint32_t>* code = nullptr);
+    uint64_t insert(Kind, const std::string& key, uint64_t handle, const std::vector<uint64_t>& passes = {},
+                    std::vector<uint32_t>* code = nullptr);
+    bool drop(Kind, uint64_t handle);
+    bool keyOf(Kind, uint64_t handle, std::string& key);
+
+public:
+
+    Cache(Device&);
+    ~Cache();
+
+    // the module for the source (the stage and the code), compile() makes the
+    // spir-v if there isn't one yet. spirv gets the module's, compiled now or not
+    VkShaderModule shader(const std::string& source, std::function<std::vector<char>()> compile,
+                          std::vector<uint32_t>& spirv);
+    VkDescriptorSetLayout setLayout(const VkDescriptorSetLayoutCreateInfo&);
+    VkPipelineLayout pipelineLayout(const VkPipelineLayoutCreateInfo&);
+    VkPipeline graphics(const VkGraphicsPipelineCreateInfo&);
+    VkPipeline compute(const VkComputePipelineCreateInfo&);
+
+    // one user less, destroyed if it was the last
+    void release(VkShaderModule);
+    void release(VkDescriptorSetLayout);
+    void release(VkPipelineLayout);
+    void release(VkPipeline);
+
+    // the pipelines made with a render pass aren't handed out again, it's being
+    // destroyed (they're still their users' to release)
+    void forget(VkRenderPass);
+
+    // alive right now
+    size_t count(Kind k) const {return entries[k].size();}
+
+    const Stats& stats() const {return _stats;}
+
+    static const char* name(Kind);
+};
+
+};
+#endif
@@ -3,6 +3,12 @@
 
 namespace vk {
 
+// the accesses that need flushing before anything else touches the memory
+static constexpr VkAccessFlags2 WRITES =
+    VK_ACCESS_2_SHADER_WRITE_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT |
+    VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_2_TRANSFER_WRITE_BIT | VK_ACCESS_2_HOST_WRITE_BIT | VK_ACCESS_2_MEMORY_WRITE_BIT;
+
 // vkCmdBeginRendering
 // void CommandBuffer::beginRendering (std::vector<VkRenderingAttachmentInfo> attachment_col,
 //                                     VkRenderingAttachmentInfo attachment_depth,
@@ -45,24 +51,28 @@ void CommandBuffer::imageTransition(
     Image& im,
     VkImageLayout srcl, VkPipelineStageFlags srcs, VkAccessFlags srca,
     VkImageLayout dstl, VkPipelineStageFlags dsts, VkAccessFlags dsta,
-    VkImageAspectFlags aspect
+    VkImageAspectFlags aspect,
+    uint32_t srcf, uint32_t dstf
 ) {
 
+    // the same family is no transfer at all
+    if (srcf == dstf) srcf = dstf = VK_QUEUE_FAMILY_IGNORED;
+
     VkImageMemoryBarrier transition{
         .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
         .srcAccessMask = srca,
         .dstAccessMask = dsta,
         .oldLayout = srcl,
         .newLayout = dstl,
-        .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-        .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+        .srcQueueFamilyIndex = srcf,
+        .dstQueueFamilyIndex = dstf,
         .image = (VkImage) im,
         .subresourceRange = {
             .aspectMask = aspect,
             .baseMipLevel = 0,
-            .levelCount = 1,
+            .levelCount = VK_REMAINING_MIP_LEVELS,  // the whole image
             .baseArrayLayer = 0,
-            .layerCount = 1
+            .layerCount = VK_REMAINING_ARRAY_LAYERS
         }
     };
 
@@ -74,13 +84,147 @@ void CommandBuffer::imageTransition(
         1, &transition
     );
 
+    // whatever comes next is going to use it as the barrier said
+    im._layout = dstl;
+    im._stages = dsts;
+    im._writes = dsta & WRITES;
+}
+
+// the layout, stages and accesses of each Image::Usage
+struct UsageInfo {
+    VkImageLayout layout;
+    VkPipelineStageFlags2 stages;
+    VkAccessFlags2 access;
+};
+
+static const UsageInfo usages[] = {  // in the order of Image::Usage
+    // SAMPLED_FRAGMENT
+    {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_2_FRAGMENT_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT},
+    // SAMPLED_COMPUTE
+    {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_SAMPLED_READ_BIT},
+    // STORAGE_READ
+    {VK_IMAGE_LAYOUT_GENERAL,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT},
+    // STORAGE_WRITE
+    {VK_IMAGE_LAYOUT_GENERAL,
+        VK_PIPELINE_STAGE_2_COMPUTE_SHADER_BIT, VK_ACCESS_2_SHADER_STORAGE_READ_BIT | VK_ACCESS_2_SHADER_STORAGE_WRITE_BIT},
+    // COLOR_ATTACHMENT
+    {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+        VK_PIPELINE_STAGE_2_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_2_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_2_COLOR_ATTACHMENT_WRITE_BIT},
+    // DEPTH_ATTACHMENT
+    {VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+        VK_PIPELINE_STAGE_2_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_2_LATE_FRAGMENT_TESTS_BIT,
+        VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_2_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT},
+    // TRANSFER_SRC
+    {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+        VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_READ_BIT},
+    // TRANSFER_DST
+    {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_2_ALL_TRANSFER_BIT, VK_ACCESS_2_TRANSFER_WRITE_BIT},
+    // PRESENT
+    {VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+        VK_PIPELINE_STAGE_2_NONE, VK_ACCESS_2_NONE},
+};
+
+void CommandBuffer::use(Image& im, Image::Usage usage, bool discard) {
+    use({{&im, usage, discard}});
+}
+
+void CommandBuffer::use(std::vector<Image::Use> uses) {
+
+    std::vector<VkImageMemoryBarrier2> barriers;
+
+    for (const Image::Use& u : uses) {
+        Image& im = *u.image;
+        const UsageInfo& next = usages[u.usage];
+        VkAccessFlags2 writes = next.access & WRITES;
+
+        // reading what's already visible, in the layout it's in
+        if (!u.discard && im._layout == next.layout && !im._writes && !writes) {
+            im._stages |= next.stages;
+            continue;
+        }
+
+        // wait for everything that used it since the last barrier, but only
+        // flush the writes (a write after reads just needs them to be done)
+        bool depth = im.format == vk_DEPTH_FORMAT;
+        barriers.push_back({
+            .sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER_2,
+            .srcStageMask = im._stages,
+            .srcAccessMask = im._writes,
+            .dstStageMask = next.stages,
+            .dstAccessMask = next.access,
+            .oldLayout = u.discard ? VK_IMAGE_LAYOUT_UNDEFINED : im._layout,
+            .newLayout = next.layout,
+            .srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+            .image = (VkImage) im,
+            .subresourceRange = {
+                .aspectMask = depth ? (VkImageAspectFlags) VK_IMAGE_ASPECT_DEPTH_BIT : (VkImageAspectFlags) VK_IMAGE_ASPECT_COLOR_BIT,
+                .baseMipLevel = 0,
+                .levelCount = VK_REMAINING_MIP_LEVELS,
+                .baseArrayLayer = 0,
+                .layerCount = VK_REMAINING_ARRAY_LAYERS
+            }
+        });
+
+        im._layout = next.layout;
+        im._stages = next.stages;
+        im._writes = writes;
+    }
+
+    if (barriers.empty()) return;
+
+    VkDependencyInfo dep {
+        .sType = VK_STRUCTURE_TYPE_DEPENDENCY_INFO,
+        .imageMemoryBarrierCount = (uint32_t) barriers.size(),
+        .pImageMemoryBarriers = barriers.data(),
+    };
+    vkCmdPipelineBarrier2(cmd, &dep);
+}
+
+// makes the srca writes at srcs visible to dsta at dsts
+void CommandBuffer::memoryBarrier(VkPipelineStageFlags srcs, VkAccessFlags srca, VkPipelineStageFlags dsts, VkAccessFlags dsta) {
+
+    VkMemoryBarrier barrier {
+        .sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+        .srcAccessMask = srca,
+        .dstAccessMask = dsta,
+    };
+
+    vkCmdPipelineBarrier(cmd,
+        srcs, dsts,
+        0,
+        1, &barrier,
+        0, nullptr,
+        0, nullptr
+    );
 }
 
 // vkCmdBindPipeline
 void CommandBuffer::bindPipeline(Pipeline& p){
     std::vector<VkDescriptorSet> d = p._getdescset();
-    vkCmdBindDescriptorSets(cmd, p, p, 0, (uint32_t) d.size(), d.data(), 0, nullptr);
+    if (!d.empty()) {
+        vkCmdBindDescriptorSets(cmd, p, p, p._pushed() ? 1 : 0, (uint32_t) d.size(), d.data(), 0, nullptr);
+    }
     vkCmdBindPipeline(cmd, p, p);
+    p._push(cmd);
+}
+
+// vkCmdPushDescriptorSetKHR
+void CommandBuffer::pushDescriptors(Pipeline& p) {
+    if (p._pushed()) {
+        p._push(cmd);
+        return;
+    }
+
+    // (no push descriptors on the device: the sets with what changed, bound again)
+    std::vector<VkDescriptorSet> d = p._getdescset();
+    if (!d.empty()) {
+        vkCmdBindDescriptorSets(cmd, p, p, 0, (uint32_t) d.size(), d.data(), 0, nullptr);
+    }
 }
 
 // vkCmdBindVertexBuffers
@@ -156,6 +300,45 @@ void CommandBuffer::blit(Image& src, VkImageLayout srcl, VkOffset3D srcext, Imag
     );
 }
 
+// vkCmdCopyBuffer
+void CommandBuffer::copyBuffer(Buffer& src, Buffer& dst, VkDeviceSize size) {
+    VkBufferCopy region {.size = size};
+    vkCmdCopyBuffer(cmd, src, dst, 1, &region);
+}
+
+// vkCmdCopyBufferToImage, image must be in VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL
+void CommandBuffer::copyBufferToImage(Buffer& src, Image& dst, VkExtent3D extent, VkImageAspectFlags aspect) {
+    VkBufferImageCopy region {
+        .bufferOffset = 0,
+        .bufferRowLength = 0, // tightly packed
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = aspect,
+            .layerCount = 1
+        },
+        .imageOffset = {0, 0, 0},
+        .imageExtent = extent,
+    };
+    vkCmdCopyBufferToImage(cmd, src, dst, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+}
+
+// vkCmdCopyImageToBuffer
+void CommandBuffer::copyImageToBuffer(Image& src, VkImageLayout layout, Buffer& dst, uint32_t level, VkImageAspectFlags aspect) {
+    VkBufferImageCopy region {
+        .bufferOffset = 0,
+        .bufferRowLength = 0, // tightly packed
+        .bufferImageHeight = 0,
+        .imageSubresource = {
+            .aspectMask = aspect,
+            .mipLevel = level,
+            .layerCount = 1
+        },
+        .imageOffset = {0, 0, 0},
+        .imageExtent = src.extent(level),
+    };
+    vkCmdCopyImageToBuffer(cmd, src, layout, dst, 1, &region);
+}
+
 // vkCmdEndRendering
 void CommandBuffer::endRendering () {
     vkCmdEndRendering(cmd);
@@ -39,9 +39,14 @@ public:
     // mirrors vkCmdEndRendering
     void endRendering();
 
-    // mirrors vkCmdBindPipeline
+    // mirrors vkCmdBindPipeline, and binds (or pushes) its descriptor sets
     void bindPipeline(Pipeline&);
 
+    // mirrors vkCmdPushDescriptorSetKHR: records the bindings written to a
+    // push pipeline's set 0 straight into the command buffer, no set needed.
+    // bindPipeline() does it too, this is for new writes between draws / dispatches
+    void pushDescriptors(Pipeline&);
+
     // mirrors vkCmdPushConstants
     void setPcrData(Pipeline&, int, void*);
 
@@ -66,17 +71,43 @@ public:
     // wraps vkCmdSetViewport and vkCmdSetScissor
     void setRenderArea(VkViewport, VkRect2D);
 
+    // mirrors vkCmdCopyBuffer(src, dst, size)
+    void copyBuffer(Buffer&, Buffer&, VkDeviceSize);
+
+    // mirrors vkCmdCopyBufferToImage, copies a tightly packed buffer into the whole image
+    void copyBufferToImage(Buffer&, Image&, VkExtent3D, VkImageAspectFlags);
+
+    // mirrors vkCmdCopyImageToBuffer, copies a whole mip level (of the first layer) into a tightly packed buffer
+    void copyImageToBuffer(Image&, VkImageLayout, Buffer&, uint32_t level, VkImageAspectFlags);
+
     // wraps vkCmdImageBlit
     void blit(Image&, VkImageLayout, VkOffset3D, Image&, VkImageLayout, VkOffset3D, VkImageAspectFlags);
 
-    // transitions an image from one VkImageLayout to another
+    // transitions an image from one VkImageLayout to another.
+    // with two different queue families, it's the release (recorded on the first)
+    // or the acquire (on the second) half of an ownership transfer
     void imageTransition(
         Image&,
         VkImageLayout, VkPipelineStageFlags, VkAccessFlags,
         VkImageLayout, VkPipelineStageFlags, VkAccessFlags,
-        VkImageAspectFlags
+        VkImageAspectFlags,
+        uint32_t srcFamily = VK_QUEUE_FAMILY_IGNORED, uint32_t dstFamily = VK_QUEUE_FAMILY_IGNORED
     );
 
+    // makes the image ready for usage, after whatever it was used for last (as recorded),
+    // with a vkCmdPipelineBarrier2 that only waits for the stages that used it and only
+    // flushes their writes. reads after reads in the same layout need no barrier at all.
+    // the old contents are kept unless discard is set.
+    // assumes the command buffers get submitted in the order they're recorded in
+    // (or, across queues, that a semaphore is between the two uses)
+    void use(Image&, Image::Usage, bool discard = false);
+
+    // same, for a few images at once, in a single barrier
+    void use(std::vector<Image::Use>);
+
+    // a global memory barrier, eg. between dispatches sharing a buffer
+    void memoryBarrier(VkPipelineStageFlags, VkAccessFlags, VkPipelineStageFlags, VkAccessFlags);
+
     // getters
     operator VkCommandBuffer() {return cmd;}
 };
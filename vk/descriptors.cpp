@@ -0,0 +1,112 @@
+#include "vklib.h"
+
+namespace vk {
+
+// the biggest a pool gets, in sets
+static const uint32_t max_size = 4096;
+
+DescriptorAllocator::DescriptorAllocator(Device& d) : device(d) {}
+
+DescriptorAllocator::~DescriptorAllocator() {
+    std::vector<VkDescriptorPool> all = used;
+    all.insert(all.end(), ready.begin(), ready.end());
+    for (Frame& f : inflight) all.insert(all.end(), f.pools.begin(), f.pools.end());
+    if (current != VK_NULL_HANDLE) all.push_back(current);
+
+    for (VkDescriptorPool p : all) {
+        vkDestroyDescriptorPool(device, p, nullptr);
+    }
+}
+
+// a reset pool if there is one, otherwise a new (bigger) one
+VkDescriptorPool DescriptorAllocator::take() {
+
+    if (!ready.empty()) {
+        VkDescriptorPool p = ready.back();
+        ready.pop_back();
+        return p;
+    }
+
+    // a few of each type per set, whatever the layouts turn out to be
+    std::vector<VkDescriptorPoolSize> sizes {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, size * 4},
+        {VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, size * 2},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, size * 2},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, size * 2},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, size * 2},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, size},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, size},
+        {VK_DESCRIPTOR_TYPE_SAMPLER, size},
+    };
+
+    VkDescriptorPoolCreateInfo info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .maxSets = size,
+        .poolSizeCount = (uint32_t) sizes.size(),
+        .pPoolSizes = sizes.data(),
+    };
+
+    VkDescriptorPool p;
+    VK_ASSERT( vkCreateDescriptorPool(device, &info, nullptr, &p) );
+    size = std::min(size * 2, max_size);
+    pools++;
+    return p;
+}
+
+VkDescriptorSet DescriptorAllocator::allocate(VkDescriptorSetLayout layout) {
+
+    if (current == VK_NULL_HANDLE) current = take();
+
+    VkDescriptorSetAllocateInfo info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .descriptorPool = current,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &layout,
+    };
+
+    VkDescriptorSet set;
+    VkResult res = vkAllocateDescriptorSets(device, &info, &set);
+
+    // full, this one's done for the frame. a fresh pool has room for any one set
+    if (res == VK_ERROR_OUT_OF_POOL_MEMORY || res == VK_ERROR_FRAGMENTED_POOL) {
+        used.push_back(current);
+        current = info.descriptorPool = take();
+        res = vkAllocateDescriptorSets(device, &info, &set);
+    }
+    VK_ASSERT( res );
+
+    sets++;
+    return set;
+}
+
+// whether the gpu got to all of them
+bool DescriptorAllocator::reached(const std::vector<Sync>& syncs) {
+    for (const Sync& s : syncs) {
+        uint64_t v;
+        VK_ASSERT( vkGetSemaphoreCounterValue(device, s.semaphore, &v) );
+        if (v < s.value) return false;
+    }
+    return true;
+}
+
+void DescriptorAllocator::frame(std::vector<Sync> done) {
+
+    // the current pool stays with this frame too, the next one starts on a fresh one
+    if (current != VK_NULL_HANDLE) used.push_back(current);
+    current = VK_NULL_HANDLE;
+    if (!used.empty()) inflight.push_back({done, std::move(used)});
+    used.clear();
+    sets = 0;
+    frames++;
+
+    // frames finish in order, the first one that isn't done is where it stops
+    while (!inflight.empty() && reached(inflight.front().done)) {
+        for (VkDescriptorPool p : inflight.front().pools) {
+            vkResetDescriptorPool(device, p, 0);
+            ready.push_back(p);
+        }
+        inflight.pop_front();
+    }
+}
+
+};
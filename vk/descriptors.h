@@ -0,0 +1,67 @@
+#ifndef DESCRIPTORS_H
+#define DESCRIPTORS_H
+
+#include "vklib.h"
+#include <deque>
+
+namespace vk {
+
+class Device;
+struct Sync;
+
+// Hands out descriptor sets for the frame being recorded, out of pools that
+// belong to that frame. Sets are never freed or written over one by one: when
+// the gpu is done with a frame (its syncs are reached), all of its pools are
+// reset at once and reused by a later frame.
+//
+// A pool that runs out is retired to the frame and a new one is taken, so it
+// grows with whatever a frame needs, and stays there. Every new pool is twice
+// the size of the last one (up to a limit), sized for any kind of descriptor.
+//
+// The Device has one, used by every Pipeline.
+class DescriptorAllocator {
+
+    Device& device;
+
+    VkDescriptorPool current = VK_NULL_HANDLE;  // the pool sets come from now
+    std::vector<VkDescriptorPool> used;         // full ones, of the frame being recorded
+    std::vector<VkDescriptorPool> ready;        // reset, for when current runs out
+    uint32_t size = 64;                         // sets in the next new pool
+
+    // frames that were submitted, and the pools they used
+    struct Frame {
+        std::vector<Sync> done;
+        std::vector<VkDescriptorPool> pools;
+    };
+    std::deque<Frame> inflight;
+
+    uint32_t pools = 0;   // made so far
+    uint64_t sets = 0;    // handed out this frame
+    uint64_t frames = 0;  // frame() calls so far
+
+    VkDescriptorPool take();
+    bool reached(const std::vector<Sync>&);
+
+public:
+
+    DescriptorAllocator(Device&);
+    ~DescriptorAllocator();
+
+    // a set of the layout, good until the frame's done on the gpu
+    VkDescriptorSet allocate(VkDescriptorSetLayout);
+
+    // the frame that was being recorded is done once done is reached, the next
+    // one starts. the pools of frames that are done by now are reset, it doesn't wait.
+    // (nothing in done means the frame's done already)
+    void frame(std::vector<Sync> done);
+
+    // the frame being recorded, counted from 0. sets from earlier ones can't be used
+    uint64_t number() const {return frames;}
+
+    // pools made so far, and sets handed out to the current frame
+    uint32_t poolCount() const {return pools;}
+    uint64_t setCount() const {return sets;}
+};
+
+};
+#endif
@@ -1,4 +1,5 @@
 #include "device.h"
+#include <cstring>
 
 namespace vk {
 
@@ -23,6 +24,8 @@ Device::Device (const Instance& instance) : instance(instance) {
 
     // set null for late initialization
     device = NULL;
+    _descriptors = nullptr;
+    _cache = nullptr;
 
     // create a stager queue for internal use (_copybuffer)
     _stagerq = &create_queue(VK_QUEUE_TRANSFER_BIT);
@@ -40,21 +43,28 @@ Queue& Device::create_queue(uint32_t flags) {
     std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
     vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyCount, queueFamilies.data());
 
-    // split the flags into the real flags and the presentation flag
+    // split the flags into the real flags and the presentation/dedicated flags
     bool present = flags & VK_QUEUE_PRESENTATION_BIT;
-           flags = flags & ~VK_QUEUE_PRESENTATION_BIT;
+    bool dedicated = flags & VK_QUEUE_DEDICATED_BIT;
+           flags = flags & ~(VK_QUEUE_PRESENTATION_BIT | VK_QUEUE_DEDICATED_BIT);
 
     // try to find the correct queuefamily
+    // takes the first one that fits, or if dedicated, the one with the least extra capabilities
     uint32_t qf = 0;
+    int best = -1;
     for (int i = 0; i < queueFamilyCount; i++) {
-        if (queueFamilies[i].queueFlags & flags == flags) {
+        if ((queueFamilies[i].queueFlags & flags) == flags) {
             if (present) {
                 VkBool32 p;
                 vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevice, i, (VkSurfaceKHR) instance, &p);
                 if (!p) continue;
             }
 
-            qf = i;
+            int extra = std::popcount(queueFamilies[i].queueFlags & ~flags);
+            if (best < 0 || (dedicated && extra < best)) {
+                qf = i;
+                best = extra;
+            }
         }
     }
 
@@ -72,11 +82,35 @@ void Device::init() {
     const std::vector<const char*> validationLayers = {
         "VK_LAYER_KHRONOS_validation"
     };
-    const std::vector<const char*> deviceExtensions = {
+    std::vector<const char*> deviceExtensions = {
         VK_KHR_SWAPCHAIN_EXTENSION_NAME,
-        "VK_KHR_dynamic_rendering",
     };
 
+    // what the gpu has: vulkan 1.3, the extensions, and the features below
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(physicalDevice, &props);
+    if (props.apiVersion < VK_API_VERSION_1_3) {
+        throw std::runtime_error(std::string("vk::Device: ") + props.deviceName + " doesn't support Vulkan 1.3");
+    }
+
+    uint32_t extensionCount = 0;
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr);
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data());
+
+    auto supported = [&](const char* name) {
+        for (VkExtensionProperties& e : extensions) {
+            if (!strcmp(e.extensionName, name)) return true;
+        }
+        return false;
+    };
+
+    if (!supported(VK_KHR_SWAPCHAIN_EXTENSION_NAME)) {
+        throw std::runtime_error(std::string("vk::Device: ") + props.deviceName + " doesn't support " VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
+    _pushdescriptors = supported(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+    if (_pushdescriptors) deviceExtensions.push_back(VK_KHR_PUSH_DESCRIPTOR_EXTENSION_NAME);
+
     // run through the queues, and fetch their queuefamilies
     for (Queue* q : queues) {
         for (uint32_t i: families) {
@@ -102,16 +136,81 @@ void Device::init() {
         qcinfos.push_back(qci);
     }
 
-    VkPhysicalDeviceDynamicRenderingFeaturesKHR dynamic_render {
-        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES_KHR,
+    // dynamic rendering
+    // synchronization2, for CommandBuffer::use()
+    VkPhysicalDeviceVulkan13Features vk13 {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES,
+        .synchronization2 = VK_TRUE,
         .dynamicRendering = VK_TRUE,
     };
 
+    // descriptor indexing, for vk::Heap
+    // timeline semaphores, for syncing uploads across queues
+    // host query reset, for vk::Timestamps
+    VkPhysicalDeviceVulkan12Features vk12 {
+        .sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
+        .pNext = &vk13,
+        .descriptorIndexing = VK_TRUE,
+        .shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+        .descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+        .descriptorBindingStorageImageUpdateAfterBind = VK_TRUE,
+        .descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE,
+        .descriptorBindingUpdateUnusedWhilePending = VK_TRUE,
+        .descriptorBindingPartiallyBound = VK_TRUE,
+        .descriptorBindingVariableDescriptorCount = VK_TRUE,
+        .runtimeDescriptorArray = VK_TRUE,
+        .hostQueryReset = VK_TRUE,
+        .timelineSemaphore = VK_TRUE,
+    };
+
+    // indexing the arrays of vk::Heap with a value from the push constants
+    VkPhysicalDeviceFeatures deviceFeatures {
+        .shaderSampledImageArrayDynamicIndexing = VK_TRUE,
+        .shaderStorageBufferArrayDynamicIndexing = VK_TRUE,
+    };
+
+    // all of those have to be there
+    VkPhysicalDeviceVulkan13Features has13 {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_3_FEATURES};
+    VkPhysicalDeviceVulkan12Features has12 {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES, .pNext = &has13};
+    VkPhysicalDeviceFeatures2 has {.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2, .pNext = &has12};
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &has);
+
+    std::string missing;
+    auto need = [&](VkBool32 wanted, VkBool32 there, const char* name) {
+        if (wanted && !there) missing += std::string(missing.empty() ? "" : ", ") + name;
+    };
+    need(vk13.synchronization2, has13.synchronization2, "synchronization2");
+    need(vk13.dynamicRendering, has13.dynamicRendering, "dynamicRendering");
+    need(vk12.descriptorIndexing, has12.descriptorIndexing, "descriptorIndexing");
+    need(vk12.shaderSampledImageArrayNonUniformIndexing, has12.shaderSampledImageArrayNonUniformIndexing,
+         "shaderSampledImageArrayNonUniformIndexing");
+    need(vk12.descriptorBindingSampledImageUpdateAfterBind, has12.descriptorBindingSampledImageUpdateAfterBind,
+         "descriptorBindingSampledImageUpdateAfterBind");
+    need(vk12.descriptorBindingStorageImageUpdateAfterBind, has12.descriptorBindingStorageImageUpdateAfterBind,
+         "descriptorBindingStorageImageUpdateAfterBind");
+    need(vk12.descriptorBindingStorageBufferUpdateAfterBind, has12.descriptorBindingStorageBufferUpdateAfterBind,
+         "descriptorBindingStorageBufferUpdateAfterBind");
+    need(vk12.descriptorBindingUpdateUnusedWhilePending, has12.descriptorBindingUpdateUnusedWhilePending,
+         "descriptorBindingUpdateUnusedWhilePending");
+    need(vk12.descriptorBindingPartiallyBound, has12.descriptorBindingPartiallyBound, "descriptorBindingPartiallyBound");
+    need(vk12.descriptorBindingVariableDescriptorCount, has12.descriptorBindingVariableDescriptorCount,
+         "descriptorBindingVariableDescriptorCount");
+    need(vk12.runtimeDescriptorArray, has12.runtimeDescriptorArray, "runtimeDescriptorArray");
+    need(vk12.hostQueryReset, has12.hostQueryReset, "hostQueryReset");
+    need(vk12.timelineSemaphore, has12.timelineSemaphore, "timelineSemaphore");
+    need(deviceFeatures.shaderSampledImageArrayDynamicIndexing, has.features.shaderSampledImageArrayDynamicIndexing,
+         "shaderSampledImageArrayDynamicIndexing");
+    need(deviceFeatures.shaderStorageBufferArrayDynamicIndexing, has.features.shaderStorageBufferArrayDynamicIndexing,
+         "shaderStorageBufferArrayDynamicIndexing");
+
+    if (!missing.empty()) {
+        throw std::runtime_error(std::string("vk::Device: ") + props.deviceName + " doesn't support " + missing);
+    }
+
     // create the device
-    VkPhysicalDeviceFeatures deviceFeatures{};
     VkDeviceCreateInfo createInfo{
         .sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-        .pNext = &dynamic_render,
+        .pNext = &vk12,
         .queueCreateInfoCount = (uint32_t) qcinfos.size(),
         .pQueueCreateInfos = qcinfos.data(),
         .enabledLayerCount = (uint32_t) validationLayers.size(),
@@ -123,6 +222,21 @@ void Device::init() {
 
     VK_ASSERT( vkCreateDevice(physicalDevice, &createInfo, nullptr, &device) );
 
+    // extension functions. if they aren't there after all, pipelines allocate set 0 instead
+    if (_pushdescriptors) {
+        _cmdPushDescriptorSet = (PFN_vkCmdPushDescriptorSetKHR)
+            vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetKHR");
+        _cmdPushDescriptorSetWithTemplate = (PFN_vkCmdPushDescriptorSetWithTemplateKHR)
+            vkGetDeviceProcAddr(device, "vkCmdPushDescriptorSetWithTemplateKHR");
+        _pushdescriptors = _cmdPushDescriptorSet && _cmdPushDescriptorSetWithTemplate;
+    }
+    if (!_pushdescriptors) {
+        fprintf(stderr, "[device] no VK_KHR_push_descriptor, pushed sets are allocated instead\n");
+    }
+
+    _descriptors = new DescriptorAllocator(*this);
+    _cache = new Cache(*this);
+
     // init the queues
     for (Queue* q : queues) {
         q->init();
@@ -236,6 +350,22 @@ VkSemaphore Device::semaphore() {
     return s;
 }
 
+VkSemaphore Device::timeline(uint64_t initial) {
+    VkSemaphoreTypeCreateInfo t {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+        .semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+        .initialValue = initial,
+    };
+    VkSemaphoreCreateInfo i {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+        .pNext = &t,
+    };
+    VkSemaphore s;
+    VK_ASSERT( vkCreateSemaphore(device, &i, nullptr, &s) );
+    sems.push_back(s);
+    return s;
+}
+
 VkFence Device::fence() {
     return fence(false);
 }
@@ -256,10 +386,34 @@ void Device::wait (VkFence f) {
     vkResetFences(device, 1, &f);
 }
 
+bool Device::wait (std::vector<Sync> points, bool any, uint64_t timeout) {
+    std::vector<VkSemaphore> s;
+    std::vector<uint64_t> v;
+    for (const Sync& p : points) {
+        s.push_back(p.semaphore);
+        v.push_back(p.value);
+    }
+
+    VkSemaphoreWaitInfo info {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+        .flags = any ? VK_SEMAPHORE_WAIT_ANY_BIT : 0u,
+        .semaphoreCount = (uint32_t) s.size(),
+        .pSemaphores = s.data(),
+        .pValues = v.data(),
+    };
+
+    VkResult r = vkWaitSemaphores(device, &info, timeout);
+    if (r == VK_TIMEOUT) return false;
+    VK_ASSERT( r );
+    return true;
+}
+
 // Destructor.
 Device::~Device () {
 
     delete _stagerq;
+    delete _descriptors;
+    delete _cache;
 
     for (Image* i : swapimages) {
         delete i;
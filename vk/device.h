@@ -6,6 +6,9 @@
 // additional flag to the VkQueueFlagBits, to signal presentation support
 // https://registry.khronos.org/vulkan/specs/latest/man/html/VkQueueFlagBits.html
 #define VK_QUEUE_PRESENTATION_BIT 0x200
+// additional flag to the VkQueueFlagBits, to prefer a queue family with as few
+// other capabilities as possible (dedicated transfer / async compute families)
+#define VK_QUEUE_DEDICATED_BIT 0x400
 
 namespace vk {
 
@@ -14,12 +17,16 @@ class Instance;
 class Queue;
 class Image;
 class Buffer;
+class DescriptorAllocator;
+class Cache;
+struct Sync;
 
 // A vk::Device wraps a physical device and a VkDevice, and a VkSwapchainKHR.
 // Also allows you to create Queues using Device::create_queue().
 // The device is initialized and ready when Device::init() is called.
-// Assumes the extensions VK_KHR_SWAPCHAIN_EXTENSION_NAME and VK_KHR_dynamic_rendering
-// are available, and loads them.
+// Needs Vulkan 1.3 (synchronization2, dynamic rendering), VK_KHR_swapchain, and
+// descriptor indexing (for Heap), init() throws saying what's missing.
+// VK_KHR_push_descriptor is used if it's there, see pushDescriptors().
 class Device {
 
     const Instance& instance;
@@ -38,6 +45,9 @@ class Device {
     void createswapchain();
 
     Queue* _stagerq;
+    DescriptorAllocator* _descriptors;
+    Cache* _cache;
+    bool _pushdescriptors = false;
 
 public:
     // sole constructor
@@ -57,6 +67,9 @@ public:
     // creates a semaphore
     VkSemaphore semaphore();
 
+    // creates a timeline semaphore
+    VkSemaphore timeline(uint64_t);
+
     // creates a fence
     VkFence fence();
     VkFence fence(bool);
@@ -64,12 +77,30 @@ public:
     // waits for a fence
     void wait(VkFence);
 
+    // waits for timeline semaphores to reach their values, all of them or any.
+    // false if it timed out (in ns)
+    bool wait(std::vector<Sync>, bool any = false, uint64_t timeout = UINT64_MAX);
+
+    // where pipelines get their descriptor sets, see DescriptorAllocator::frame()
+    DescriptorAllocator& descriptors() {return *_descriptors;}
+
+    // where pipelines, their layouts and shader modules are made, see Cache
+    Cache& cache() {return *_cache;}
+
     // waits till the device is done with everything
     void idle() {vkDeviceWaitIdle(device);};
 
     // helpers:
     void _copybuffer(Buffer& src, Buffer& dst);
 
+    // whether there's VK_KHR_push_descriptor. without it, a pipeline made with
+    // push gets its set 0 from the DescriptorAllocator like the others
+    bool pushDescriptors() const {return _pushdescriptors;}
+
+    // VK_KHR_push_descriptor, which the loader doesn't export (nullptr without it)
+    PFN_vkCmdPushDescriptorSetKHR _cmdPushDescriptorSet = nullptr;
+    PFN_vkCmdPushDescriptorSetWithTemplateKHR _cmdPushDescriptorSetWithTemplate = nullptr;
+
     // getters
     operator VkPhysicalDevice() const {return physicalDevice;};
     operator VkDevice() const {return device;};
@@ -0,0 +1,534 @@
+#include "graph.h"
+#include <algorithm>
+
+namespace vk {
+
+static const char* usageNames[] = {  // in the order of Image::Usage
+    "sampled (fragment)", "sampled (compute)", "storage read", "storage write",
+    "color attachment", "depth attachment", "transfer src", "transfer dst", "present"
+};
+
+const char* Graph::name(QueueType q) {
+    static const char* names[] = {"graphics", "compute", "transfer"};
+    return q < QUEUES ? names[q] : "any";
+}
+
+Graph::Pass& Graph::Pass::access(Resource r, Image::Usage u, bool write, bool discard) {
+    for (Access& a : accesses) {
+        if (a.resource == r) throw std::runtime_error("graph: pass " + name + " uses a resource twice");
+    }
+    accesses.push_back({r, u, write, discard});
+    return *this;
+}
+
+Graph::Pass& Graph::Pass::wait(Sync s) {
+    waits.push_back(s);
+    return *this;
+}
+
+Graph::Pass& Graph::Pass::signal(Sync s) {
+    signals.push_back(s);
+    return *this;
+}
+
+Graph::Graph(Device& d, Queue& graphics, Queue* compute, Queue* transfer) : dev(&d) {
+    queues[GRAPHICS] = &graphics;
+    queues[COMPUTE] = compute;
+    queues[TRANSFER] = transfer;
+
+    // one timeline per queue, their batches finish in order
+    for (int q = 0; q < QUEUES; q++) {
+        if (queues[q]) timelines[q] = new Timeline(d);
+    }
+}
+
+Graph::Graph() : dev(nullptr), queues{} {}
+
+Graph::~Graph() {
+    for (Pass* p : passes) delete p;
+    for (Res& r : resources) {
+        if (r.transient) delete r.image;
+    }
+    for (Slot& s : slots) {
+        if (s.memory != VK_NULL_HANDLE) vkFreeMemory(*dev, s.memory, nullptr);
+    }
+    for (Timeline* t : timelines) delete t;
+}
+
+Graph::Resource Graph::import(std::string name, Image* img) {
+    Res r;
+    r.name = name;
+    r.image = img;
+    resources.push_back(r);
+    return resources.size() - 1;
+}
+
+Graph::Resource Graph::transient(std::string name, VkImageCreateInfo info, VkImageViewCreateInfo view) {
+    Res r;
+    r.name = name;
+    r.transient = true;
+    r.info = info;
+    r.info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    r.info.mipLevels = info.mipLevels == 0 ? 1 : info.mipLevels;
+    r.info.arrayLayers = info.arrayLayers == 0 ? 1 : info.arrayLayers;
+    r.view = view;
+    resources.push_back(r);
+    return resources.size() - 1;
+}
+
+void Graph::output(Resource r, Image::Usage u) {
+    resources[r].output = true;
+    resources[r].final = u;
+}
+
+void Graph::bind(Resource r, Image& img) {
+    resources[r].image = &img;
+}
+
+Image& Graph::image(Resource r) {
+    if (!resources[r].image) throw std::runtime_error("graph: " + resources[r].name + " has no image (yet)");
+    return *resources[r].image;
+}
+
+Graph::Pass& Graph::pass(std::string name, std::function<void(CommandBuffer&)> func) {
+    passes.push_back(new Pass(name, func));
+    return *passes.back();
+}
+
+// bytes per texel, for the dry run's estimate
+static VkDeviceSize texelSize(VkFormat f) {
+    switch (f) {
+        case VK_FORMAT_R8_UNORM:
+            return 1;
+        case VK_FORMAT_R16G16B16A16_SFLOAT:
+        case VK_FORMAT_R32G32_SFLOAT:
+            return 8;
+        case VK_FORMAT_R32G32B32A32_SFLOAT:
+            return 16;
+        default:  // rgba8, bgra8, d32, d24s8, r32...
+            return 4;
+    }
+}
+
+VkMemoryRequirements Graph::requirements(Res& r) {
+
+    if (dev) return r.image->requirements();
+
+    // about what a driver would want, tightly packed and 64k aligned
+    VkDeviceSize size = 0;
+    for (uint32_t l = 0; l < r.info.mipLevels; l++) {
+        size += (VkDeviceSize) std::max(1u, r.info.extent.width >> l) * std::max(1u, r.info.extent.height >> l)
+              * std::max(1u, r.info.extent.depth >> l);
+    }
+    size *= r.info.arrayLayers * texelSize(r.info.format);
+
+    const VkDeviceSize align = 65536;
+    return {(size + align - 1) / align * align, align, ~0u};
+}
+
+void Graph::compile() {
+
+    if (compiled) return;
+
+    // what's needed, from the end: a pass that writes something needed is
+    // needed, and then so is everything it reads (and whatever it writes
+    // over, unless it discards it)
+    std::vector<bool> needed(resources.size());
+    for (Resource r = 0; r < resources.size(); r++) needed[r] = resources[r].output;
+
+    for (int p = passes.size() - 1; p >= 0; p--) {
+        Pass& pass = *passes[p];
+
+        bool live = pass.kept;
+        for (Pass::Access& a : pass.accesses) {
+            live |= a.write && needed[a.resource];
+        }
+        pass._culled = !live;
+        if (!live) continue;
+
+        for (Pass::Access& a : pass.accesses) {
+            if (a.write && a.discard) needed[a.resource] = false;
+        }
+        for (Pass::Access& a : pass.accesses) {
+            if (!a.write || !a.discard) needed[a.resource] = true;
+        }
+    }
+
+    // the queues, and the steps (the passes that are left)
+    for (Pass* p : passes) {
+        if (p->_culled) continue;
+
+        QueueType q = TRANSFER;
+        if (p->wanted != ANY) {
+            q = p->wanted;
+        } else if (p->accesses.empty()) {
+            q = GRAPHICS;
+        } else {
+            for (Pass::Access& a : p->accesses) {
+                switch (a.usage) {
+                    case Image::SAMPLED_FRAGMENT:
+                    case Image::COLOR_ATTACHMENT:
+                    case Image::DEPTH_ATTACHMENT:
+                        q = GRAPHICS;
+                        break;
+                    case Image::SAMPLED_COMPUTE:
+                    case Image::STORAGE_READ:
+                    case Image::STORAGE_WRITE:
+                        q = std::min(q, COMPUTE);
+                        break;
+                    default:
+                        break;
+                }
+            }
+        }
+
+        // the graphics queue does everything the others don't
+        if (dev && !queues[q]) q = GRAPHICS;
+        p->_queue = q;
+
+        steps.push_back({p});
+    }
+
+    // the batches: steps in a row on the same queue
+    for (uint32_t s = 0; s < steps.size(); s++) {
+        QueueType q = steps[s].pass->_queue;
+        if (batches.empty() || batches.back().queue != q) {
+            batches.push_back({q});
+            batches.back().number = ++perframe[q];
+        }
+        batches.back().steps.push_back(s);
+        steps[s].pass->_batch = batches.size() - 1;
+    }
+
+    // how long the transients are in use, and where
+    std::vector<uint32_t> families(resources.size());
+    for (uint32_t s = 0; s < steps.size(); s++) {
+        Pass& pass = *steps[s].pass;
+        for (Pass::Access& a : pass.accesses) {
+            Res& r = resources[a.resource];
+            r.first = std::min(r.first, s);
+            r.last = std::max(r.last, s);
+            families[a.resource] |= 1u << (dev ? queues[pass._queue]->getfamily() : pass._queue);
+        }
+    }
+
+    // make them, shared between the families if they're used on more than one
+    // (no ownership transfers then), and see how much memory they want
+    std::vector<Resource> transients;
+    for (Resource r = 0; r < resources.size(); r++) {
+        Res& res = resources[r];
+        if (!res.transient || res.first == UINT32_MAX) continue;
+
+        if (std::popcount(families[r]) > 1) res.info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        if (dev) res.image = new Image(*dev, res.info);
+        res.req = requirements(res);
+        transients.push_back(r);
+    }
+
+    // share memory: biggest first, into the first slot with nothing in use at the same time
+    std::stable_sort(transients.begin(), transients.end(), [&](Resource a, Resource b) {
+        return resources[a].req.size > resources[b].req.size;
+    });
+
+    for (Resource r : transients) {
+        Res& res = resources[r];
+
+        uint32_t s = 0;
+        for (; s < slots.size(); s++) {
+            if (!(slots[s].types & res.req.memoryTypeBits)) continue;
+            bool overlaps = false;
+            for (Resource o : slots[s].resources) {
+                overlaps |= !(resources[o].last < res.first || res.last < resources[o].first);
+            }
+            if (!overlaps) break;
+        }
+        if (s == slots.size()) slots.push_back({});
+
+        Slot& slot = slots[s];
+        slot.size = std::max(slot.size, res.req.size);
+        slot.types &= res.req.memoryTypeBits;
+        slot.resources.push_back(r);
+        res.slot = s;
+    }
+
+    for (Slot& slot : slots) {
+        std::sort(slot.resources.begin(), slot.resources.end(), [&](Resource a, Resource b) {
+            return resources[a].first < resources[b].first;
+        });
+        for (size_t i = 1; i < slot.resources.size(); i++) {
+            resources[slot.resources[i]].before = slot.resources[i - 1];
+        }
+
+        // the next frame's first use waits for this one's last, a semaphore if it's on another queue
+        Batch& first = batches[steps[resources[slot.resources.front()].first].pass->_batch];
+        Batch& last = batches[steps[resources[slot.resources.back()].last].pass->_batch];
+        if (first.queue != last.queue) {
+            first.reuses[last.queue] = std::max(first.reuses[last.queue], last.number);
+        }
+    }
+
+    // the barriers, and what every step has to wait for:
+    // reads wait for the last write, writes also for the reads since then,
+    // and the first use of shared memory for everything its last owner did
+    std::vector<int> writer(resources.size(), -1);
+    std::vector<std::vector<uint32_t>> readers(resources.size()), users(resources.size());
+
+    for (uint32_t s = 0; s < steps.size(); s++) {
+        Step& step = steps[s];
+        Pass& pass = *step.pass;
+        std::vector<uint32_t> deps;
+
+        for (Pass::Access& a : pass.accesses) {
+            Resource r = a.resource;
+            Res& res = resources[r];
+
+            bool first = users[r].empty();
+            step.uses.push_back({nullptr, a.usage, a.discard || (res.transient && first)});
+            step.resources.push_back(r);
+
+            if (!first && steps[users[r].back()].pass->_queue != pass._queue) {
+                step.handoffs.push_back(r);
+            }
+            if (first && res.before != UINT32_MAX) {
+                step.takeovers.push_back(r);
+                for (uint32_t u : users[res.before]) deps.push_back(u);
+            }
+            if (res.output && res.last == s) {
+                step.finals.push_back(r);
+            }
+
+            if (writer[r] >= 0) deps.push_back(writer[r]);
+            if (a.write) {
+                for (uint32_t u : readers[r]) deps.push_back(u);
+                writer[r] = s;
+                readers[r].clear();
+            } else {
+                readers[r].push_back(s);
+            }
+            users[r].push_back(s);
+        }
+
+        // only the ones on other queues need a semaphore, the rest are in submission order
+        Batch& batch = batches[pass._batch];
+        for (uint32_t d : deps) {
+            Batch& other = batches[steps[d].pass->_batch];
+            if (other.queue == batch.queue) continue;
+            batch.waits[other.queue] = std::max(batch.waits[other.queue], other.number);
+        }
+    }
+
+    if (dev) allocate();
+
+    compiled = true;
+}
+
+void Graph::allocate() {
+
+    VkPhysicalDeviceMemoryProperties memProperties;
+    vkGetPhysicalDeviceMemoryProperties(*dev, &memProperties);
+
+    for (Slot& slot : slots) {
+
+        uint32_t i;
+        for (i = 0; i < memProperties.memoryTypeCount; i++) {
+            if (
+                slot.types & (1 << i)
+                && (memProperties.memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT)
+            ) {
+                break;
+            }
+        }
+        if (i == memProperties.memoryTypeCount) throw std::runtime_error("Failed to find device memory");
+
+        VkMemoryAllocateInfo alloc {
+            .sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+            .allocationSize = slot.size,
+            .memoryTypeIndex = i
+        };
+        VK_ASSERT( vkAllocateMemory(*dev, &alloc, nullptr, &slot.memory) );
+
+        for (Resource r : slot.resources) {
+            Res& res = resources[r];
+            res.image->bind(slot.memory);
+            if (res.view.format != VK_FORMAT_UNDEFINED) res.image->view(res.view);
+        }
+    }
+}
+
+std::vector<Sync> Graph::done() const {
+    std::vector<Sync> ret;
+    for (int q = 0; q < QUEUES; q++) {
+        if (timelines[q] && timelines[q]->last()) ret.push_back(timelines[q]->at(timelines[q]->last()));
+    }
+    return ret;
+}
+
+void Graph::execute() {
+
+    compile();
+
+    // where the last frame's batches are on the timelines
+    uint64_t base[QUEUES] {};
+    if (dev) {
+        for (int q = 0; q < QUEUES; q++) {
+            if (timelines[q]) base[q] = timelines[q]->last();
+        }
+
+        // the transients' memory is taken over from the last frame's last user:
+        // on the same queue the barrier waits for what it was doing, on another
+        // one the semaphore does (the batch's reuses)
+        for (Slot& slot : slots) {
+            if (!frames) break;
+            Res& first = resources[slot.resources.front()];
+            Res& last = resources[slot.resources.back()];
+            if (steps[first.first].pass->_queue == steps[last.last].pass->_queue) {
+                first.image->_stages = last.image->_stages;
+                first.image->_writes = last.image->_writes;
+            } else {
+                first.image->_stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+                first.image->_writes = VK_ACCESS_2_NONE;
+            }
+        }
+    } else {
+        printf("[graph] frame %lu\n", frames);
+    }
+
+    for (Batch& batch : batches) {
+
+        std::vector<Sync> waits, signals;
+        for (uint32_t s : batch.steps) {
+            Pass& pass = *steps[s].pass;
+            waits.insert(waits.end(), pass.waits.begin(), pass.waits.end());
+            signals.insert(signals.end(), pass.signals.begin(), pass.signals.end());
+        }
+
+        for (int q = 0; q < QUEUES; q++) {
+            batch.waited[q] = frames && !batch.waits[q] ? batch.reuses[q] : 0;
+        }
+
+        if (!dev) {
+            printf("[graph]   %s batch %lu:", name(batch.queue), batch.number);
+            for (uint32_t s : batch.steps) printf(" %s", steps[s].pass->name.c_str());
+            for (int q = 0; q < QUEUES; q++) {
+                if (batch.waits[q]) printf(", waits for %s batch %lu", name((QueueType) q), batch.waits[q]);
+                if (batch.waited[q]) printf(", waits for the last frame's %s batch %lu",
+                                            name((QueueType) q), batch.waited[q]);
+            }
+            printf(" (+%zu waits, %zu signals outside the graph)\n", waits.size(), signals.size());
+            continue;
+        }
+
+        // (one of this frame's batches on a queue comes after all of the last frame's)
+        for (int q = 0; q < QUEUES; q++) {
+            if (batch.waits[q]) {
+                waits.push_back(timelines[q]->at(base[q] + batch.waits[q]));
+            } else if (batch.waited[q]) {
+                waits.push_back(timelines[q]->at(base[q] - perframe[q] + batch.waited[q]));
+            }
+        }
+        signals.push_back(timelines[batch.queue]->at(timelines[batch.queue]->next()));
+
+        CommandBuffer& cmd = queues[batch.queue]->command() << [&](CommandBuffer& cmd) {
+            for (uint32_t s : batch.steps) {
+                Step& step = steps[s];
+
+                // the semaphore made the other queue's work done and visible, the
+                // barrier just has to come after it
+                for (Resource r : step.handoffs) {
+                    resources[r].image->_stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+                    resources[r].image->_writes = VK_ACCESS_2_NONE;
+                }
+
+                // memory that was some other transient's: on the same queue, the
+                // barrier waits for what that one was doing
+                for (Resource r : step.takeovers) {
+                    Image& img = *resources[r].image;
+                    Res& before = resources[resources[r].before];
+                    if (steps[before.last].pass->_queue == step.pass->_queue) {
+                        img._stages = before.image->_stages;
+                        img._writes = before.image->_writes;
+                    } else {
+                        img._stages = VK_PIPELINE_STAGE_2_ALL_COMMANDS_BIT;
+                        img._writes = VK_ACCESS_2_NONE;
+                    }
+                }
+
+                for (size_t i = 0; i < step.uses.size(); i++) {
+                    step.uses[i].image = &image(step.resources[i]);
+                }
+                cmd.use(step.uses);
+
+                step.pass->record(cmd);
+
+                for (Resource r : step.finals) {
+                    cmd.use(image(r), resources[r].final);
+                }
+            }
+        };
+
+        queues[batch.queue]->submit(cmd, waits, signals);
+    }
+
+    for (Pass* p : passes) {
+        p->waits.clear();
+        p->signals.clear();
+    }
+
+    frames++;
+}
+
+VkDeviceSize Graph::memory() const {
+    VkDeviceSize total = 0;
+    for (const Slot& s : slots) total += s.size;
+    return total;
+}
+
+VkDeviceSize Graph::unaliased() const {
+    VkDeviceSize total = 0;
+    for (const Res& r : resources) {
+        if (r.slot != UINT32_MAX) total += r.req.size;
+    }
+    return total;
+}
+
+void Graph::describe(FILE* out) const {
+
+    size_t culled = 0;
+    for (Pass* p : passes) culled += p->_culled;
+
+    fprintf(out, "[graph] %zu passes (%zu culled) in %zu batches, transients: %.1f MB in %zu slots (%.1f MB unaliased)%s\n",
+            passes.size(), culled, batches.size(), memory() / 1e6, slots.size(), unaliased() / 1e6,
+            dev ? "" : ", dry run");
+
+    for (Pass* p : passes) {
+        if (p->_culled) {
+            fprintf(out, "[graph]   %-12s culled\n", p->name.c_str());
+            continue;
+        }
+        fprintf(out, "[graph]   %-12s %s batch %lu\n", p->name.c_str(), name(p->_queue), batches[p->_batch].number);
+        for (const Pass::Access& a : p->accesses) {
+            const Res& r = resources[a.resource];
+            fprintf(out, "[graph]     %s %-14s %s%s%s\n", a.write ? "write" : "read ", r.name.c_str(),
+                    usageNames[a.usage], a.discard ? ", discard" : "", r.transient ? ", transient" : "");
+        }
+    }
+
+    for (const Batch& b : batches) {
+        for (int q = 0; q < QUEUES; q++) {
+            if (b.waits[q]) fprintf(out, "[graph]   %s batch %lu waits for %s batch %lu\n",
+                                    name(b.queue), b.number, name((QueueType) q), b.waits[q]);
+            if (b.reuses[q]) fprintf(out, "[graph]   %s batch %lu waits for the last frame's %s batch %lu\n",
+                                     name(b.queue), b.number, name((QueueType) q), b.reuses[q]);
+        }
+    }
+
+    for (size_t s = 0; s < slots.size(); s++) {
+        fprintf(out, "[graph]   slot %zu: %.1f MB,", s, slots[s].size / 1e6);
+        for (Resource r : slots[s].resources) {
+            fprintf(out, " %s (steps %u-%u)", resources[r].name.c_str(), resources[r].first, resources[r].last);
+        }
+        fprintf(out, "\n");
+    }
+}
+
+};
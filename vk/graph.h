@@ -0,0 +1,223 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include "vklib.h"
+#include <functional>
+
+namespace vk {
+
+class Device;
+class Queue;
+class Image;
+class CommandBuffer;
+class Timeline;
+struct Sync;
+
+// A render graph for the frame.
+//
+// Passes say which images they read and write, and how (as an Image::Usage),
+// and compile() works out the rest:
+//  - passes whose results nobody reads are culled. what's needed is what's
+//    output(), and anything a pass marked keep() writes
+//  - every pass goes on the least capable queue that can do it: attachments or
+//    fragment sampling -> graphics, storage or compute sampling -> compute,
+//    only copies -> transfer. (on() overrides that)
+//  - passes stay in the order they were added. the ones in a row on the same
+//    queue are recorded into one command buffer, and a batch waits (on the other
+//    queue's timeline) for the batches on other queues it depends on
+//  - transient images (made by the graph, their contents only live during a
+//    frame) that are never in use at the same time share memory
+//
+// The barriers are CommandBuffer::use() with what the pass declared, which is
+// recorded before the pass's own commands.
+//
+// It's built and compiled once, and executed every frame. Imported images that
+// change (the swapchain image) are bind()'d before each execute(), and so are
+// the frame's waits and signals on semaphores outside the graph (wait()/signal()).
+//
+// Made without a device it's a dry run: nothing is created or recorded,
+// transients get a size estimated from their format, and execute() prints what
+// it would submit. The compiled plan (culled(), queue(), batch(), slot()) can be
+// checked the same with or without a gpu.
+class Graph {
+public:
+
+    using Resource = uint32_t;
+
+    enum QueueType {GRAPHICS, COMPUTE, TRANSFER, QUEUES, ANY = QUEUES};
+
+    class Pass {
+
+        friend class Graph;
+
+        struct Access {
+            Resource resource;
+            Image::Usage usage;
+            bool write;
+            bool discard;
+        };
+
+        std::string name;
+        std::function<void(CommandBuffer&)> record;
+        std::vector<Access> accesses;
+        QueueType wanted = ANY;
+        bool kept = false;
+
+        // this frame's, cleared by execute()
+        std::vector<Sync> waits, signals;
+
+        // compiled
+        bool _culled = false;
+        QueueType _queue = GRAPHICS;
+        uint32_t _batch = 0;
+
+        Pass(std::string n, std::function<void(CommandBuffer&)> r) : name(n), record(r) {}
+        Pass& access(Resource, Image::Usage, bool write, bool discard);
+
+    public:
+
+        // what the pass does with an image. write() keeps the old contents
+        // unless discard is set (eg. it's cleared, or fully overwritten)
+        Pass& read(Resource r, Image::Usage u) {return access(r, u, false, false);}
+        Pass& write(Resource r, Image::Usage u, bool discard = false) {return access(r, u, true, discard);}
+
+        // run it on a given queue, instead of the one its usages pick
+        Pass& on(QueueType q) {wanted = q; return *this;}
+
+        // never cull it (eg. it writes something the cpu reads)
+        Pass& keep() {kept = true; return *this;}
+
+        // for this frame's submit of the pass's batch
+        Pass& wait(Sync);
+        Pass& signal(Sync);
+
+        // where it ended up. the batch is the index in the frame's submits
+        bool culled() const {return _culled;}
+        QueueType queue() const {return _queue;}
+        uint32_t batch() const {return _batch;}
+    };
+
+private:
+
+    Device* dev;  // nullptr for a dry run
+    Queue* queues[QUEUES];
+    Timeline* timelines[QUEUES] {};
+
+    struct Res {
+        std::string name;
+        Image* image = nullptr;
+        bool transient = false;
+        VkImageCreateInfo info {};
+        VkImageViewCreateInfo view {};
+        bool output = false;
+        Image::Usage final = Image::PRESENT;
+
+        // compiled (for transients)
+        uint32_t first = UINT32_MAX, last = 0;  // steps it's used in
+        uint32_t slot = UINT32_MAX;
+        Resource before = UINT32_MAX;  // the one that had the memory before it this frame
+        VkMemoryRequirements req {};
+    };
+
+    // a pass that wasn't culled, in order
+    struct Step {
+        Pass* pass;
+        std::vector<Image::Use> uses;       // filled in with the images when executed
+        std::vector<Resource> resources;    // what uses[i] is for
+        std::vector<Resource> handoffs;     // used on another queue before, the semaphore covers it
+        std::vector<Resource> takeovers;    // first use of memory a transient had earlier in the frame
+        std::vector<Resource> finals;       // output()s last used here
+    };
+
+    // steps in a row on one queue, one command buffer and submit
+    struct Batch {
+        QueueType queue;
+        std::vector<uint32_t> steps;
+        uint64_t waits[QUEUES] {};   // the batch (by its number on that queue) to wait for, 0 for none
+        uint64_t reuses[QUEUES] {};  // the same, of the last frame, whose transients' memory it reuses
+        uint64_t waited[QUEUES] {};  // the last frame's batches the last execute() waited for
+        uint64_t number;             // counted per queue, from 1
+    };
+
+    // memory shared by transients
+    struct Slot {
+        VkDeviceSize size = 0;
+        uint32_t types = ~0u;
+        std::vector<Resource> resources;
+        VkDeviceMemory memory = VK_NULL_HANDLE;
+    };
+
+    std::vector<Res> resources;
+    std::vector<Pass*> passes;
+
+    std::vector<Step> steps;
+    std::vector<Batch> batches;
+    std::vector<Slot> slots;
+    uint64_t perframe[QUEUES] {};  // batches on each queue
+    uint64_t frames = 0;           // executed so far
+    bool compiled = false;
+
+    VkMemoryRequirements requirements(Res&);
+    void allocate();
+
+public:
+
+    // graphics is used for whatever queue isn't given
+    Graph(Device&, Queue& graphics, Queue* compute = nullptr, Queue* transfer = nullptr);
+
+    // a dry run
+    Graph();
+
+    ~Graph();
+
+    // an image made elsewhere (nullptr, to bind() it later)
+    Resource import(std::string name, Image* = nullptr);
+
+    // an image made by the graph. its view, if any, is made with the image
+    // (the create infos are filled in like Image() and Image::view() do)
+    Resource transient(std::string name, VkImageCreateInfo, VkImageViewCreateInfo = {});
+
+    // the frame's results, and what they're left as when they're done with
+    void output(Resource, Image::Usage);
+
+    // swaps the image behind an imported resource
+    void bind(Resource, Image&);
+
+    // the image behind a resource. transients only exist once compiled
+    Image& image(Resource);
+
+    // a pass, recorded by func on its queue's command buffer
+    Pass& pass(std::string name, std::function<void(CommandBuffer&)> func);
+
+    // culls, schedules and aliases, and makes the transients. once, before execute()
+    void compile();
+
+    // records and submits every pass, in batches. doesn't wait on the cpu: the
+    // first use of a transient's memory waits on the gpu for the last frame's
+    // last use of it (on another queue with its semaphore, on the same one with
+    // the barrier). the queues' command buffers are a ring, so the caller still
+    // has to keep within a frame or two of the gpu
+    void execute();
+
+    // where the last execute()'s batches are done, on every queue it used
+    std::vector<Sync> done() const;
+
+    // memory used by the transients (and what it'd take without sharing)
+    VkDeviceSize memory() const;
+    VkDeviceSize unaliased() const;
+
+    // which shared memory a transient is in, the ones with the same are aliased
+    uint32_t slot(Resource r) const {return resources[r].slot;}
+
+    // which of the last frame's batches on a queue the pass's batch waited for
+    // in the last execute() (its number on that queue, 0 for none)
+    uint64_t waited(const Pass& p, QueueType q) const {return batches[p._batch].waited[q];}
+
+    // prints the compiled plan
+    void describe(FILE*) const;
+
+    static const char* name(QueueType);
+};
+
+};
+#endif
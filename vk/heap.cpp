@@ -0,0 +1,184 @@
+#include "heap.h"
+
+namespace vk {
+
+Heap::Heap(Device& d, uint32_t cap) : device(d), capacity(cap) {
+
+    VkDescriptorSetLayoutBinding bindings[KINDS] {
+        {.binding = SAMPLED, .descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+         .descriptorCount = capacity, .stageFlags = VK_SHADER_STAGE_ALL},
+        {.binding = STORAGE_IMAGE, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+         .descriptorCount = capacity, .stageFlags = VK_SHADER_STAGE_ALL},
+        {.binding = STORAGE_BUFFER, .descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+         .descriptorCount = capacity, .stageFlags = VK_SHADER_STAGE_ALL},
+    };
+
+    // written while in use (just not the entries that are), and not all of them valid
+    const VkDescriptorBindingFlags common =
+        VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+        VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+        VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+    VkDescriptorBindingFlags flags[KINDS] {
+        common, common, common | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT
+    };
+
+    VkDescriptorSetLayoutBindingFlagsCreateInfo flags_info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
+        .bindingCount = KINDS,
+        .pBindingFlags = flags,
+    };
+
+    VkDescriptorSetLayoutCreateInfo layout_info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+        .pNext = &flags_info,
+        .flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
+        .bindingCount = KINDS,
+        .pBindings = bindings,
+    };
+
+    // (from the cache, so the pipeline layouts made with it can be shared)
+    _layout = device.cache().setLayout(layout_info);
+
+    VkDescriptorPoolSize sizes[KINDS] {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, capacity},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, capacity},
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, capacity},
+    };
+
+    VkDescriptorPoolCreateInfo pool_info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+        .flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
+        .maxSets = 1,
+        .poolSizeCount = KINDS,
+        .pPoolSizes = sizes,
+    };
+
+    VK_ASSERT( vkCreateDescriptorPool(device, &pool_info, nullptr, &pool) );
+
+    VkDescriptorSetVariableDescriptorCountAllocateInfo count_info {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO,
+        .descriptorSetCount = 1,
+        .pDescriptorCounts = &capacity,
+    };
+
+    VkDescriptorSetAllocateInfo alloc {
+        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+        .pNext = &count_info,
+        .descriptorPool = pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts = &_layout,
+    };
+
+    VK_ASSERT( vkAllocateDescriptorSets(device, &alloc, &_set) );
+}
+
+Heap::~Heap() {
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    device.cache().release(_layout);
+}
+
+// the index of handle, a new one if it wasn't added yet
+uint32_t Heap::insert(Kind k, uint64_t handle, bool& added) {
+
+    auto it = indices.find({k, handle});
+    added = it == indices.end();
+    if (!added) return it->second;
+
+    uint32_t i;
+    if (!freed[k].empty()) {
+        i = freed[k].back();
+        freed[k].pop_back();
+    } else if (used[k] < capacity) {
+        i = used[k]++;
+    } else {
+        throw std::runtime_error("descriptor heap is full");
+    }
+
+    indices[{k, handle}] = i;
+    return i;
+}
+
+void Heap::write(Kind k, uint32_t i, VkDescriptorImageInfo* image, VkDescriptorBufferInfo* buffer) {
+
+    static const VkDescriptorType types[KINDS] {
+        VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+    };
+
+    VkWriteDescriptorSet write {
+        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+        .dstSet = _set,
+        .dstBinding = (uint32_t) k,
+        .dstArrayElement = i,
+        .descriptorCount = 1,
+        .descriptorType = types[k],
+        .pImageInfo = image,
+        .pBufferInfo = buffer,
+    };
+
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+}
+
+uint32_t Heap::add(Image& image) {
+
+    VkImageView view = image;
+    bool added;
+    uint32_t i = insert(SAMPLED, (uint64_t) view, added);
+    if (!added) return i;
+
+    VkDescriptorImageInfo info {
+        .sampler = image.sampler(),
+        .imageView = view,
+        .imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+    };
+    write(SAMPLED, i, &info, nullptr);
+    return i;
+}
+
+uint32_t Heap::add(Image& image, uint32_t level) {
+
+    VkImageView view = level == ~0u ? (VkImageView) image : image.level(level);
+    bool added;
+    uint32_t i = insert(STORAGE_IMAGE, (uint64_t) view, added);
+    if (!added) return i;
+
+    VkDescriptorImageInfo info {
+        .imageView = view,
+        .imageLayout = VK_IMAGE_LAYOUT_GENERAL,
+    };
+    write(STORAGE_IMAGE, i, &info, nullptr);
+    return i;
+}
+
+uint32_t Heap::add(Buffer& buffer) {
+
+    bool added;
+    uint32_t i = insert(STORAGE_BUFFER, (uint64_t) (VkBuffer) buffer, added);
+    if (!added) return i;
+
+    VkDescriptorBufferInfo info {
+        .buffer = buffer,
+        .offset = 0,
+        .range = VK_WHOLE_SIZE,
+    };
+    write(STORAGE_BUFFER, i, nullptr, &info);
+    return i;
+}
+
+void Heap::remove(Kind k, uint32_t i) {
+    for (auto it = indices.begin(); it != indices.end(); it++) {
+        if (it->first.first == k && it->second == i) {
+            indices.erase(it);
+            freed[k].push_back(i);
+            return;
+        }
+    }
+}
+
+std::string Heap::glsl(uint32_t set) {
+    std::string s = std::to_string(set);
+    return "#extension GL_EXT_nonuniform_qualifier : require\n"
+           "layout (set = " + s + ", binding = " + std::to_string(SAMPLED) + ") uniform sampler2D heap_tex2d[];\n"
+           "layout (set = " + s + ", binding = " + std::to_string(SAMPLED) + ") uniform samplerCube heap_cube[];\n";
+}
+
+};
@@ -0,0 +1,82 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "vklib.h"
+#include <map>
+
+namespace vk {
+
+class Device;
+class Image;
+class Buffer;
+
+// A bindless descriptor heap, one descriptor set shared by every pipeline
+// made with it (see Pipeline::Graphics), bound at the set after the pipeline's own.
+//
+// Images and buffers are added once and keep their index until they're
+// removed. Shaders get the indices as push constants and index the arrays
+// glsl() declares. Adding the same image (view) or buffer again hands out the
+// same index, so it's fine to add() every frame.
+//
+// The set is update-after-bind and partially bound: descriptors can be added
+// while command buffers using the set are in flight, as long as those don't
+// use the new ones, and the unused entries don't need to be valid.
+class Heap {
+public:
+
+    // the bindings, one array of each
+    enum Kind {
+        SAMPLED,         // combined image samplers
+        STORAGE_IMAGE,
+        STORAGE_BUFFER,  // the last one, its size is the variable count
+        KINDS
+    };
+
+private:
+
+    Device& device;
+    uint32_t capacity;
+
+    VkDescriptorSetLayout _layout;
+    VkDescriptorPool pool;
+    VkDescriptorSet _set;
+
+    std::map<std::pair<Kind, uint64_t>, uint32_t> indices;  // the index of every view/buffer added
+    std::vector<uint32_t> freed[KINDS];
+    uint32_t used[KINDS] {};
+
+    uint32_t insert(Kind, uint64_t handle, bool& added);
+    void write(Kind, uint32_t, VkDescriptorImageInfo*, VkDescriptorBufferInfo*);
+
+public:
+
+    // capacity is the size of every array
+    Heap(Device&, uint32_t capacity = 1024);
+    ~Heap();
+
+    // a sampled image (all its levels, with its sampler)
+    uint32_t add(Image&);
+
+    // a storage image, one level of it (~0 for the image's own view)
+    uint32_t add(Image&, uint32_t level);
+
+    // a storage buffer (all of it)
+    uint32_t add(Buffer&);
+
+    // frees an index, for the next add(). the caller makes sure nothing in flight uses it
+    void remove(Kind, uint32_t);
+
+    // how many are in use
+    uint32_t count(Kind k) const {return used[k] - freed[k].size();}
+
+    VkDescriptorSetLayout layout() const {return _layout;}
+    VkDescriptorSet set() const {return _set;}
+
+    // the glsl declarations of the arrays, for a shader that has the heap at set.
+    // sampled images are heap_tex2d[] and heap_cube[] (both the same binding),
+    // storage buffers are at binding STORAGE_BUFFER, their block depends on the shader
+    static std::string glsl(uint32_t set);
+};
+
+};
+#endif
@@ -1,25 +1,11 @@
-#include "image.h"
+#include "vklib.h"  // not image.h first, commandbuffer.h needs the whole of Image
 
 namespace vk {
 
-Image::Image (Device& d, VkImageCreateInfo info, VkMemoryPropertyFlags memflags) : device(d) {
-
-    // all the parameters that need to be default
-    info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
-    info.mipLevels = 1;
-    info.arrayLayers = 1;
-    info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    info.samples = VK_SAMPLE_COUNT_1_BIT;
-
-    // only the graphics queue needs to access this, so we're chilling
-    info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-
-    VK_ASSERT( vkCreateImage(device, &info, nullptr, &image) );
+Image::Image (Device& d, VkImageCreateInfo info, VkMemoryPropertyFlags memflags) : Image(d, info) {
 
     // now allocate memory
-    VkMemoryRequirements memRequirements;
-    vkGetImageMemoryRequirements(device, image, &memRequirements);
-
+    VkMemoryRequirements memRequirements = requirements();
 
     VkPhysicalDeviceMemoryProperties memProperties;
     vkGetPhysicalDeviceMemoryProperties(device, &memProperties);
@@ -50,6 +36,42 @@ found_heap_index:
     vkBindImageMemory(device, image, mem, 0);
 }
 
+Image::Image (Device& d, VkImageCreateInfo info) : device(d) {
+
+    // all the parameters that need to be default
+    info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    info.mipLevels = info.mipLevels == 0 ? 1 : info.mipLevels;
+    info.arrayLayers = info.arrayLayers == 0 ? 1 : info.arrayLayers;
+    info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    info.samples = VK_SAMPLE_COUNT_1_BIT;
+
+    // only the graphics queue needs to access this, so we're chilling
+    // (unless asked to be shared between all queue families, like buffers are)
+    if (info.sharingMode == VK_SHARING_MODE_CONCURRENT && d.getqfs().size() > 1) {
+        info.queueFamilyIndexCount = (uint32_t) d.getqfs().size();
+        info.pQueueFamilyIndices = d.getqfs().data();
+    } else {
+        info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    }
+
+    VK_ASSERT( vkCreateImage(device, &info, nullptr, &image) );
+
+    format = info.format;
+    _extent = info.extent;
+    levels = info.mipLevels;
+    layers = info.arrayLayers;
+}
+
+VkMemoryRequirements Image::requirements() {
+    VkMemoryRequirements req;
+    vkGetImageMemoryRequirements(device, image, &req);
+    return req;
+}
+
+void Image::bind(VkDeviceMemory m, VkDeviceSize offset) {
+    VK_ASSERT( vkBindImageMemory(device, image, m, offset) );
+}
+
 VkSampler Image::sampler() {
 
     if (_sampler != VK_NULL_HANDLE) {
@@ -60,11 +82,14 @@ VkSampler Image::sampler() {
         .sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
         .magFilter = VK_FILTER_LINEAR,
         .minFilter = VK_FILTER_LINEAR,
+        .mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR,
         .addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
         .addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
         .addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE,
         .anisotropyEnable = VK_FALSE,
         .compareEnable = VK_FALSE,
+        .minLod = 0.f,
+        .maxLod = (float) levels,  // all of them, if there are any
         .unnormalizedCoordinates = VK_FALSE,
     };
 
@@ -105,13 +130,50 @@ void Image::view (VkImageViewCreateInfo v, bool keep_prev) {
     VK_ASSERT( vkCreateImageView(device, &v, nullptr, &imview) );
 }
 
+VkImageView Image::level(uint32_t l) {
+
+    if (levelviews.empty()) {
+        levelviews.resize(levels, VK_NULL_HANDLE);
+    }
+
+    if (levelviews[l] != VK_NULL_HANDLE) {
+        return levelviews[l];
+    }
+
+    VkImageViewCreateInfo v {
+        .sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
+        .image = image,
+        .viewType = layers > 1 ? VK_IMAGE_VIEW_TYPE_2D_ARRAY : VK_IMAGE_VIEW_TYPE_2D,
+        .format = format,
+        .subresourceRange = {
+            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+            .baseMipLevel = l,
+            .levelCount = 1,
+            .baseArrayLayer = 0,
+            .layerCount = layers
+        }
+    };
+
+    VK_ASSERT( vkCreateImageView(device, &v, nullptr, &levelviews[l]) );
+
+    return levelviews[l];
+}
+
 Image::~Image () {
     if (imview != VK_NULL_HANDLE) {
         vkDestroyImageView((VkDevice) device, imview, nullptr);
     }
+    for (VkImageView v : levelviews) {
+        if (v != VK_NULL_HANDLE) vkDestroyImageView((VkDevice) device, v, nullptr);
+    }
+    if (_sampler != VK_NULL_HANDLE) {
+        vkDestroySampler((VkDevice) device, _sampler, nullptr);
+    }
     // printf("[DEBUG] is it owner? %d\n", owner);
-    if (mem != VK_NULL_HANDLE) {
+    if (owned) {
         vkDestroyImage(device, image, nullptr);
+    }
+    if (mem != VK_NULL_HANDLE) {
         vkFreeMemory(device, mem, nullptr);
     }
 }
@@ -6,31 +6,83 @@
 namespace vk {
 
 class Device;
+class CommandBuffer;
+class Graph;
 
 // Represents a VkImage.
 // Currently wraps a VkImage, and allows a
 // VkImageView to ve created from it.
+// Also keeps track of the layout it's in and how it was last used, as of the
+// last command recorded with it, for CommandBuffer::use().
 class Image {
 
     Device& device;
     VkImage image;
     VkImageView imview = VK_NULL_HANDLE;
     VkDeviceMemory mem = VK_NULL_HANDLE;
+    bool owned = true;  // destroyed with the wrapper (not for the swapchain's)
 
     VkSampler _sampler = VK_NULL_HANDLE;
 
     void* _mapped_ptr = nullptr;
     uint32_t memsize;
+
+    // what it was created with (1 level, 1 layer for wrapped images)
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent3D _extent {0, 0, 0};
+    uint32_t levels = 1;
+    uint32_t layers = 1;
+
+    // single mip level views, made on demand by level()
+    std::vector<VkImageView> levelviews;
+
+    // the tracked state, see CommandBuffer::use()
+    // (the graph moves it along when an image changes queues, see Graph::execute())
+    friend class CommandBuffer;
+    friend class Graph;
+    VkImageLayout _layout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkPipelineStageFlags2 _stages = VK_PIPELINE_STAGE_2_NONE;  // used by since the last barrier
+    VkAccessFlags2 _writes = VK_ACCESS_2_NONE;                 // not made visible by a barrier yet
 public:
+
+    // what an image is going to be used for, see CommandBuffer::use()
+    enum Usage {
+        SAMPLED_FRAGMENT,  // sampled by fragment shaders
+        SAMPLED_COMPUTE,   // sampled by compute shaders
+        STORAGE_READ,      // storage image, read by compute
+        STORAGE_WRITE,     // storage image, read and written by compute
+        COLOR_ATTACHMENT,
+        DEPTH_ATTACHMENT,
+        TRANSFER_SRC,
+        TRANSFER_DST,
+        PRESENT,
+    };
+
+    // a use of an image, for the batched CommandBuffer::use()
+    struct Use {
+        Image* image;
+        Usage usage;
+        bool discard = false;  // the old contents aren't needed
+    };
     
     // wrap an existsing image
     Image(Device& d, VkImage _) : device(d), image(_), mem(VK_NULL_HANDLE) {
         mem = VK_NULL_HANDLE;
+        owned = false;
     }
 
     // create a new image
+    // (mipLevels and arrayLayers default to 1 if left at 0)
     Image(Device& d, VkImageCreateInfo, VkMemoryPropertyFlags);
 
+    // create a new image without memory, it needs bind() before it can be used
+    // (eg. to put it into memory shared with other images, see Graph)
+    Image(Device& d, VkImageCreateInfo);
+
+    // the memory it needs, and binding it to (a part of) some memory owned by someone else
+    VkMemoryRequirements requirements();
+    void bind(VkDeviceMemory, VkDeviceSize offset = 0);
+
     // create a sampler
     VkSampler sampler();
 
@@ -46,6 +98,28 @@ public:
     void view(VkImageViewCreateInfo);
     void view(VkImageViewCreateInfo, bool);
 
+    // a 2D view of just one mip level, eg. to write it as a storage image
+    // (2D array, of all the layers, if there's more than one, eg. a cube's faces)
+    VkImageView level(uint32_t);
+
+    // the layout as of the last command recorded with it
+    VkImageLayout layout() const {return _layout;}
+
+    // what the next use() waits for, when that isn't what was recorded last:
+    // a recording that's submitted again and again after other work, or one on
+    // a queue that doesn't have the stages the image was last used at
+    void assume(VkPipelineStageFlags2 stages, VkAccessFlags2 writes = VK_ACCESS_2_NONE) {
+        _stages = stages;
+        _writes = writes;
+    }
+
+    uint32_t mipLevels() {return levels;}
+    uint32_t arrayLayers() {return layers;}
+    VkExtent3D extent() {return _extent;}
+    VkExtent3D extent(uint32_t level) {
+        return {std::max(1u, _extent.width >> level), std::max(1u, _extent.height >> level), std::max(1u, _extent.depth >> level)};
+    }
+
     operator VkImage() {return image;}
     operator VkImageView() {return imview;}
 };
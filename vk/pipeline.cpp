@@ -1,7 +1,19 @@
 #include "pipeline.h"
+#include <chrono>
 
 namespace vk {
 
+static Pipeline::DescriptorStats stats;
+
+static int64_t now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Pipeline::DescriptorStats Pipeline::descriptorStats() {
+    return stats;
+}
+
 // helper function used by the factory function / named constructor
 void Pipeline::init_graphics (
     std::vector<std::vector<VkDescriptorSetLayoutBinding>> descriptorsets,
@@ -10,6 +22,9 @@ void Pipeline::init_graphics (
     RenderPass& pass, ShaderModule& frag
 ) {
 
+    // without push descriptors set 0 is allocated like the rest
+    push = push && device.pushDescriptors();
+
     // use default values for the states
 
     std::vector<VkDynamicState> dynamicStates = {
@@ -87,6 +102,7 @@ void Pipeline::init_graphics (
         .stage = VK_SHADER_STAGE_VERTEX_BIT,
         .module = (VkShaderModule) vert,
         .pName = "main",
+        .pSpecializationInfo = spec,
     };
 
     VkPipelineShaderStageCreateInfo frag_st {
@@ -94,6 +110,7 @@ void Pipeline::init_graphics (
         .stage = VK_SHADER_STAGE_FRAGMENT_BIT,
         .module = (VkShaderModule) frag,
         .pName = "main",
+        .pSpecializationInfo = spec,
     };
 
     VkPipelineShaderStageCreateInfo shaderStages[] = {vert_st, frag_st};
@@ -114,16 +131,17 @@ void Pipeline::init_graphics (
 
             binding++;
         }
+        bindings.push_back(descriptors);
 
+        // a pushed set 0 is never allocated, it's recorded into the command buffer
         VkDescriptorSetLayoutCreateInfo descset_info {
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .flags = push && desc_layouts.empty() ? (VkDescriptorSetLayoutCreateFlags) VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0u,
             .bindingCount = (uint32_t) descriptors.size(),
             .pBindings = descriptors.data(),
         };
 
-        VkDescriptorSetLayout desc_layout;
-        VK_ASSERT( vkCreateDescriptorSetLayout(device, &descset_info, nullptr, &desc_layout) );
-        desc_layouts.push_back(desc_layout);
+        desc_layouts.push_back(device.cache().setLayout(descset_info));
     }
 
     // now create all the pushconstants
@@ -134,15 +152,19 @@ void Pipeline::init_graphics (
         curroff += pkr.size;
     }
 
+    // the heap's set is the pipeline's, but not its to destroy
+    std::vector<VkDescriptorSetLayout> setlayouts = desc_layouts;
+    if (heap) setlayouts.push_back(heap->layout());
+
     VkPipelineLayoutCreateInfo pipelineLayoutInfo {
         .sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-        .setLayoutCount = (uint32_t) desc_layouts.size(),
-        .pSetLayouts = desc_layouts.data(),
+        .setLayoutCount = (uint32_t) setlayouts.size(),
+        .pSetLayouts = setlayouts.data(),
         .pushConstantRangeCount = (uint32_t) pushconst.size(),
         .pPushConstantRanges = pushconst.data()
     };
 
-    VK_ASSERT( vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) );
+    pipelineLayout = device.cache().pipelineLayout(pipelineLayoutInfo);
 
     // the part where you add vertex inputs
     // Note: we do this for every entry of the set vertexinputbindings
@@ -216,109 +238,223 @@ void Pipeline::init_graphics (
         .subpass = 0
     };
 
-    vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline);
+    // (the same as one that's still around, if only the name was different)
+    pipeline = device.cache().graphics(pipelineInfo);
 
     // we're not done yet, gotta create descriptor-resources
+    init_templates();
 
-    // we'll need a pool-size for each type of descriptor.
+    // ok now we're done for real
+}
 
-    std::vector<VkDescriptorPoolSize> poolsizes;
+Pipeline& Pipeline::Graphics(Device& d, ShaderModule& v, RenderPass& r, ShaderModule& f,
+                             Heap* heap, bool push, const VkSpecializationInfo* spec) {
+    Reflection refl = v.reflection();
+    refl.merge(f.reflection());
+    return Graphics(d, refl.sets(heap != nullptr), refl.pushconstants, vertexinput(refl), v, r, f, heap, push, spec);
+}
 
-    for (const auto& descriptors : descriptorsets) {
-        for (VkDescriptorSetLayoutBinding i: descriptors) {
-            poolsizes.push_back({
-                .type = i.descriptorType,
-                .descriptorCount = _p_res_count * 2 // allocate _p_res_count of each -- double of the default (_p_res_count) seems to work
-            });
+Pipeline& Pipeline::Compute(Device& d, ShaderModule& c, bool push, const VkSpecializationInfo* spec) {
+    return Compute(d, c.reflection().sets(), c.reflection().pushconstants, c, push, spec);
+}
+
+std::vector<VertexInputBinding> Pipeline::vertexinput(const Reflection& refl) {
+
+    if (refl.inputs.empty()) return {};
+
+    VertexInputBinding bind {.stride = 0, .rate = VK_VERTEX_INPUT_RATE_VERTEX};
+    for (uint32_t i = 0; i < refl.inputs.size(); i++) {
+        // (init_graphics numbers them in order)
+        if (refl.inputs[i].location != i) {
+            throw std::runtime_error("there's no vertex input at location " + std::to_string(i));
         }
+        bind.attr.push_back({.format = refl.inputs[i].format, .offset = bind.stride});
+        bind.stride += refl.inputs[i].size;
     }
+    return {bind};
+}
 
-    VkDescriptorPoolCreateInfo poolInfo {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .maxSets = (uint32_t) descriptorsets.size() * _p_res_count,
-        .poolSizeCount = (uint32_t) poolsizes.size(),
-        .pPoolSizes = poolsizes.data(),
-    };
+std::vector<VkDescriptorSet> Pipeline::_getdescset() {
+    flush();
 
-    VK_ASSERT( vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) );
-
-    // allocate the desc sets now
-    // allocate _p_res_count descriptor sets to cycle through
-    descsets.resize(descriptorsets.size());
-    for (int i = 0; i < descriptorsets.size(); i++) {
-        std::vector<VkDescriptorSetLayout> layouts(_p_res_count, desc_layouts[i]);
-        VkDescriptorSetAllocateInfo allocInfo {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-            .descriptorPool = descriptorPool,
-            .descriptorSetCount = _p_res_count,
-            .pSetLayouts = layouts.data(),
-        };
+    std::vector<VkDescriptorSet> ret;
+    for (int i = push ? 1 : 0; i < desc_layouts.size(); i++) {
+        ret.push_back(descsets[i]);
+    }
+    if (heap) ret.push_back(heap->set());
+    return ret;
+}
 
-        descsets[i].resize(_p_res_count);
-        VK_ASSERT( vkAllocateDescriptorSets(device, &allocInfo, descsets[i].data()) );
+// a template for each set, that writes all of its bindings from an array
+// of DescriptorInfo. (not for arrays of descriptors, only the first element
+// of those is ever written)
+void Pipeline::init_templates() {
+
+    templates.resize(bindings.size(), VK_NULL_HANDLE);
+    descinfos.resize(bindings.size());
+    written.assign(bindings.size(), 0);
+    dirty.assign(bindings.size(), 0);
+    descsets.assign(bindings.size(), VK_NULL_HANDLE);
+    setframes.assign(bindings.size(), 0);
+
+    for (uint32_t set = 0; set < bindings.size(); set++) {
+
+        descinfos[set].resize(bindings[set].size());
+
+        if (bindings[set].empty() || bindings[set].size() > 64) continue;
+
+        std::vector<VkDescriptorUpdateTemplateEntry> entries;
+        for (const VkDescriptorSetLayoutBinding& b : bindings[set]) {
+            if (b.descriptorCount != 1) break;
+            entries.push_back({
+                .dstBinding = b.binding,
+                .dstArrayElement = 0,
+                .descriptorCount = 1,
+                .descriptorType = b.descriptorType,
+                .offset = b.binding * sizeof(DescriptorInfo),
+                .stride = sizeof(DescriptorInfo),
+            });
+        }
+        if (entries.size() != bindings[set].size()) continue;
+
+        VkDescriptorUpdateTemplateCreateInfo info {
+            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_UPDATE_TEMPLATE_CREATE_INFO,
+            .descriptorUpdateEntryCount = (uint32_t) entries.size(),
+            .pDescriptorUpdateEntries = entries.data(),
+            .templateType = push && set == 0 ?
+                VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_PUSH_DESCRIPTORS_KHR : VK_DESCRIPTOR_UPDATE_TEMPLATE_TYPE_DESCRIPTOR_SET,
+            .descriptorSetLayout = desc_layouts[set],
+            .pipelineBindPoint = type,
+            .pipelineLayout = pipelineLayout,
+            .set = set,
+        };
+        VK_ASSERT( vkCreateDescriptorUpdateTemplate(device, &info, nullptr, &templates[set]) );
     }
+}
 
-    // ok now we're done for real
+// where a write to binding goes, marks it for flush()
+Pipeline::DescriptorInfo& Pipeline::stage(uint32_t set, uint32_t binding) {
+    dirty[set] |= 1ull << binding;
+    written[set] |= 1ull << binding;
+    stats.writes++;
+
+    return descinfos[set][binding];
 }
 
-void Pipeline::descriptorSet(uint32_t set) {
-    // just move the index over
+// the VkWriteDescriptorSets of the staged bindings in mask, onto writes
+void Pipeline::writesof(uint32_t set, uint64_t mask, VkDescriptorSet dst, std::vector<VkWriteDescriptorSet>& writes) {
+    std::vector<DescriptorInfo>& infos = descinfos[set];
+
+    for (uint32_t b = 0; b < bindings[set].size(); b++) {
+        if (!(mask & (1ull << b))) continue;
+
+        VkDescriptorType type = bindings[set][b].descriptorType;
+        bool buffer = type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER
+                   || type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC || type == VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+        writes.push_back({
+            .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+            .dstSet = dst,
+            .dstBinding = b,
+            .dstArrayElement = 0,
+            .descriptorCount = 1,
+            .descriptorType = type,
+            .pImageInfo = buffer ? nullptr : &infos[b].image,
+            .pBufferInfo = buffer ? &infos[b].buffer : nullptr,
+        });
+    }
+}
+
+void Pipeline::flush() {
+
+    DescriptorAllocator& alloc = device.descriptors();
+    uint64_t frame = alloc.number();
+    int64_t start = now();
+    bool any = false;
+
+    std::vector<VkWriteDescriptorSet> writes;
+
+    for (uint32_t set = push ? 1 : 0; set < bindings.size(); set++) {
 
-    descset_index[set] = (descset_index[set] + 1) % _p_res_count;
+        // the set's still good: nothing changed, and its frame's pools are still around
+        if (!dirty[set] && descsets[set] != VK_NULL_HANDLE && setframes[set] == frame) continue;
+
+        // a new one with everything, the old one might be in use
+        VkDescriptorSet ds = alloc.allocate(desc_layouts[set]);
+        uint64_t all = bindings[set].size() == 64 ? ~0ull : (1ull << bindings[set].size()) - 1;
+
+        // everything's been written at some point: one call, straight from the array
+        if (templates[set] != VK_NULL_HANDLE && written[set] == all) {
+            vkUpdateDescriptorSetWithTemplate(device, ds, templates[set], descinfos[set].data());
+            stats.updates++;
+            stats.templated++;
+        } else {
+            writesof(set, written[set], ds, writes);
+        }
+
+        descsets[set] = ds;
+        setframes[set] = frame;
+        dirty[set] = 0;
+        any = true;
+    }
+
+    // the rest, all at once
+    if (!writes.empty()) {
+        vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
+        stats.updates++;
+    }
+
+    if (any) stats.ns += now() - start;
 }
 
-std::vector<VkDescriptorSet> Pipeline::_getdescset() {
-    std::vector<VkDescriptorSet> ret;
-    for (int i = 0; i < desc_layouts.size(); i++) {
-        ret.push_back(descsets[i][descset_index[i]]);
+// records set 0's bindings (as last written) into cmd
+void Pipeline::_push(VkCommandBuffer cmd) {
+
+    if (!push) return;
+    int64_t start = now();
+
+    uint64_t all = bindings[0].size() == 64 ? ~0ull : (1ull << bindings[0].size()) - 1;
+
+    if (templates[0] != VK_NULL_HANDLE && written[0] == all) {
+        device._cmdPushDescriptorSetWithTemplate(cmd, templates[0], pipelineLayout, 0, descinfos[0].data());
+        stats.templated++;
+    } else {
+        std::vector<VkWriteDescriptorSet> writes;
+        writesof(0, written[0], VK_NULL_HANDLE, writes);
+        if (!writes.empty()) {
+            device._cmdPushDescriptorSet(cmd, type, pipelineLayout, 0, writes.size(), writes.data());
+        }
     }
-    return ret;
+    dirty[0] = 0;
+    stats.pushes++;
+
+    stats.ns += now() - start;
 }
 
 // write the given buffer to the descriptor at` binding`
 void Pipeline::writeDescriptor(uint32_t set, uint32_t binding, Buffer& buffer, VkDescriptorType buftype) {
 
-    VkDescriptorBufferInfo bufferInfo {
+    stage(set, binding).buffer = {
         .buffer = (VkBuffer) buffer,
         .offset = 0,
         .range = VK_WHOLE_SIZE,
     };
-
-    VkWriteDescriptorSet descriptorWrite {
-        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        .dstSet = descsets[set][descset_index[set]],
-        .dstBinding = binding,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = buftype,
-        .pBufferInfo = &bufferInfo
-    };
-
-    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 }
 
 // write the given image to the descriptor at` binding`
 void Pipeline::writeDescriptor(uint32_t set, uint32_t binding, Image& image, VkDescriptorType imtype) {
+    writeDescriptor(set, binding, image, imtype, ~0u);
+}
+
+// same, but only one mip level of it (all of them, with the image's own view, if level is ~0)
+void Pipeline::writeDescriptor(uint32_t set, uint32_t binding, Image& image, VkDescriptorType imtype, uint32_t level) {
 
-    VkDescriptorImageInfo imageInfo {
+    stage(set, binding).image = {
         .sampler = imtype == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ?
                         image.sampler() : VK_NULL_HANDLE,
-        .imageView = (VkImageView) image,
+        .imageView = level == ~0u ? (VkImageView) image : image.level(level),
         .imageLayout = imtype == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER ?
                         VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL,
     };
-
-    VkWriteDescriptorSet descriptorWrite {
-        .sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-        .dstSet = descsets[set][descset_index[set]],
-        .dstBinding = binding,
-        .dstArrayElement = 0,
-        .descriptorCount = 1,
-        .descriptorType = imtype,
-        .pImageInfo = &imageInfo
-    };
-
-    vkUpdateDescriptorSets(device, 1, &descriptorWrite, 0, nullptr);
 }
 
 
@@ -326,6 +462,8 @@ void Pipeline::writeDescriptor(uint32_t set, uint32_t binding, Image& image, VkD
 void Pipeline::init_compute (std::vector<std::vector<VkDescriptorSetLayoutBinding>> descriptorsets,
                              std::vector<VkPushConstantRange> pushconst, ShaderModule& comp) {
 
+    // without push descriptors set 0 is allocated like the rest
+    push = push && device.pushDescriptors();
 
     // the part where you add descriptors
     // Note: we make a single descriptor set layout for this pipeline to use
@@ -341,16 +479,17 @@ void Pipeline::init_compute (std::vector<std::vector<VkDescriptorSetLayoutBindin
 
             binding++;
         }
+        bindings.push_back(descriptors);
 
+        // a pushed set 0 is never allocated, it's recorded into the command buffer
         VkDescriptorSetLayoutCreateInfo descset_info {
             .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+            .flags = push && desc_layouts.empty() ? (VkDescriptorSetLayoutCreateFlags) VK_DESCRIPTOR_SET_LAYOUT_CREATE_PUSH_DESCRIPTOR_BIT_KHR : 0u,
             .bindingCount = (uint32_t) descriptors.size(),
             .pBindings = descriptors.data(),
         };
 
-        VkDescriptorSetLayout desc_layout;
-        VK_ASSERT( vkCreateDescriptorSetLayout(device, &descset_info, nullptr, &desc_layout) );
-        desc_layouts.push_back(desc_layout);
+        desc_layouts.push_back(device.cache().setLayout(descset_info));
     }
 
     // now create all the pushconstants
@@ -369,7 +508,7 @@ void Pipeline::init_compute (std::vector<std::vector<VkDescriptorSetLayoutBindin
         .pPushConstantRanges = pushconst.data()
     };
 
-    VK_ASSERT( vkCreatePipelineLayout(device, &pipelineLayoutInfo, nullptr, &pipelineLayout) );
+    pipelineLayout = device.cache().pipelineLayout(pipelineLayoutInfo);
 
     // now create the stages
 
@@ -378,6 +517,7 @@ void Pipeline::init_compute (std::vector<std::vector<VkDescriptorSetLayoutBindin
         .stage = VK_SHADER_STAGE_COMPUTE_BIT,
         .module = (VkShaderModule) comp,
         .pName = "main",
+        .pSpecializationInfo = spec,
     };
 
     VkComputePipelineCreateInfo pipelineInfo {
@@ -386,59 +526,25 @@ void Pipeline::init_compute (std::vector<std::vector<VkDescriptorSetLayoutBindin
         .layout = pipelineLayout,
     };
 
-    VK_ASSERT( vkCreateComputePipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr, &pipeline) );
+    pipeline = device.cache().compute(pipelineInfo);
 
     // we're not done yet, gotta create descriptor-resources
-
-    // we'll need a pool-size for each type of descriptor.
-
-    std::vector<VkDescriptorPoolSize> poolsizes;
-
-    for (const auto& descriptors : descriptorsets) {
-        for (VkDescriptorSetLayoutBinding i: descriptors) {
-            poolsizes.push_back({
-                .type = i.descriptorType,
-                .descriptorCount = _p_res_count * 2 // allocate _p_res_count of each -- double of the default (_p_res_count) seems to work
-            });
-        }
-    }
-
-    VkDescriptorPoolCreateInfo poolInfo {
-        .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-        .maxSets = (uint32_t) descriptorsets.size() * _p_res_count,
-        .poolSizeCount = (uint32_t) poolsizes.size(),
-        .pPoolSizes = poolsizes.data(),
-    };
-
-    VK_ASSERT( vkCreateDescriptorPool(device, &poolInfo, nullptr, &descriptorPool) );
-
-    // allocate the desc sets now
-    // allocate _p_res_count descriptor sets to cycle through
-    descsets.resize(descriptorsets.size());
-    for (int i = 0; i < descriptorsets.size(); i++) {
-        std::vector<VkDescriptorSetLayout> layouts(_p_res_count, desc_layouts[i]);
-        VkDescriptorSetAllocateInfo allocInfo {
-            .sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-            .descriptorPool = descriptorPool,
-            .descriptorSetCount = _p_res_count,
-            .pSetLayouts = layouts.data(),
-        };
-
-        descsets[i].resize(_p_res_count);
-        VK_ASSERT( vkAllocateDescriptorSets(device, &allocInfo, descsets[i].data()) );
-    }
+    init_templates();
 
     // ok now we're done for real
 }
 
 // destructor
 Pipeline::~Pipeline() {
-    vkDestroyDescriptorPool(device, descriptorPool, nullptr);
-    vkDestroyPipeline(device, pipeline, nullptr);
-    vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+    for (VkDescriptorUpdateTemplate t : templates) {
+        if (t != VK_NULL_HANDLE) vkDestroyDescriptorUpdateTemplate(device, t, nullptr);
+    }
+    // (shared with other pipelines, maybe)
+    device.cache().release(pipeline);
+    device.cache().release(pipelineLayout);
 
     for (auto desc_layout : desc_layouts) {
-        vkDestroyDescriptorSetLayout(device, desc_layout, nullptr);
+        device.cache().release(desc_layout);
     }
 }
 
@@ -10,9 +10,7 @@ class ShaderModule;
 class Buffer;
 class Image;
 class RenderPass;
-
-// constant
-const int _p_res_count = 2;
+class Heap;
 
 // helper struct
 struct VertexInputBinding {
@@ -21,6 +19,29 @@ struct VertexInputBinding {
     std::vector<VkVertexInputAttributeDescription> attr;
 };
 
+// specialization constants for a pipeline's shaders, by constant_id.
+// every value is 4 bytes: int, uint, float, or bool (as a VkBool32).
+// converts to the VkSpecializationInfo the factories take, eg.
+//   Pipeline::Compute(..., Specialization().set(0, axis).set(1, radius))
+struct Specialization {
+    std::vector<VkSpecializationMapEntry> entries;
+    std::vector<uint32_t> data;
+    VkSpecializationInfo info;
+
+    template <typename T>
+    Specialization& set(uint32_t id, T value) {
+        static_assert(sizeof(T) == 4, "specialization constants are 4 bytes");
+        entries.push_back({id, (uint32_t) (data.size() * 4), 4});
+        data.push_back(std::bit_cast<uint32_t>(value));
+        return *this;
+    }
+
+    operator const VkSpecializationInfo*() {
+        info = {(uint32_t) entries.size(), entries.data(), data.size() * 4, data.data()};
+        return &info;
+    }
+};
+
 // Represents a pipeline
 // A pipeline either holds a vert shader and a frag shader or
 // holds a compute shader.
@@ -35,9 +56,31 @@ class Pipeline {
 
     VkPipelineBindPoint type;
 
-    VkDescriptorPool descriptorPool;
-    std::vector<std::vector<VkDescriptorSet>> descsets;
-    std::vector<uint32_t> descset_index = std::vector<uint32_t>(_p_res_count);
+    Heap* heap = nullptr;  // bound after the pipeline's own sets, if there is one
+    bool push = false;     // set 0 is pushed (see CommandBuffer::pushDescriptors), not allocated
+    const VkSpecializationInfo* spec = nullptr;  // for every stage, only while it's made
+
+    // writeDescriptor() only keeps what was written, flush() (or binding the
+    // pipeline) gets a new set from the device's DescriptorAllocator for every
+    // set that changed (or is from an earlier frame), and writes all of it: with
+    // a template if the set has one and all of its bindings were written at some
+    // point, otherwise all the writes in one vkUpdateDescriptorSets.
+    // a set is never written again once it's been bound, so it can't change under
+    // the gpu, and it's gone once its frame is done
+    union DescriptorInfo {
+        VkDescriptorImageInfo image;
+        VkDescriptorBufferInfo buffer;
+    };
+    std::vector<std::vector<VkDescriptorSetLayoutBinding>> bindings;  // of each set
+    std::vector<VkDescriptorUpdateTemplate> templates;                 // of each set, if it can have one
+    std::vector<std::vector<DescriptorInfo>> descinfos;               // [set][binding], the last written
+    std::vector<uint64_t> written, dirty;                              // of each set, a bit per binding
+    std::vector<VkDescriptorSet> descsets;                             // the current one of each set
+    std::vector<uint64_t> setframes;                                   // the allocator's frame it's from
+
+    void init_templates();
+    DescriptorInfo& stage(uint32_t set, uint32_t binding);
+    void writesof(uint32_t set, uint64_t mask, VkDescriptorSet, std::vector<VkWriteDescriptorSet>&);
 
     std::vector<VkPushConstantRange> pushconstantranges;
 
@@ -50,15 +93,26 @@ class Pipeline {
 
 public:
 
-    // Factory function - Graphics: Creates a graphics pipeline with the given parameters
+    // Factory function - Graphics: Creates a graphics pipeline with the given parameters.
+    // with a heap, its set comes after the given ones (set = descriptors.size()).
+    // with push, set 0 is a push descriptor set: what's written to it is recorded
+    // straight into the command buffer by bindPipeline() (or pushDescriptors()),
+    // so there's no set to allocate, update, or wait for the gpu to be done with.
+    // (if the device can, see Device::pushDescriptors(), it's allocated otherwise)
+    // spec sets both shaders' specialization constants. the same shaders with
+    // the same constants (and state) share one VkPipeline, see Cache
     static Pipeline& Graphics(
         Device& d,
         std::vector<std::vector<VkDescriptorSetLayoutBinding>> descriptors, std::vector<VkPushConstantRange> pushconst,
         std::vector<struct VertexInputBinding> vertex_input, ShaderModule& v,
-        RenderPass& r, ShaderModule& f
+        RenderPass& r, ShaderModule& f, Heap* heap = nullptr, bool push = false,
+        const VkSpecializationInfo* spec = nullptr
     ) {
         Pipeline* p = new Pipeline(d);
         p->type = VK_PIPELINE_BIND_POINT_GRAPHICS;
+        p->heap = heap;
+        p->push = push;
+        p->spec = spec;
 
         p->init_graphics(
             descriptors, pushconst,
@@ -66,26 +120,67 @@ public:
             r, f
         );
 
+        p->spec = nullptr;
         return *p;
     };
 
+    // Factory function - Graphics, with the layouts the shaders declare (see
+    // Reflection): their sets, one push constant range for both, and the vertex
+    // shader's inputs, packed in one vertex buffer in the order of their locations.
+    // with a heap, the sets at the end that only have unsized arrays are the heap's
+    static Pipeline& Graphics(Device& d, ShaderModule& v, RenderPass& r, ShaderModule& f,
+                              Heap* heap = nullptr, bool push = false,
+                              const VkSpecializationInfo* spec = nullptr);
+
+    // Factory function - Compute. with push, set 0 is pushed (like Graphics).
+    // the sets that aren't only last till the end of the frame (see DescriptorAllocator),
+    // so a command buffer that's recorded once and submitted again and again needs push.
+    // spec is the shader's specialization constants (one pipeline per set of them)
     static Pipeline& Compute(Device& d,std::vector<std::vector<VkDescriptorSetLayoutBinding>> descriptors,
-                            std::vector<VkPushConstantRange> pushconst, ShaderModule& c) {
+                            std::vector<VkPushConstantRange> pushconst, ShaderModule& c,
+                            bool push = false, const VkSpecializationInfo* spec = nullptr) {
         Pipeline* p = new Pipeline(d); 
         p->type = VK_PIPELINE_BIND_POINT_COMPUTE;
+        p->push = push;
+        p->spec = spec;
         p->init_compute(descriptors, pushconst, c);
+        p->spec = nullptr;
         return *p;
     };
 
-    // return the current descriptor set
+    // Factory function - Compute, with the layouts the shader declares
+    static Pipeline& Compute(Device& d, ShaderModule& c, bool push = false, const VkSpecializationInfo* spec = nullptr);
+
+    // the vertex shader's inputs, by location, in one interleaved binding
+    static std::vector<struct VertexInputBinding> vertexinput(const Reflection&);
+
+    // return the current descriptor set (flushes the writes to them first).
+    // not the pushed one, those start at set 1 then
     std::vector<VkDescriptorSet> _getdescset();
+    bool _pushed() const {return push;}
+
+    // records the pushed set into the command buffer, see CommandBuffer::pushDescriptors
+    void _push(VkCommandBuffer);
 
     // return the pushconstant ranges
     std::vector<VkPushConstantRange> _getpcr() {return pushconstantranges;}
 
-    void descriptorSet(uint32_t);
     void writeDescriptor(uint32_t, uint32_t, Buffer&, VkDescriptorType);
     void writeDescriptor(uint32_t, uint32_t, Image&, VkDescriptorType);
+    void writeDescriptor(uint32_t, uint32_t, Image&, VkDescriptorType, uint32_t level);
+
+    // makes new sets with what was written since the last flush
+    void flush();
+
+    // descriptor updates of every pipeline so far, and the cpu time spent on them
+    struct DescriptorStats {
+        uint64_t writes = 0;     // writeDescriptor() calls
+        uint64_t updates = 0;    // vkUpdateDescriptorSets / vkUpdateDescriptorSetWithTemplate calls
+        uint64_t pushes = 0;     // sets pushed into a command buffer
+        uint64_t templated = 0;  // of the updates and pushes, with a template
+        int64_t ns = 0;
+    };
+    static DescriptorStats descriptorStats();
 
     ~Pipeline();
 
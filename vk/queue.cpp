@@ -47,18 +47,77 @@ CommandBuffer& Queue::command() {
     return *ret;
 }
 
+// allocates a command buffer that command() never hands out
+CommandBuffer& Queue::dedicated() {
+
+    VkCommandBufferAllocateInfo allocInfo {
+        .sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+        .commandPool = cmdPool,
+        .level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+        .commandBufferCount = 1,
+    };
+
+    VkCommandBuffer c;
+    VK_ASSERT( vkAllocateCommandBuffers(dev, &allocInfo, &c) );
+
+    dedicated_wrap.push_back(new CommandBuffer(c));
+    return *dedicated_wrap.back();
+}
+
 
 // submits the active CommandBuffer, and cycles the ring of commandbuffers
 // fence - fence is signaled when the operation is complete
 // waitsems - semaphores to wait on before starting the operation
 // waitstages - stages to wait at on the waitsems
 // signalsems - semaphores to signal once operation is complete
-void Queue::submit(CommandBuffer& cmd, VkFence f, std::vector<VkSemaphore> waitsem, std::vector<VkPipelineStageFlags> waitstage, std::vector<VkSemaphore> signalsem) {
+// waitvals, signalvals - values for timeline semaphores, one per wait/signal semaphore
+//                        (ignored for binary semaphores). leave empty if there are none.
+void Queue::submit(CommandBuffer& cmd, VkFence f, std::vector<VkSemaphore> waitsem, std::vector<VkPipelineStageFlags> waitstage, std::vector<VkSemaphore> signalsem,
+                   std::vector<uint64_t> waitvals, std::vector<uint64_t> signalvals) {
+
+    // the values need to line up with the semaphores
+    waitvals.resize(waitsem.size());
+    signalvals.resize(signalsem.size());
+
+    std::vector<Sync> wait, signal;
+    for (size_t i = 0; i < waitsem.size(); i++) wait.push_back({waitsem[i], waitvals[i], waitstage[i]});
+    for (size_t i = 0; i < signalsem.size(); i++) signal.push_back({signalsem[i], signalvals[i]});
+
+    submit(cmd, wait, signal, f);
+}
+
+// wait - semaphores to wait on before starting, each at its stage (and value, for timelines)
+// signal - semaphores to signal once done (the stage is ignored)
+// fence - signaled once done, optional
+void Queue::submit(CommandBuffer& cmd, std::vector<Sync> wait, std::vector<Sync> signal, VkFence f) {
 
     VkCommandBuffer c = cmd;
 
+    std::vector<VkSemaphore> waitsem, signalsem;
+    std::vector<VkPipelineStageFlags> waitstage;
+    std::vector<uint64_t> waitvals, signalvals;
+    for (const Sync& w : wait) {
+        waitsem.push_back(w.semaphore);
+        waitstage.push_back(w.stage);
+        waitvals.push_back(w.value);
+    }
+    for (const Sync& s : signal) {
+        signalsem.push_back(s.semaphore);
+        signalvals.push_back(s.value);
+    }
+
+    // binary semaphores just ignore their values
+    VkTimelineSemaphoreSubmitInfo timeline_info {
+        .sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+        .waitSemaphoreValueCount = (uint32_t) waitvals.size(),
+        .pWaitSemaphoreValues = waitvals.data(),
+        .signalSemaphoreValueCount = (uint32_t) signalvals.size(),
+        .pSignalSemaphoreValues = signalvals.data(),
+    };
+
     VkSubmitInfo submit_info {
         .sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+        .pNext = &timeline_info,
         .waitSemaphoreCount = (uint32_t) waitsem.size(),
         .pWaitSemaphores = waitsem.data(),
         .pWaitDstStageMask = waitstage.data(),
@@ -95,6 +154,7 @@ void Queue::present(Image& _, std::vector<VkSemaphore> waitsem) {
 // destructor
 Queue::~Queue () {
     vkDestroyCommandPool(dev, cmdPool, nullptr);
+    for (auto c : dedicated_wrap) delete c;
 }
 
 };
\ No newline at end of file
@@ -8,6 +8,7 @@ namespace vk {
 class Device;
 class CommandBuffer;
 class Image;
+struct Sync;
 
 
 // A queue wraps a VkQueue, and
@@ -25,6 +26,8 @@ class Queue {
     std::vector<CommandBuffer*> cmdbufs_wrap;
     uint32_t curr_cmdbuf = 0;
 
+    std::vector<CommandBuffer*> dedicated_wrap;  // see dedicated()
+
     friend class Device;
     void init();
     Queue(Device&, uint32_t);
@@ -33,9 +36,23 @@ public:
     ~Queue();   
 
     CommandBuffer& command();
-    void submit(CommandBuffer&, VkFence, std::vector<VkSemaphore>, std::vector<VkPipelineStageFlags>, std::vector<VkSemaphore>);
+
+    // a new command buffer outside of the ring, for recording once and submitting
+    // many times. freed with the queue.
+    CommandBuffer& dedicated();
+    void submit(CommandBuffer&, VkFence, std::vector<VkSemaphore>, std::vector<VkPipelineStageFlags>, std::vector<VkSemaphore>,
+                std::vector<uint64_t> waitvals = {}, std::vector<uint64_t> signalvals = {});
+
+    // submits waiting for / signaling points on semaphores, see vk::Timeline
+    void submit(CommandBuffer&, std::vector<Sync> wait, std::vector<Sync> signal, VkFence = VK_NULL_HANDLE);
     void present(Image&, std::vector<VkSemaphore>);
 
+    uint32_t getfamily() const {return family;}
+
+    // whether both submit to the same VkQueue (every queue of a family does,
+    // see Device::init()), so their work doesn't run side by side
+    bool shares(const Queue& q) const {return queue == q.queue;}
+
 };
 
 
@@ -0,0 +1,389 @@
+#include "vklib.h"
+#include "reflection.h"
+#include <algorithm>
+#include <cstring>
+
+namespace vk {
+
+// the few spir-v opcodes, decorations and enums that matter here
+enum {
+    OpName = 5,
+    OpEntryPoint = 15,
+    OpTypeBool = 20,
+    OpTypeInt = 21,
+    OpTypeFloat = 22,
+    OpTypeVector = 23,
+    OpTypeMatrix = 24,
+    OpTypeImage = 25,
+    OpTypeSampler = 26,
+    OpTypeSampledImage = 27,
+    OpTypeArray = 28,
+    OpTypeRuntimeArray = 29,
+    OpTypeStruct = 30,
+    OpTypePointer = 32,
+    OpConstant = 43,
+    OpSpecConstant = 50,
+    OpVariable = 59,
+    OpDecorate = 71,
+    OpMemberDecorate = 72,
+    OpTypeAccelerationStructureKHR = 5341,
+};
+
+enum {
+    DecorationBufferBlock = 3,
+    DecorationArrayStride = 6,
+    DecorationMatrixStride = 7,
+    DecorationBuiltIn = 11,
+    DecorationLocation = 30,
+    DecorationBinding = 33,
+    DecorationDescriptorSet = 34,
+    DecorationOffset = 35,
+};
+
+enum {
+    StorageUniformConstant = 0,
+    StorageInput = 1,
+    StorageUniform = 2,
+    StoragePushConstant = 9,
+    StorageStorageBuffer = 12,
+};
+
+enum {
+    DimBuffer = 5,
+    DimSubpassData = 6,
+};
+
+// everything known about an id
+struct Id {
+    uint32_t op = 0;
+    std::vector<uint32_t> args;  // the instruction's operands after the id
+    std::string name;
+
+    uint32_t set = ~0u, binding = ~0u, location = ~0u;
+    bool builtin = false;
+    bool bufferblock = false;
+    uint32_t arraystride = 0;
+    std::vector<uint32_t> offsets, matrixstrides;  // of a struct's members
+};
+
+static std::string str(const uint32_t* words, uint32_t n) {
+    return std::string((const char*) words, strnlen((const char*) words, n * 4));
+}
+
+static VkShaderStageFlags stageof(uint32_t model) {
+    switch (model) {
+        case 0: return VK_SHADER_STAGE_VERTEX_BIT;
+        case 1: return VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT;
+        case 2: return VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT;
+        case 3: return VK_SHADER_STAGE_GEOMETRY_BIT;
+        case 4: return VK_SHADER_STAGE_FRAGMENT_BIT;
+        case 5: return VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+    return 0;
+}
+
+// the length of an array type (its default, if it's a specialization constant)
+static uint32_t length(const std::vector<Id>& ids, const Id& array) {
+    const Id& c = ids[array.args[1]];
+    return c.args.empty() ? 1 : c.args[0];
+}
+
+// the size of a type in a block, laid out by its decorations
+static uint32_t sizeof_type(const std::vector<Id>& ids, uint32_t t, uint32_t matrixstride = 0) {
+    const Id& id = ids[t];
+    switch (id.op) {
+        case OpTypeBool: return 4;
+        case OpTypeInt:
+        case OpTypeFloat: return id.args[0] / 8;
+        case OpTypeVector: return id.args[1] * sizeof_type(ids, id.args[0]);
+        case OpTypeMatrix: return id.args[1] * (matrixstride ? matrixstride : sizeof_type(ids, id.args[0]));
+        case OpTypeArray: return length(ids, id) * id.arraystride;
+        case OpTypeStruct: {
+            uint32_t size = 0;
+            for (uint32_t m = 0; m < id.args.size(); m++) {
+                uint32_t offset = m < id.offsets.size() ? id.offsets[m] : 0;
+                uint32_t stride = m < id.matrixstrides.size() ? id.matrixstrides[m] : 0;
+                size = std::max(size, offset + sizeof_type(ids, id.args[m], stride));
+            }
+            return size;
+        }
+    }
+    return 0;
+}
+
+// the descriptor type of a variable's (array element) type, false if it isn't one
+static bool descriptor(const std::vector<Id>& ids, uint32_t t, uint32_t storage, VkDescriptorType& type) {
+    const Id& id = ids[t];
+
+    if (storage == StorageStorageBuffer) {
+        type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        return true;
+    }
+    if (storage == StorageUniform) {
+        type = id.bufferblock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        return true;
+    }
+    if (storage != StorageUniformConstant) return false;
+
+    switch (id.op) {
+        case OpTypeSampler:
+            type = VK_DESCRIPTOR_TYPE_SAMPLER;
+            return true;
+        case OpTypeAccelerationStructureKHR:
+            type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR;
+            return true;
+        case OpTypeSampledImage:
+            type = ids[id.args[0]].args[1] == DimBuffer ?
+                VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            return true;
+        case OpTypeImage: {
+            // sampled type, dim, depth, arrayed, ms, sampled (1: with a sampler, 2: storage), format
+            bool storage = id.args[5] == 2;
+            if (id.args[1] == DimSubpassData) type = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            else if (id.args[1] == DimBuffer) type = storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            else type = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            return true;
+        }
+    }
+    return false;
+}
+
+// the vertex format of an input's type: a scalar or a vector of 32 bit numbers
+static bool vertexformat(const std::vector<Id>& ids, uint32_t t, VkFormat& format, uint32_t& size) {
+    uint32_t n = 1;
+    if (ids[t].op == OpTypeVector) {
+        n = ids[t].args[1];
+        t = ids[t].args[0];
+    }
+
+    const Id& c = ids[t];
+    if (c.op != OpTypeInt && c.op != OpTypeFloat) return false;
+    if (c.args[0] != 32 || n > 4) return false;
+
+    static const VkFormat floats[4] {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT, VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    static const VkFormat sints[4]  {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT, VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+    static const VkFormat uints[4]  {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT, VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+
+    format = c.op == OpTypeFloat ? floats[n - 1] : c.args[1] ? sints[n - 1] : uints[n - 1];
+    size = n * 4;
+    return true;
+}
+
+Reflection Reflection::of(const std::vector<uint32_t>& code) {
+
+    if (code.size() < 5 || code[0] != 0x07230203) {
+        throw std::runtime_error("not spir-v");
+    }
+
+    std::vector<Id> ids(code[3]);  // the bound
+    std::vector<uint32_t> variables;
+    Reflection r;
+
+    // one pass over the instructions, everything that matters is declared before
+    // the functions (and types before the variables of them)
+    for (size_t i = 5; i < code.size(); ) {
+        uint32_t count = code[i] >> 16;
+        uint32_t op = code[i] & 0xffff;
+        if (count == 0 || i + count > code.size()) throw std::runtime_error("broken spir-v");
+
+        const uint32_t* a = &code[i + 1];
+        uint32_t n = count - 1;
+        i += count;
+
+        switch (op) {
+            case OpName:
+                ids[a[0]].name = str(a + 1, n - 1);
+                break;
+
+            case OpEntryPoint:
+                r.stages |= stageof(a[0]);
+                break;
+
+            case OpDecorate: {
+                Id& id = ids[a[0]];
+                switch (a[1]) {
+                    case DecorationBufferBlock: id.bufferblock = true; break;
+                    case DecorationArrayStride: id.arraystride = a[2]; break;
+                    case DecorationBuiltIn: id.builtin = true; break;
+                    case DecorationLocation: id.location = a[2]; break;
+                    case DecorationBinding: id.binding = a[2]; break;
+                    case DecorationDescriptorSet: id.set = a[2]; break;
+                }
+                break;
+            }
+
+            case OpMemberDecorate: {
+                Id& id = ids[a[0]];
+                std::vector<uint32_t>* v =
+                    a[2] == DecorationOffset ? &id.offsets :
+                    a[2] == DecorationMatrixStride ? &id.matrixstrides : nullptr;
+                if (v) {
+                    if (v->size() <= a[1]) v->resize(a[1] + 1);
+                    (*v)[a[1]] = a[3];
+                }
+                if (a[2] == DecorationBuiltIn) id.builtin = true;  // (gl_PerVertex)
+                break;
+            }
+
+            case OpTypeBool:
+            case OpTypeInt:
+            case OpTypeFloat:
+            case OpTypeVector:
+            case OpTypeMatrix:
+            case OpTypeImage:
+            case OpTypeSampler:
+            case OpTypeSampledImage:
+            case OpTypeArray:
+            case OpTypeRuntimeArray:
+            case OpTypeStruct:
+            case OpTypePointer:
+            case OpTypeAccelerationStructureKHR:
+                ids[a[0]].op = op;
+                ids[a[0]].args.assign(a + 1, a + n);
+                break;
+
+            // (only the low word, they're only used as array sizes)
+            case OpConstant:
+            case OpSpecConstant:
+                ids[a[1]].op = op;
+                ids[a[1]].args.assign(a + 2, a + n);
+                break;
+
+            case OpVariable:
+                ids[a[1]].op = op;
+                ids[a[1]].args.assign({a[0], a[2]});  // pointer type, storage class
+                variables.push_back(a[1]);
+                break;
+        }
+    }
+
+    for (uint32_t v : variables) {
+        const Id& var = ids[v];
+        uint32_t storage = var.args[1];
+        uint32_t t = ids[var.args[0]].args[1];  // what the pointer points to
+
+        if (storage == StoragePushConstant) {
+            r.pushconstants = {{.stageFlags = r.stages, .offset = 0, .size = sizeof_type(ids, t)}};
+            continue;
+        }
+
+        if (storage == StorageInput) {
+            if (!(r.stages & VK_SHADER_STAGE_VERTEX_BIT) || var.builtin || ids[t].builtin) continue;
+
+            Input in {.location = var.location};
+            if (!vertexformat(ids, t, in.format, in.size)) {
+                throw std::runtime_error("vertex input " + var.name + " isn't a scalar or vector of 32 bits");
+            }
+            r.inputs.push_back(in);
+            continue;
+        }
+
+        if (var.binding == ~0u) continue;
+
+        // arrays of descriptors
+        uint32_t count = 1;
+        while (ids[t].op == OpTypeArray || ids[t].op == OpTypeRuntimeArray) {
+            count = ids[t].op == OpTypeArray ? count * length(ids, ids[t]) : 0;
+            t = ids[t].args[0];
+        }
+
+        Binding b {
+            .set = var.set == ~0u ? 0 : var.set,
+            .binding = var.binding,
+            .count = count,
+            .stages = r.stages,
+            .name = var.name.empty() ? ids[t].name : var.name,
+        };
+        if (!descriptor(ids, t, storage, b.type)) {
+            throw std::runtime_error("no descriptor type for " + b.name);
+        }
+
+        Reflection one;
+        one.bindings = {b};
+        r.merge(one);
+    }
+
+    std::sort(r.inputs.begin(), r.inputs.end(), [](const Input& x, const Input& y) {return x.location < y.location;});
+    return r;
+}
+
+void Reflection::merge(const Reflection& o) {
+
+    stages |= o.stages;
+
+    for (const Binding& b : o.bindings) {
+        auto it = std::lower_bound(bindings.begin(), bindings.end(), b, [](const Binding& x, const Binding& y) {
+            return std::make_pair(x.set, x.binding) < std::make_pair(y.set, y.binding);
+        });
+
+        // (two variables at the same binding, like the heap's arrays, are fine if they agree)
+        if (it != bindings.end() && it->set == b.set && it->binding == b.binding) {
+            if (it->type != b.type || it->count != b.count) {
+                throw std::runtime_error("set " + std::to_string(b.set) + " binding " + std::to_string(b.binding) +
+                    " is a " + name(it->type) + " (" + it->name + ") and a " + name(b.type) + " (" + b.name + ")");
+            }
+            it->stages |= b.stages;
+        } else {
+            bindings.insert(it, b);
+        }
+    }
+
+    // one range over everything every stage pushes
+    for (const VkPushConstantRange& p : o.pushconstants) {
+        if (pushconstants.empty()) {
+            pushconstants.push_back(p);
+        } else {
+            pushconstants[0].stageFlags |= p.stageFlags;
+            pushconstants[0].size = std::max(pushconstants[0].size, p.size);
+        }
+    }
+
+    if (inputs.empty()) inputs = o.inputs;
+}
+
+std::vector<std::vector<VkDescriptorSetLayoutBinding>> Reflection::sets(bool heap) const {
+
+    std::vector<std::vector<VkDescriptorSetLayoutBinding>> ret;
+    for (const Binding& b : bindings) {
+        if (b.set >= ret.size()) ret.resize(b.set + 1);
+        ret[b.set].push_back({
+            .binding = b.binding,
+            .descriptorType = b.type,
+            .descriptorCount = b.count,
+            .stageFlags = b.stages,
+        });
+    }
+
+    while (heap && !ret.empty() && std::all_of(ret.back().begin(), ret.back().end(),
+            [](const VkDescriptorSetLayoutBinding& b) {return b.descriptorCount == 0;})) {
+        ret.pop_back();
+    }
+
+    for (uint32_t s = 0; s < ret.size(); s++) {
+        for (uint32_t i = 0; i < ret[s].size(); i++) {
+            if (ret[s][i].binding != i) {
+                throw std::runtime_error("set " + std::to_string(s) + " has no binding " + std::to_string(i) +
+                                         ", its bindings have to be 0, 1, 2...");
+            }
+        }
+    }
+    return ret;
+}
+
+const char* Reflection::name(VkDescriptorType t) {
+    switch (t) {
+        case VK_DESCRIPTOR_TYPE_SAMPLER: return "sampler";
+        case VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER: return "combined image sampler";
+        case VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE: return "sampled image";
+        case VK_DESCRIPTOR_TYPE_STORAGE_IMAGE: return "storage image";
+        case VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER: return "uniform texel buffer";
+        case VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER: return "storage texel buffer";
+        case VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER: return "uniform buffer";
+        case VK_DESCRIPTOR_TYPE_STORAGE_BUFFER: return "storage buffer";
+        case VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT: return "input attachment";
+        case VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR: return "acceleration structure";
+        default: return "descriptor";
+    }
+}
+
+};
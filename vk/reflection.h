@@ -0,0 +1,55 @@
+#ifndef REFLECTION_H
+#define REFLECTION_H
+
+#include "vklib.h"
+
+namespace vk {
+
+// What a shader's spir-v says it takes: its descriptors, its push constants,
+// and (for a vertex shader) its vertex inputs. Every ShaderModule has one, and
+// the Pipeline factories that only take the shaders make their layouts from
+// them, so they can't go out of sync with the glsl.
+//
+// Only what's needed for that is read: the decorations, types, constants and
+// global variables, not the code. Arrays sized by a specialization constant
+// get its default size.
+struct Reflection {
+
+    struct Binding {
+        uint32_t set;
+        uint32_t binding;
+        VkDescriptorType type;
+        uint32_t count;             // array size, 0 for an unsized array
+        VkShaderStageFlags stages;  // the shaders that have it
+        std::string name;           // the variable's (or its block's), for errors
+    };
+
+    struct Input {
+        uint32_t location;
+        VkFormat format;
+        uint32_t size;  // bytes
+    };
+
+    VkShaderStageFlags stages = 0;
+    std::vector<Binding> bindings;                   // by set, then binding
+    std::vector<VkPushConstantRange> pushconstants;  // at most one, from 0 to the end of the block
+    std::vector<Input> inputs;                       // by location, only a vertex shader's
+
+    // reads a module's code. throws if it isn't spir-v, or uses something
+    // there's no descriptor type (or vertex format) for
+    static Reflection of(const std::vector<uint32_t>& spirv);
+
+    // adds another stage's. a binding both have has to be the same type and size
+    void merge(const Reflection&);
+
+    // the sets, as Pipeline::Graphics/Compute take them. the bindings of a set
+    // have to be 0, 1, 2... (the pipeline numbers them in order).
+    // with heap, the sets at the end that only have unsized arrays are left
+    // out, they're the heap's (see Heap::glsl)
+    std::vector<std::vector<VkDescriptorSetLayoutBinding>> sets(bool heap = false) const;
+
+    static const char* name(VkDescriptorType);
+};
+
+};
+#endif
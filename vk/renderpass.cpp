@@ -96,6 +96,7 @@ RenderPass::RenderPass(
 }
 
 RenderPass::~RenderPass () {
+    device.cache().forget(pass);
     vkDestroyRenderPass(device, pass, nullptr);
 }
 
@@ -1,8 +1,25 @@
 #include <fstream>
+#include <atomic>
+#include <chrono>
 #include "shadermodule.h"
 
+#ifdef VKLIB_SHADERC
+    #include <shaderc/shaderc.hpp>
+#endif
+
 namespace vk {
 
+bool ShaderModule::optimize = false;
+bool ShaderModule::debug = false;
+#ifdef VKLIB_SHADERC
+bool ShaderModule::inprocess = true;
+#else
+bool ShaderModule::inprocess = false;
+#endif
+
+static std::atomic<uint64_t> compiled {0};
+static std::atomic<int64_t> compile_ns {0};
+
 // helper -- check if `a` endswith `b`
 static bool endswith (const std::string a, const std::string b) {
 
@@ -13,26 +30,21 @@ static bool endswith (const std::string a, const std::string b) {
     return p == b;
 }
 
-// Constructor - compiles a given shader program using glslc and creates a shadermodule
-ShaderModule::ShaderModule(Device& d, std::string filename, std::string code) : device(d) {
+const char* ShaderModule::flags() {
+    return optimize ? (debug ? "-O -g" : "-O") : (debug ? "-g" : "");
+}
 
-    if (endswith(filename, ".vert")){
-        this->type = VK_SHADER_STAGE_VERTEX_BIT;
-    }
-    else if (endswith(filename, ".frag")){
-        this->type = VK_SHADER_STAGE_FRAGMENT_BIT;
-    }
-    else if (endswith(filename, ".comp")){
-        this->type = VK_SHADER_STAGE_COMPUTE_BIT;
-    }
+// glslc in a process of its own, through a file in /tmp
+static std::vector<char> glslc(const std::string& filename, const std::string& code) {
 
     std::ofstream glfile("/tmp/" + filename, std::ios::out);
     glfile << "#version 450\n";
     glfile << code;
     glfile.close();
 
+    std::string flags = ShaderModule::flags();
     if ( 0 != 
-        system(("./.util/glslc -g \"/tmp/" + filename + "\" -o \"/tmp/" + filename + ".spv\"").c_str())
+        system(("./.util/glslc " + flags + (flags.empty() ? "" : " ") + "\"/tmp/" + filename + "\" -o \"/tmp/" + filename + ".spv\"").c_str())
     ) {
         throw std::runtime_error("shader compile failed");
     }
@@ -45,18 +57,93 @@ ShaderModule::ShaderModule(Device& d, std::string filename, std::string code) :
     spvfile.read(bcode.data(), fileSize);
     spvfile.close();
 
-    VkShaderModuleCreateInfo createInfo {
-        .sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-        .codeSize = bcode.size(),
-        .pCode = (uint32_t*) bcode.data()
-    };
+    return bcode;
+}
+
+#ifdef VKLIB_SHADERC
+// the same, but with shaderc in this process and all in memory.
+// a compiler per thread, for the materials compiled in the background
+static std::vector<char> shaderc_compile(const std::string& filename, const std::string& code, VkShaderStageFlagBits type) {
+
+    thread_local shaderc::Compiler compiler;
+
+    shaderc::CompileOptions options;
+    if (ShaderModule::optimize) {
+        options.SetOptimizationLevel(shaderc_optimization_level_performance);
+    }
+    if (ShaderModule::debug) {
+        options.SetGenerateDebugInfo();
+    }
+
+    shaderc_shader_kind kind =
+        type == VK_SHADER_STAGE_VERTEX_BIT ? shaderc_glsl_vertex_shader :
+        type == VK_SHADER_STAGE_FRAGMENT_BIT ? shaderc_glsl_fragment_shader : shaderc_glsl_compute_shader;
 
-    vkCreateShaderModule(device, &createInfo, nullptr, &module);
+    shaderc::SpvCompilationResult result =
+        compiler.CompileGlslToSpv("#version 450\n" + code, kind, filename.c_str(), options);
+
+    if (result.GetCompilationStatus() != shaderc_compilation_status_success) {
+        fprintf(stderr, "%s", result.GetErrorMessage().c_str());
+        throw std::runtime_error("shader compile failed");
+    }
+
+    return std::vector<char>((const char*) result.cbegin(), (const char*) result.cend());
+}
+#endif
+
+const char* ShaderModule::backend() {
+#ifdef VKLIB_SHADERC
+    if (inprocess) return "shaderc";
+#endif
+    return "glslc";
+}
+
+ShaderModule::CompileStats ShaderModule::compileStats() {
+    return {compiled.load(), compile_ns.load()};
+}
+
+// Constructor - compiles a given shader program (see backend()) and creates a shadermodule
+ShaderModule::ShaderModule(Device& d, std::string filename, std::string code) : device(d) {
+
+    if (endswith(filename, ".vert")){
+        this->type = VK_SHADER_STAGE_VERTEX_BIT;
+    }
+    else if (endswith(filename, ".frag")){
+        this->type = VK_SHADER_STAGE_FRAGMENT_BIT;
+    }
+    else if (endswith(filename, ".comp")){
+        this->type = VK_SHADER_STAGE_COMPUTE_BIT;
+    }
+
+    // the same code (as another material's vertex shader) gets the same module,
+    // and only the first one is compiled
+    std::string source = std::to_string(type) + " " + flags() + "\n" + code;
+    std::vector<uint32_t> spirv;
+    module = device.cache().shader(source, [&]() {
+
+        auto start = std::chrono::steady_clock::now();
+#ifdef VKLIB_SHADERC
+        std::vector<char> bcode = inprocess ? shaderc_compile(filename, code, type) : glslc(filename, code);
+#else
+        std::vector<char> bcode = glslc(filename, code);
+#endif
+        compile_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        compiled++;
+
+        return bcode;
+    }, spirv);
+
+    try {
+        _reflection = Reflection::of(spirv);
+    } catch (...) {
+        device.cache().release(module);
+        throw;
+    }
 }
 
 // destructor
 ShaderModule::~ShaderModule () {
-    vkDestroyShaderModule(device, module, nullptr);
+    device.cache().release(module);
 }
 
 };
\ No newline at end of file
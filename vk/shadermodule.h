@@ -11,13 +11,19 @@ class Device;
 // A shader can be a vert shader, a frag shader or a comp shader.
 // Wraps a VkShaderModule.
 // Upon construction with a filename and code, automatically
-// puts the code in the file, compiles it with glslc, and 
-// loads the spv into the shadermodule.
+// compiles it and loads the spv into the shadermodule.
+// built with VKLIB_SHADERC (make SHADERC=1) that's shaderc, in this
+// process and in memory. otherwise (or without inprocess) the code is put
+// in the file (in /tmp) and compiled with glslc.
+// the code only gets compiled if the cache doesn't have it yet.
+// what the spv declares (descriptors, push constants, vertex inputs) is in
+// reflection(), for the pipelines made from it.
 class ShaderModule {
 
     Device& device;
     VkShaderModule module;
     VkShaderStageFlagBits type;
+    Reflection _reflection;
 
 public:
     
@@ -26,6 +32,32 @@ public:
     ShaderModule(Device& d, std::string filename, std::string code);
     ~ShaderModule();
 
+    // compile with the optimizer (-O), for every module made after it's set.
+    // the optimizer can take out what the code never uses (descriptors, push
+    // constants, vertex inputs), and so out of reflection()
+    static bool optimize;
+
+    // compile with debug info (-g), for every module made after it's set
+    static bool debug;
+
+    // the flags of the two above, as glslc takes them ("" for neither)
+    static const char* flags();
+
+    // compile with shaderc, if it's built in (it's on then), instead of glslc
+    static bool inprocess;
+
+    // what compiles them, "shaderc" or "glslc"
+    static const char* backend();
+
+    // the compiles so far (cache misses), and the time they took
+    struct CompileStats {
+        uint64_t compiled = 0;
+        int64_t ns = 0;
+    };
+    static CompileStats compileStats();
+
+    const Reflection& reflection() const {return _reflection;}
+
     operator VkShaderModule() const {return module;}
 };
 
@@ -0,0 +1,28 @@
+#include "timeline.h"
+
+namespace vk {
+
+Timeline::Timeline(Device& d, uint64_t initial) : device(d), issued(initial) {
+    sem = d.timeline(initial);
+}
+
+uint64_t Timeline::value() {
+    uint64_t v;
+    VK_ASSERT( vkGetSemaphoreCounterValue(device, sem, &v) );
+    return v;
+}
+
+void Timeline::signal(uint64_t value) {
+    VkSemaphoreSignalInfo info {
+        .sType = VK_STRUCTURE_TYPE_SEMAPHORE_SIGNAL_INFO,
+        .semaphore = sem,
+        .value = value,
+    };
+    VK_ASSERT( vkSignalSemaphore(device, &info) );
+}
+
+bool Timeline::wait(uint64_t value, uint64_t timeout) {
+    return device.wait({at(value)}, false, timeout);
+}
+
+};
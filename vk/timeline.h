@@ -0,0 +1,54 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include "vklib.h"
+
+namespace vk {
+
+class Device;
+
+// a point on a semaphore, for Queue::submit: something to wait for (at stage),
+// or to signal. the value is ignored for binary semaphores
+struct Sync {
+    VkSemaphore semaphore;
+    uint64_t value = 0;
+    VkPipelineStageFlags stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;  // waits only
+};
+
+// wraps a timeline semaphore. its value only goes up: every submit that's part
+// of the timeline signals the next value, and other queues (or the cpu) wait for
+// the value they care about, no matter how far ahead the producer already is.
+// the values are handed out by next(), so the producer doesn't need to count.
+// the semaphore itself belongs to the Device.
+class Timeline {
+
+    Device& device;
+    VkSemaphore sem;
+    uint64_t issued;  // last value handed out by next()
+
+public:
+    Timeline(Device&, uint64_t initial = 0);
+
+    // the value for the next signal, and the last one handed out
+    uint64_t next() {return ++issued;}
+    uint64_t last() const {return issued;}
+
+    // the value the timeline got to so far
+    uint64_t value();
+
+    // for Queue::submit: wait for value (at stage), or signal it
+    Sync at(uint64_t value, VkPipelineStageFlags stage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT) const {
+        return {sem, value, stage};
+    }
+
+    // signals value from the cpu
+    void signal(uint64_t value);
+
+    // waits for value on the cpu, false if it timed out (in ns)
+    bool wait(uint64_t value, uint64_t timeout = UINT64_MAX);
+
+    operator VkSemaphore() const {return sem;}
+};
+
+};
+#endif
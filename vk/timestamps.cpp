@@ -0,0 +1,96 @@
+#include "timestamps.h"
+#include <chrono>
+#include <climits>
+
+namespace vk {
+
+static int64_t steady_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// creates the query pool, and calibrates against the cpu clock
+Timestamps::Timestamps(Device& d, Queue& q, uint32_t count) : device(d), count(count) {
+
+    VkPhysicalDeviceProperties props;
+    vkGetPhysicalDeviceProperties(device, &props);
+    period = props.limits.timestampPeriod;
+
+    uint32_t qfcount;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &qfcount, nullptr);
+    std::vector<VkQueueFamilyProperties> qfs(qfcount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &qfcount, qfs.data());
+
+    uint32_t bits = qfs[q.getfamily()].timestampValidBits;
+    mask = bits >= 64 ? ~0ull : (1ull << bits) - 1;
+
+    VkQueryPoolCreateInfo info {
+        .sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+        .queryType = VK_QUERY_TYPE_TIMESTAMP,
+        .queryCount = count,
+    };
+
+    VK_ASSERT( vkCreateQueryPool(device, &info, nullptr, &pool) );
+    vkResetQueryPool(device, pool, 0, count);
+
+    if (!valid()) return;
+
+    // the gpu writes the timestamp some time after the submit. the smallest
+    // (gpu - cpu) difference over a few tries is the closest to the real offset
+    VkFence f = d.fence();
+    int64_t best = LLONG_MAX;
+
+    for (int i = 0; i < 8; i++) {
+        CommandBuffer& cmd = q.command() << [&](CommandBuffer& cmd) {
+            write(cmd, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+        };
+
+        int64_t before = steady_ns();
+        q.submit(cmd, f, {}, {}, {});
+        d.wait(f);
+
+        uint64_t t;
+        if (raw(0, t)) {
+            best = std::min(best, (int64_t) (t * period) - before);
+        }
+        vkResetQueryPool(device, pool, 0, 1);
+    }
+
+    offset = best == LLONG_MAX ? 0 : -best;
+}
+
+void Timestamps::write(CommandBuffer& cmd, uint32_t query, VkPipelineStageFlagBits stage) {
+    if (!valid()) return;
+    vkCmdWriteTimestamp((VkCommandBuffer) cmd, stage, pool, query);
+}
+
+void Timestamps::reset(CommandBuffer& cmd, uint32_t first, uint32_t n) {
+    if (!valid()) return;
+    vkCmdResetQueryPool((VkCommandBuffer) cmd, pool, first, n);
+}
+
+// reads the raw tick count of a query, without waiting
+bool Timestamps::raw(uint32_t query, uint64_t& ticks) {
+    uint64_t result[2];  // value, availability
+    vkGetQueryPoolResults(device, pool, query, 1, sizeof(result), result, sizeof(result),
+                          VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+    if (!result[1]) return false;
+
+    ticks = result[0] & mask;
+    return true;
+}
+
+bool Timestamps::read(uint32_t query, int64_t& ns) {
+    uint64_t t;
+    if (!valid() || !raw(query, t)) return false;
+
+    ns = (int64_t) (t * period) + offset;
+    vkResetQueryPool(device, pool, query, 1);
+    return true;
+}
+
+Timestamps::~Timestamps() {
+    vkDestroyQueryPool(device, pool, nullptr);
+}
+
+};
@@ -0,0 +1,52 @@
+#ifndef TIMESTAMPS_H
+#define TIMESTAMPS_H
+
+#include "vklib.h"
+
+namespace vk {
+
+class Device;
+class Queue;
+class CommandBuffer;
+
+// wraps a VkQueryPool of timestamps, for timing gpu work.
+// the results are converted to the cpu's std::chrono::steady_clock (in ns),
+// so they can be put next to cpu timings. the offset between the two clocks
+// is measured once at construction, on the given queue.
+// queries are reset from the host (hostQueryReset) when they're read.
+class Timestamps {
+
+    Device& device;
+    VkQueryPool pool;
+    uint32_t count;
+
+    double period;       // ns per tick
+    uint64_t mask;       // valid bits of a timestamp
+    int64_t offset = 0;  // steady_clock - gpu, in ns
+
+    bool raw(uint32_t, uint64_t&);
+
+public:
+    // count - number of queries
+    // the queue must be able to write timestamps (see valid())
+    Timestamps(Device&, Queue&, uint32_t count);
+    ~Timestamps();
+
+    // records a timestamp write into query, taken when the previous commands
+    // in the queue reach stage. the query must have been read (or never used)
+    void write(CommandBuffer&, uint32_t query, VkPipelineStageFlagBits stage);
+
+    // records a reset of queries [first, first + n), for command buffers that write
+    // them and get submitted more than once (whether or not they were read)
+    void reset(CommandBuffer&, uint32_t first, uint32_t n);
+
+    // gets the time of a query on the steady_clock, in ns. returns false if the
+    // gpu didn't get there yet. a successful read frees the query for reuse.
+    bool read(uint32_t query, int64_t& ns);
+
+    // false if the queue doesn't support timestamps, writes and reads do nothing then
+    bool valid() const {return mask != 0;}
+};
+
+};
+#endif
@@ -18,11 +18,18 @@
 #include "instance.h"
 #include "device.h"
 #include "queue.h"
+#include "reflection.h"
 #include "shadermodule.h"
 #include "image.h"
 #include "commandbuffer.h"
 #include "buffer.h"
 #include "pipeline.h"
 #include "renderpass.h"
+#include "timestamps.h"
+#include "timeline.h"
+#include "descriptors.h"
+#include "cache.h"
+#include "graph.h"
+#include "heap.h"
 
 #endif
\ No newline at end of file
@@ -6,15 +6,8 @@
 #include <string>
 #include <chrono>
 
+// (tf is the camera and the entity's transforms, see sc::Material)
 std::string  _shader_vert_default = SHADERCODE(
-    layout (set = 0, binding = 0) uniform Obj {  // transforms uniform
-        mat4 model;
-        mat4 norm;
-        mat4 view;
-        mat4 proj;
-        float t;
-    } tf;
-
     layout (location = 0) in vec3 pos;
     layout (location = 1) in vec3 norm;
     layout (location = 2) in vec2 uv;
@@ -32,7 +25,61 @@ std::string  _shader_vert_default = SHADERCODE(
     }
 );
 
-int main() {
+int main(int argc, char** argv) {
+
+//----------------------------------------------//
+//  Command Line
+//----------------------------------------------//
+
+    // --source <spec>  where the camera frames come from, see cm::FrameSource::create
+    //                  (theta, mjpeg:file@rate, dir:path@rate, synthetic@rate)
+    // --trace <path>   write the camera frames' latency as a chrome trace on exit
+    // --blur <kernel>  tiled (default) or legacy, to compare the blur's gpu time
+    // --env-ref        check the environment against the cpu version once a second,
+    //                  alternating between its AVX2 and scalar paths (tiled blur only)
+    // --env-sync       draw with the environment of this frame's camera frame, waiting
+    //                  for it, instead of the last one's (no overlap, for comparison)
+    // --graph          print the frame's render graph once it's compiled
+    // --shader-opt     compile the shaders with the optimizer (-O)
+    // --shader-debug   compile the shaders with debug info (-g)
+    // --glslc          compile the shaders with glslc, even if shaderc is built in
+    std::string source = "theta";
+    sc::Environment::Kernel blur_kernel = sc::Environment::TILED;
+    bool env_ref = false;
+    bool env_sync = false;
+    bool print_graph = false;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--source" && i + 1 < argc) {
+            source = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            cm::Latency::trace(argv[++i]);
+        } else if (arg == "--blur" && i + 1 < argc) {
+            blur_kernel = std::string(argv[++i]) == "legacy" ? sc::Environment::LEGACY : sc::Environment::TILED;
+        } else if (arg == "--env-ref") {
+            env_ref = true;
+        } else if (arg == "--env-sync") {
+            env_sync = true;
+        } else if (arg == "--graph") {
+            print_graph = true;
+        } else if (arg == "--shader-opt") {
+            vk::ShaderModule::optimize = true;
+        } else if (arg == "--shader-debug") {
+            vk::ShaderModule::debug = true;
+        } else if (arg == "--glslc") {
+            vk::ShaderModule::inprocess = false;
+        } else {
+            printf("usage: %s [--source <spec>] [--trace <path>] [--blur tiled|legacy] [--env-ref] [--env-sync] [--graph] [--shader-opt] [--shader-debug] [--glslc]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    // the cpu reference only has the tiled blur
+    if (env_ref && blur_kernel == sc::Environment::LEGACY) {
+        printf("--env-ref can't check the legacy blur\n");
+        return 1;
+    }
 
 //----------------------------------------------//
 //  Engine Initialization
@@ -45,98 +92,79 @@ int main() {
     // create the required queues
     vk::Queue& graphics = dev.create_queue(VK_QUEUE_GRAPHICS_BIT);
     vk::Queue& presentation = dev.create_queue(VK_QUEUE_PRESENTATION_BIT);
-    vk::Queue& compute = dev.create_queue(VK_QUEUE_COMPUTE_BIT);
+    vk::Queue& compute = dev.create_queue(VK_QUEUE_COMPUTE_BIT | VK_QUEUE_DEDICATED_BIT);  // async compute, if there's a family for it
     vk::Queue& transfer = dev.create_queue(VK_QUEUE_TRANSFER_BIT);
+    vk::Queue& upload = dev.create_queue(VK_QUEUE_TRANSFER_BIT | VK_QUEUE_DEDICATED_BIT);
 
     dev.init();  // initialize the device
 
+    // without a transfer-only family, "dedicated" gets the draw's family, and so its queue
+    printf("[webcam] uploading on %s\n", upload.shares(graphics)
+        ? "the graphics queue (the device has no separate transfer queue)" : "a dedicated transfer queue");
+
     // synch structures
+    // the swapchain only takes binary semaphores, everything between the queues is on timelines
     VkSemaphore sem_img_avail = dev.semaphore();
-    VkSemaphore sem_render_finish = dev.semaphore();
     VkSemaphore sem_post_finish = dev.semaphore();
-    VkFence fence_wait_frame = dev.fence(true);
+    vk::Timeline& blitted = *new vk::Timeline(dev);   // the blit of frame n is done, and so is all of frame n
+
+    // the frame: its passes are added below, once everything they draw exists
+    vk::Graph& graph = *new vk::Graph(dev, graphics, &compute, &transfer);
+
+    // every texture and buffer the materials use, they only push indices into it
+    vk::Heap& heap = *new vk::Heap(dev);
 
 //----------------------------------------------//
 //  Webcam init
 //----------------------------------------------//
 
-    cm::Webcam& probecam = *new cm::Webcam(dev);
+    cm::Webcam& probecam = *new cm::Webcam(dev, upload, true, // YCbCr -> RGB on the gpu
+                                           cm::FrameSource::create(source));
     probecam.startStreaming();
 
 //----------------------------------------------//
-//  Roughness Init
+//  Environment Init
 //----------------------------------------------//
 
-    vk::ShaderModule& roughblur_sh = *new vk::ShaderModule(dev, "roughblur.comp",
-    SHADERCODE(
-        layout (binding = 0, rgba8) uniform readonly image2D source;
-        layout (binding = 1, rgba8) uniform           image2D halfway;
-        layout (binding = 2, rgba8) uniform writeonly image2D dest;
-
-        layout (push_constant) uniform config { int rad; } cfg;
-
-        layout(local_size_x = 32, local_size_y = 32) in;
-
-        void main() {
-
-            const ivec2 maxres = ivec2(1024, 512);
-            const int step = 3;
-            
-            ivec2 coord = ivec2(gl_GlobalInvocationID.xy); 
-            vec4 color = vec4(0., 0., 0., 1.);
-            float sc = abs(cfg.rad) * 2 + 1;
-                  sc = float(step) / sc;
-
-            float xstp = float(coord.y) / float(maxres.y);
-                  xstp = (xstp - 0.5) * 2 * 3.14159;
-                  xstp = abs(sin(xstp)) + 1.;
-
-            vec2 dir = cfg.rad > 0 ? vec2(xstp, 0.) : vec2(0., 1.);
-
-            for (int i = -abs(cfg.rad); i <= abs(cfg.rad); i+=step) {
-                vec2 jcoord = vec2(coord) + dir * i;
-                ivec2 icoord;
-                      icoord.x = int(mod(jcoord.x + maxres.x, maxres.x));
-                      icoord.y = int(mod(jcoord.y + maxres.y, maxres.y));
-                if (cfg.rad > 0) {
-                    color.rgb += imageLoad(source, icoord).bgr * sc;
-                } else {
-                    color.rgb += imageLoad(halfway, icoord).bgr * sc;
-                }
-            }
-
-            if (cfg.rad > 0) {
-                imageStore(halfway, coord, color);
-            } else {
-                imageStore(dest, coord, color);
-            }
-
-        }
-    )
-    );
-
-    vk::Pipeline& roughblur = vk::Pipeline::Compute(dev, {{
-        {.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .stageFlags = VK_SHADER_STAGE_ALL},
-        {.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .stageFlags = VK_SHADER_STAGE_ALL},
-        {.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, .stageFlags = VK_SHADER_STAGE_ALL}
-    }}, {{VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(int)}},
-    roughblur_sh);
+    // prefilters the camera frame into a mip chain, for the lookups at any roughness.
+    // runs on compute alongside the draws on graphics, one recording per image of the camera's ring
+    sc::Environment& env = *new sc::Environment(dev, compute, graphics, cm::Webcam::WIDTH, cm::Webcam::HEIGHT,
+                                                cm::Webcam::BUFFER_SIZE);
+    env.kernel = blur_kernel;
+
+    // gpu time of the draw, to see how much of it the environment overlaps
+    vk::Timestamps& draw_stamps = *new vk::Timestamps(dev, graphics, 2);
+
+    // the cpu reference, and where the gpu's frame and level 1 get copied for it
+    sc::EnvironmentRef* envref = nullptr;
+    vk::Buffer* ref_frame = nullptr;
+    vk::Buffer* ref_level = nullptr;
+    if (env_ref) {
+        envref = new sc::EnvironmentRef(cm::Webcam::WIDTH, cm::Webcam::HEIGHT, env.mipLevels());
+        ref_frame = new vk::Buffer(dev, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+            cm::Webcam::WIDTH * cm::Webcam::HEIGHT * 4);
+        ref_level = new vk::Buffer(dev, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+            VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT | VK_MEMORY_PROPERTY_HOST_CACHED_BIT,
+            (cm::Webcam::WIDTH / 2) * (cm::Webcam::HEIGHT / 2) * 4);
+    }
 
 //----------------------------------------------//
 //  Image Initialization
 //----------------------------------------------//
 
+    // the images only the frame uses are the graph's, they're made (and share
+    // memory, where they can) when it's compiled
+
     // depth buffer
     // use as a render-target depth attachment
-    vk::Image& depth_buffer = *new vk::Image(dev, {
+    vk::Graph::Resource depth_res = graph.transient("depth", {
         .imageType = VK_IMAGE_TYPE_2D,
         .format = vk_DEPTH_FORMAT,
         .extent = {1920, 1080, 1},
         .tiling = VK_IMAGE_TILING_OPTIMAL,
         .usage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT,
-    },  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    depth_buffer.view({
+    }, {
         .viewType = VK_IMAGE_VIEW_TYPE_2D,
         .format = vk_DEPTH_FORMAT,
         .subresourceRange = {
@@ -145,56 +173,22 @@ int main() {
 
     // offscreen image
     // use as draw's render target, and then postprocess with compute
-    vk::Image& draw_image = *new vk::Image(dev, {
+    vk::Graph::Resource draw_res = graph.transient("draw_image", {
         .imageType = VK_IMAGE_TYPE_2D,
         .format = vk_COLOR_FORMAT,
         .extent = {1920, 1080, 1},
         .tiling = VK_IMAGE_TILING_OPTIMAL,
         .usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
-    },  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    draw_image.view({
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = vk_COLOR_FORMAT,
-        .subresourceRange = {
-        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT}
-    });
-
-    // roughblur image
-    // get the camera image and blur (one axis) on it, store that in this image
-    vk::Image& roughblur_im_half = *new vk::Image(dev, {
-        .imageType = VK_IMAGE_TYPE_2D,
-        .format = vk_COLOR_FORMAT,
-        .extent = {1024, 512, 1}, // match probeimg format!
-        .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-    },  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    roughblur_im_half.view({
-        .viewType = VK_IMAGE_VIEW_TYPE_2D,
-        .format = vk_COLOR_FORMAT,
-        .subresourceRange = {
-        .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT}
-    });
-
-    // roughblur image
-    // get the camera image and blur it, store that in this image
-    vk::Image& roughblur_im = *new vk::Image(dev, {
-        .imageType = VK_IMAGE_TYPE_2D,
-        .format = vk_COLOR_FORMAT,
-        .extent = {1024, 512, 1}, // match probeimg format!
-        .tiling = VK_IMAGE_TILING_OPTIMAL,
-        .usage = VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
-    },  VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
-
-    roughblur_im.view({
+    }, {
         .viewType = VK_IMAGE_VIEW_TYPE_2D,
         .format = vk_COLOR_FORMAT,
         .subresourceRange = {
         .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT}
     });
 
-    roughblur_im.sampler();
+    // the swapchain image of the frame
+    vk::Graph::Resource screen_res = graph.import("screen");
+    graph.output(screen_res, vk::Image::PRESENT);
 
 //----------------------------------------------//
 //  Render Passes
@@ -208,29 +202,33 @@ int main() {
          {.format=vk_DEPTH_FORMAT, .initialLayout=VK_IMAGE_LAYOUT_UNDEFINED, .finalLayout=VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL} // depth
     );
 
-    drawpass.framebuffers({/*{roughblur_im},*/ {draw_image}, {depth_buffer}});
-
 //----------------------------------------------//
 //  Object/Entity Initialization
 //----------------------------------------------//
 
+    // what's drawn with while the real materials compile in the background:
+    // plain grey, lit from above. it's tiny, so it's ready right away
+    sc::Material& fallback_mat = *new sc::Material(dev, drawpass, heap, "fallback_mat",
+    _shader_vert_default,
+    SHADERCODE(
+        layout (location = 0) in vec3 fnorm;
+        layout (location = 0) out vec4 col;
+
+        void main() {
+            col = vec4(vec3(0.3 + 0.4 * max(normalize(fnorm).y, 0.)), 1.0);
+        }
+    )
+    );
+
     // initialize monke
     sc::Mesh& monke_mesh = *new sc::Mesh(dev, "suzane_smooth.obj");
     // sc::Mesh& monke_mesh = *new sc::Mesh(dev, "sphere.obj");
 
-    sc::Material& monke_mat = *new sc::Material(dev, drawpass, "default_mat", 
+    sc::Material& monke_mat = *new sc::Material(dev, drawpass, heap, "default_mat", 
     _shader_vert_default,
     SHADERCODE(
-        layout (set = 0, binding = 0) uniform Obj {  // transforms uniform
-            mat4 model;
-            mat4 norm;
-            mat4 view;
-            mat4 proj;
-            vec3 camerapos;
-            float t;
-        } tf;
-        layout (set = 0, binding = 1) uniform sampler2D probeimg;
-        layout (set = 0, binding = 2) uniform sampler2D proberoughimg;
+        // tf.sh is the irradiance, see sc::Lighting. the textures are
+        // 0: the raw frame (unused), 1: prefiltered, rougher with every level
 
         layout (location = 0) in vec3 fnorm;
         layout (location = 1) in vec3 fpos;
@@ -238,26 +236,29 @@ int main() {
 
         layout (location = 0) out vec4 col;
 
-        float lerp (float v, float i0, float i1, float o0, float o1) {
-            return o0 + (o1 - o0) * (v - i0) / (i1 - i0);
+        // the light coming in around the normal, from the sh coefficients
+        vec3 irradiance(vec3 n) {
+            return tf.sh[0].rgb * 0.282095
+                 + tf.sh[1].rgb * 0.488603 * n.y
+                 + tf.sh[2].rgb * 0.488603 * n.z
+                 + tf.sh[3].rgb * 0.488603 * n.x
+                 + tf.sh[4].rgb * 1.092548 * n.x * n.y
+                 + tf.sh[5].rgb * 1.092548 * n.y * n.z
+                 + tf.sh[6].rgb * 0.315392 * (3. * n.z * n.z - 1.)
+                 + tf.sh[7].rgb * 1.092548 * n.x * n.z
+                 + tf.sh[8].rgb * 0.546274 * (n.x * n.x - n.y * n.y);
         }
 
-        vec3 envlookup(vec3 dir, int id) {
+        // 0 is a mirror, 1 takes the roughest level
+        const float roughness = 0.4;
 
-            // use spherical coordinates
-            // convert normal to a lattitude and longitude
-
-            vec2 spcoord = vec2(
-                lerp(atan(dir.z, dir.x), -3.1415, 3.1415, 0, 1),
-                lerp(dir.y, -1, 1, 0, 1)
-            );
+        vec3 envlookup(vec3 dir, float roughness, int id) {
 
-            // rotate the spcoord a little
-            if (id == 0) spcoord.x = mod(spcoord.x + 0.25, 1.0);
+            // rotate it a little (a quarter turn in longitude)
+            if (id == 0) dir = vec3(-dir.z, dir.y, dir.x);
 
-            if (id == 0) return vec3(texture(probeimg, spcoord).bgr);
-            if (id == 1) return vec3(texture(proberoughimg, spcoord).bgr);
-            return vec3(0., 0., 0.);
+            float lod = roughness * float(textureQueryLevels(heap_cube[ids.textures[1]]) - 1);
+            return vec3(textureLod(heap_cube[ids.textures[1]], dir, lod).bgr);
         }
         
         void main() {
@@ -268,8 +269,8 @@ int main() {
             vec3 reflectdir = reflect(cameradir, fnorm);
 
             // blue object with shiny red highlights
-            vec3 specular = envlookup(reflectdir, 0) * vec3(1.f, 1.f, 1.f);
-            vec3 diffuse = envlookup(normaldir, 1) * vec3(1.f, 1.f, 1.f);
+            vec3 specular = envlookup(reflectdir, roughness, 0) * vec3(1.f, 1.f, 1.f);
+            vec3 diffuse = irradiance(normaldir) * vec3(1.f, 1.f, 1.f);
             
             col.rgb = specular * 0.0f + diffuse * 1.0f;
             col.a = 1.f;
@@ -280,8 +281,8 @@ int main() {
 
             // gl_FragDepth = displacedPosition.z;
         }
-    )
-    );
+    ),
+    fallback_mat);
 
     // new monke object
     sc::Entity& monke = *new sc::Entity(dev, monke_mesh, monke_mat);
@@ -289,7 +290,7 @@ int main() {
     // initialize plane
     sc::Mesh& plane_mesh = *new sc::Mesh(dev, "plane.obj");
 
-    sc::Material& checkerboard_mat = *new sc::Material(dev, drawpass, "checkerboard_mat", 
+    sc::Material& checkerboard_mat = *new sc::Material(dev, drawpass, heap, "checkerboard_mat", 
     _shader_vert_default,
     SHADERCODE(
         layout (location = 0) in vec3 fnorm;
@@ -308,11 +309,16 @@ int main() {
             
             col = vec4(v*0.5, v, v, 1.0);
         }
-    )
-    );
+    ),
+    fallback_mat);
 
     // new plane object
     sc::Entity& plane_001 = *new sc::Entity(dev, plane_mesh, checkerboard_mat);
+
+    // the camera and lighting every draw shares, once per eye
+    sc::CameraBuffer& cameras = *new sc::CameraBuffer(dev, heap);
+    printf("[materials] transforms %s\n", monke_mat.pushes() ?
+           "pushed with every draw" : "in storage buffers (too big for push constants)");
     
 //----------------------------------------------//
 //  Scene Setup
@@ -331,28 +337,203 @@ int main() {
     plane_001.rotation = glm::quat(1, 0, 0, 0);
     plane_001.scaling = glm::vec3(4, 4, 4);
 
+//----------------------------------------------//
+//  Frame Graph
+//----------------------------------------------//
+
+    // what the draw picked up from the environment this frame
+    bool env_changed = false;
+
+    // draws the scene into the offscreen image. the graph puts the targets into
+    // attachment layouts first (they're cleared), the render pass leaves them there
+    vk::Graph::Pass& draw_pass = graph.pass("draw", [&](vk::CommandBuffer& cmd) {
+
+        draw_stamps.reset(cmd, 0, 2);
+        draw_stamps.write(cmd, 0, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT);
+
+        // the prefiltered camera image as texture (all of its levels). the last frame's,
+        // while this one's is still being processed (picked before the submit, see below)
+        env.acquire(cmd);
+
+        // and the camera image it came from (keeps what prepare() wrote, no barrier
+        // if it's still read-only from the last draw). both are the environment's, it
+        // syncs them with the compute queue itself
+        cmd.use(env.source(), vk::Image::SAMPLED_FRAGMENT);
+
+        // they're one of a few images each, which are in the heap after the first time
+        monke_mat.texture(0, env.source());
+        monke_mat.texture(1, env.prefiltered());
+
+        cmd.beginRenderpass(drawpass,
+            {{0, 0}, {1920, 1080}},
+            {{0.f, 0.f, .1f, 1.f}, {1.f, 0u}}
+        );
+
+        // go form eye=-1 to eye=1
+        for (int eye = -1; eye <= 1; eye += 2) {
+            // set render area (L)
+            sc::camera.eye = eye;
+            cmd.setRenderArea(
+                {1920.f / 4 * (1+eye), 0.f, 1920.f / 2, 1080.f, 0.f, 1.f}, // viewport
+                {{1920 / 4 * (1+eye), 0}, {1920 / 2, 1080}} // scissor rect
+            );
+
+            // this eye's view, for every draw
+            uint32_t cam = cameras.update();
+
+            // draw the monke
+            monke.draw(cmd, cam);
+
+            // draw the plane
+            plane_001.draw(cmd, cam);
+        }
+
+        // end rendering
+        cmd.endRenderpass(drawpass);
+
+        draw_stamps.write(cmd, 1, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT);
+    })
+    .write(draw_res, vk::Image::COLOR_ATTACHMENT, true)
+    .write(depth_res, vk::Image::DEPTH_ATTACHMENT, true);
+
+    // blits the offscreen image onto the screen. only copies, so it goes on the
+    // transfer queue, and waits for the draw there
+    vk::Graph::Pass& blit_pass = graph.pass("blit", [&](vk::CommandBuffer& cmd) {
+        cmd.blit(
+            graph.image(draw_res), VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, {1920, 1080, 1},
+            graph.image(screen_res), VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, {instance.width, instance.height, 1},
+            VK_IMAGE_ASPECT_COLOR_BIT 
+        );
+    })
+    .read(draw_res, vk::Image::TRANSFER_SRC)
+    .write(screen_res, vk::Image::TRANSFER_DST, true);
+
+    // makes the targets, so the render pass can have its framebuffer
+    graph.compile();
+    drawpass.framebuffers({/*{env.prefiltered()},*/ {graph.image(draw_res)}, {graph.image(depth_res)}});
+
+    if (print_graph) graph.describe(stdout);
+
 //----------------------------------------------//
 //  Main Loop
 //----------------------------------------------//
 
     float t = 0;
 
+    // camera ingest rate, over the last second
+    auto cam_time = std::chrono::high_resolution_clock::now();
+    cm::Webcam::Stats cam_stats = probecam.stats();
+    double cam_fps = 0;
+
+    // the camera frame drawn last loop (0 if it was drawn before), its gpu stamps are read once it's done
+    uint64_t traced_frame = 0;
+    int64_t traced_present = 0;
+
+    // the camera frame being drawn, until the camera has a newer one
+    vk::Image* probeimg = nullptr;
+
+    // gpu time of the environment processing
+    double env_ms = 0, env_total_ms = 0;
+    uint64_t env_frames = 0;
+
+    // the environment only runs on display frames with a new camera frame
+    uint64_t display_frames = 0, env_runs = 0;
+    uint64_t job_frame[2] {};  // camera frame of each of the environment's outputs
+
+    // the last few draws on the gpu, and how much of the environment ran alongside them
+    int64_t draw_start[4] {}, draw_end[4] {};
+    double draw_total_ms = 0, overlap_total_ms = 0;
+    uint64_t draws_timed = 0;
+
+    // --env-ref: the copies for the check were recorded into the last frame
+    bool ref_pending = false;
+    auto ref_time = std::chrono::high_resolution_clock::now();
+
     while (instance.update()) {
         
 auto start_time = std::chrono::high_resolution_clock::now();
 
-        // network: wait for image
-        vk::Image& probeimg = probecam.getNextImage();
+        // network: pick up the new camera frame, if there is one
+        // (only the very first one is waited for, after that the last one gets drawn again)
+        vk::Image* newimg = probeimg ? probecam.tryNextImage() : &probecam.getNextImage();
+        uint64_t probe_frame = 0, probe_uploaded = 0;
 
-        probeimg.view({
-            .viewType = VK_IMAGE_VIEW_TYPE_2D,
-            .format = vk_COLOR_FORMAT,
-            .subresourceRange = {
-            .aspectMask = VK_IMAGE_ASPECT_COLOR_BIT}
-        });
+        if (newimg) {
+            probeimg = newimg;  // (with the webcam's view, the one in the heap)
+            probe_frame = probecam.frame();
+
+            // copy it to the gpu on the transfer queue, compute waits for it below
+            probe_uploaded = probecam.upload();
+        }
+
+        // cpu: wait for the last frame to be done, its command buffers and uniforms get reused
+        blitted.wait(blitted.last());
+
+        // the last frame is done, finish its latency trace
+        int64_t draw_s, draw_e;
+        if (draw_stamps.read(1, draw_e) && draw_stamps.read(0, draw_s)) {
+            draw_start[draws_timed % 4] = draw_s;
+            draw_end[draws_timed % 4] = draw_e;
+            draw_total_ms += (draw_e - draw_s) / 1e6;
+            draws_timed++;
+        }
+
+        int64_t env_start, env_end;
+        uint64_t env_job;
+        if (env.timing(env_start, env_end, env_job)) {
+            cm::Latency::stamp(job_frame[(env_job - 1) % 2], cm::Latency::BLURRED, env_end);
+            env_ms = (env_end - env_start) / 1e6;
+            env_total_ms += env_ms;
+            env_frames++;
+
+            // the draws it ran next to
+            for (int i = 0; i < 4; i++) {
+                int64_t o = std::min(env_end, draw_end[i]) - std::max(env_start, draw_start[i]);
+                if (o > 0) overlap_total_ms += o / 1e6;
+            }
+        }
+        if (traced_frame) {
+            cm::Latency::stamp(traced_frame, cm::Latency::PRESENTED, traced_present);
+        }
+
+        // the diffuse lighting of the last frame, for this one's transforms
+        env.irradiance(sc::lighting);
+
+        // check the last frame against the cpu
+        if (ref_pending) {
+            ref_pending = false;
+            envref->process((uint8_t*) ref_frame->map(), cm::Webcam::WIDTH * 4);
+
+            // level 1 exercises the reduce and the blur, in 8 bit units
+            const uint8_t* gpu = (uint8_t*) ref_level->map();
+            const sc::EnvImage& cpu = envref->chain[1];
+            int maxdiff = 0;
+            size_t off = 0;
+            for (size_t i = 0; i < cpu.px.size(); i++) {
+                if (i % 4 == 3) continue;
+                int d = std::abs((int) gpu[i] - (int) std::lround(cpu.px[i] * 255));
+                maxdiff = std::max(maxdiff, d);
+                off += d > 1;
+            }
+
+            // sh, relative to the dc term
+            float sherr = 0;
+            for (int i = 0; i < 9; i++) {
+                for (int c = 0; c < 3; c++) {
+                    sherr = std::max(sherr, std::abs(sc::lighting.sh[i][c] - envref->lighting.sh[i][c]));
+                }
+            }
+            sherr /= std::max(1e-6f, envref->lighting.sh[0][1]);
 
-        // cpu: wait for the thing to be done
-        dev.wait(fence_wait_frame);
+            printf("\n[envref] %s, %u threads: chain %.2f ms, cube %.2f ms, sh %.2f ms | "
+                   "level 1 max diff %d/255 (%zu values off by more than 1), sh error %.2e\n",
+                   envref->simd && sc::EnvironmentRef::avx2() ? "avx2" : "scalar", envref->threads,
+                   envref->timing.chain_ms, envref->timing.cube_ms, envref->timing.sh_ms,
+                   maxdiff, off, sherr);
+
+            envref->simd = !envref->simd;
+        }
+        cm::Latency::collect();
 
         // get an image from the screen -- blocks
         vk::Image& screen = dev.getSwapchainImage(VK_NULL_HANDLE, sem_img_avail);
@@ -378,172 +559,80 @@ auto wait_time = std::chrono::high_resolution_clock::now();
 //  Main - Draw
 //----------------------------------------------//
 
-        // record the commandbuffer for blurring the camera image
-        vk::CommandBuffer& roughblur_cmd = compute.command() << [&](vk::CommandBuffer& cmd) {
-
-            // set the probeimg to be a storage-optimal (read)
-            cmd.imageTransition(probeimg,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
-                VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_ASPECT_COLOR_BIT
-            );
-
-
-            // set the middle to be read and write
-            cmd.imageTransition(roughblur_im_half,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
-                VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_ASPECT_COLOR_BIT
-            );
-
-            // set the roughblur to be storage-optimal (for write)
-            cmd.imageTransition(roughblur_im,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
-                VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
-                VK_IMAGE_ASPECT_COLOR_BIT
-            );
-
-            // bind the images
-            roughblur.descriptorSet(0);
-            roughblur.writeDescriptor(0, 0, probeimg, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-            roughblur.writeDescriptor(0, 1, roughblur_im_half, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-            roughblur.writeDescriptor(0, 2, roughblur_im, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
-
-            // bind the postprocessor
-            cmd.bindPipeline(roughblur);
-
-            uint32_t groupCountX = (1920 + 31) / 32;  // Round up division
-            uint32_t groupCountY = (1080 + 31) / 32;
-
-            // set the arg
-            cmd.setPcr(roughblur, 0,  -5); // 10px Y-blur
-
-            // apply the shader
-            cmd.dispatch(groupCountX, groupCountY, 1);
-
-            // set the arg
-            cmd.setPcr(roughblur, 0,  5); // 10px X-blur
-            
-            // apply the shader again
-            cmd.dispatch(groupCountX, groupCountY, 1);
-
-        };
-
-        // record the commandbuffer for drawing
-        vk::CommandBuffer& draw_cmd = graphics.command() << [&](vk::CommandBuffer& cmd) {
-            
-            // add camera image as texture
-            cmd.imageTransition(roughblur_im,
-                // VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_ASPECT_COLOR_BIT
-            );
-
-            // add camera image as texture
-            cmd.imageTransition(probeimg,
-                // VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
-                VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
-                VK_IMAGE_ASPECT_COLOR_BIT
-            );
-
-            cmd.beginRenderpass(drawpass,
-                {{0, 0}, {1920, 1080}},
-                {{0.f, 0.f, .1f, 1.f}, {1.f, 0u}}
-            );
-
-            // go form eye=-1 to eye=1
-            for (int eye = -1; eye <= 1; eye += 2) {
-                // set render area (L)
-                sc::camera.eye = eye;
-                cmd.setRenderArea(
-                    {1920.f / 4 * (1+eye), 0.f, 1920.f / 2, 1080.f, 0.f, 1.f}, // viewport
-                    {{1920 / 4 * (1+eye), 0}, {1920 / 2, 1080}} // scissor rect
-                );
-
-                // draw the monke
-                // monke.draw(cmd);
-
-                monke_mat.descriptorSet(0); // init descriptor set
-                monke.set_transforms(cmd); // writes the transforms into monke_mat (set=0, binding=0)
-                ((vk::Pipeline&)monke_mat).writeDescriptor(0, 1, probeimg, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-                ((vk::Pipeline&)monke_mat).writeDescriptor(0, 2, roughblur_im, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-
-                monke_mat.bind(cmd); // bind the pipeline
-
-                monke_mesh.draw(cmd);
-
-                // draw the plane
-                plane_001.draw(cmd);
+        // a new camera frame: convert it (per frame, the push constants change with the jpeg),
+        // the prefiltering itself is recorded once per camera image, see sc::Environment::submit
+        vk::CommandBuffer* prepare_cmd = nullptr;
+        vk::CommandBuffer* ref_cmd = nullptr;
+        if (newimg) {
+            prepare_cmd = &(compute.command() << [&](vk::CommandBuffer& cmd) {
+                // leaves probeimg storage-optimal (read)
+                probecam.prepare(cmd);
+            });
+
+            // grab the frame and level 1 for the cpu check
+            if (envref && std::chrono::high_resolution_clock::now() - ref_time > std::chrono::seconds(1)) {
+                ref_time = std::chrono::high_resolution_clock::now();
+                ref_cmd = &(compute.command() << [&](vk::CommandBuffer& cmd) {
+                    cmd.memoryBarrier(VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                      VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT,
+                                      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT);
+                    cmd.copyImageToBuffer(*probeimg, VK_IMAGE_LAYOUT_GENERAL, *ref_frame, 0, VK_IMAGE_ASPECT_COLOR_BIT);
+                    cmd.copyImageToBuffer(env.equirect(), VK_IMAGE_LAYOUT_GENERAL, *ref_level, 1, VK_IMAGE_ASPECT_COLOR_BIT);
+
+                    // for the cpu, and done before the frame is handed to graphics
+                    cmd.memoryBarrier(VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+                                      VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_HOST_READ_BIT);
+                });
+                ref_pending = true;
             }
+        }
 
-            // end rendering
-            cmd.endRenderpass(drawpass);
-
-        };
+        // the environment only when there's something new to process.
+        // submitted first, so that the draw can pick it up with --env-sync
+        if (newimg) {
+            compute.submit(*prepare_cmd,
+                {probecam.timeline().at(probe_uploaded, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT)}, {});
 
-        // record the commandbuffer to blit offscreen rt
-        vk::CommandBuffer& blit_cmd = transfer.command() << [&](vk::CommandBuffer& cmd) {
+            env.submit(*probeimg, ref_cmd);
+            env_runs++;
 
-            // now set the target_final to be transfer src
-            cmd.imageTransition(draw_image,
-                VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
-                VK_IMAGE_ASPECT_COLOR_BIT
-            );
-
-            // set th screen to be transfer dst
-            cmd.imageTransition(screen,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
-                VK_IMAGE_ASPECT_COLOR_BIT
-            );
+            // the camera's next upload into this slot waits for the job (and the conversion before it)
+            probecam.readBy(*probeimg, env.submitted());
+            job_frame[(env_runs - 1) % 2] = probe_frame;
+        }
+        display_frames++;
 
-            // blit the target onto the screen
-            cmd.blit(
-                draw_image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, {1920, 1080, 1},
-                screen, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, {instance.width, instance.height, 1},
-                VK_IMAGE_ASPECT_COLOR_BIT 
-            );
+        // the frame's swapchain image, and its semaphores
+        graph.bind(screen_res, screen);
+        blit_pass.wait({sem_img_avail, 0, VK_PIPELINE_STAGE_TRANSFER_BIT})
+                 .signal(blitted.at(blitted.next()))
+                 .signal({sem_post_finish});
 
-            // turn the screen to present optimal
-            cmd.imageTransition(screen,
-                VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
-                VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
-                VK_IMAGE_ASPECT_COLOR_BIT
-            );
-        };
+        // the draw waits for the environment it picks, and tells it when it's done with it.
+        // picked now, ready() and finished() are this draw's
+        env_changed = env.pick(env_sync);
+        draw_pass.wait(env.ready()).signal(env.finished());
 
 //----------------------------------------------//
 //  Loop - Submit
 //----------------------------------------------//
-        
-        // graphics.submit(VK_NULL_HANDLE,
-        //     {sem_img_avail}, {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT},
-        //     {sem_render_finish});
 
-        // compute.submit(fence_wait_frame,
-        //     {sem_render_finish}, {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT},
-        //     {sem_post_finish});
-        
-        // if we assume that we're on an igpu and graphics and compute are on the same qf
+        // records and submits the draw and the blit, see the frame graph above
+        graph.execute();
+        probecam.readBy(env.source(), env.finished());  // the draw samples the raw frame too
 
-        compute.submit(roughblur_cmd, VK_NULL_HANDLE,
-            {sem_img_avail}, {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT}, {/* auto sync */});
+        // the descriptor sets the frame took are recycled once its batches are done
+        // (and the environment's job, if the device can't push its sets)
+        std::vector<vk::Sync> frame_done = graph.done();
+        frame_done.push_back(env.submitted());
+        dev.descriptors().frame(frame_done);
 
-        graphics.submit(draw_cmd, VK_NULL_HANDLE,
-            {/*auto sync*/}, {/*auto sync*/}, {/* auto sync */});
-
-        // compute.submit(postproc_cmd, VK_NULL_HANDLE,
-        //     {/*auto sync*/}, {/*auto sync*/}, {/* auto sync */});
-
-        transfer.submit(blit_cmd, fence_wait_frame,
-            {/*auto sync*/}, {/*auto sync*/}, {sem_post_finish});
-        
         // throw the image onto the screen
         presentation.present(screen, {sem_post_finish});
 
+        traced_frame = env_changed ? job_frame[(env.job() - 1) % 2] : 0;
+        traced_present = cm::Latency::now();
+
 auto end_time = std::chrono::high_resolution_clock::now();
 
         auto duration = std::chrono::duration_cast<std::chrono::microseconds>(end_time - start_time);
@@ -551,16 +640,66 @@ auto end_time = std::chrono::high_resolution_clock::now();
 
         t += duration.count() / 1000000.0;
 
-        printf(" frametime: %03.3f ms (idle %03.3f ms) fps: %03.1f  \r",
+        if (end_time - cam_time > std::chrono::seconds(1)) {
+            cm::Webcam::Stats s = probecam.stats();
+            cam_fps = (s.frames - cam_stats.frames) / std::chrono::duration<double>(end_time - cam_time).count();
+            cam_stats = s;
+            cam_time = end_time;
+        }
+
+        printf(" frametime: %03.3f ms (idle %03.3f ms) fps: %03.1f  cam: %03.1f fps (decode %03.3f ms)  env: %03.3f ms  age: %03.1f/%03.1f ms  \r",
                 duration.count() / 1000.0,
                 waitduration.count() / 1000.0,
-                1000000.0 / duration.count());
+                1000000.0 / duration.count(),
+                cam_fps, cam_stats.decode_ms, env_ms,
+                cm::Latency::percentile(cm::Latency::PRESENTED, 0.5),
+                cm::Latency::percentile(cm::Latency::PRESENTED, 0.99));
         fflush(stdout);
     }
 
     dev.idle();
 
+    printf("\n");
+    cm::Latency::finish();
+    cm::Latency::report(stdout);
+    printf("[environment] %u level prefilter (%s blur): %.3f ms gpu on average, over %lu frames\n",
+           env.mipLevels(), blur_kernel == sc::Environment::LEGACY ? "legacy" : "tiled", env_frames ? env_total_ms / env_frames : 0., env_frames);
+    printf("[environment] ran on %lu of %lu display frames\n", env_runs, display_frames);
+
+    // (the draw's are all in the heap, this is the camera's conversion, and the
+    //  environment's, which are pushed once per recording, once per camera image)
+    vk::Pipeline::DescriptorStats desc = vk::Pipeline::descriptorStats();
+    printf("[descriptors] per frame: %.1f writes in %.1f updates and %.1f pushes (%.1f with a template), %.3f ms cpu\n",
+           (double) desc.writes / std::max<uint64_t>(1, display_frames),
+           (double) desc.updates / std::max<uint64_t>(1, display_frames),
+           (double) desc.pushes / std::max<uint64_t>(1, display_frames),
+           (double) desc.templated / std::max<uint64_t>(1, display_frames),
+           desc.ns / 1e6 / std::max<uint64_t>(1, display_frames));
+    const vk::Cache::Stats& cache = dev.cache().stats();
+    printf("[cache]");
+    for (int k = 0; k < vk::Cache::KINDS; k++) {
+        printf(" %s: %lu made for %lu%s", vk::Cache::name((vk::Cache::Kind) k),
+               cache.made[k], cache.asked[k], k + 1 < vk::Cache::KINDS ? "," : "\n");
+    }
+    vk::ShaderModule::CompileStats shaders = vk::ShaderModule::compileStats();
+    printf("[shaders] %lu compiled with %s (%s) in %.1f ms, %.1f ms each\n",
+           shaders.compiled, vk::ShaderModule::backend(), *vk::ShaderModule::flags() ? vk::ShaderModule::flags() : "no flags",
+           shaders.ns / 1e6, shaders.ns / 1e6 / std::max<uint64_t>(1, shaders.compiled));
+    printf("[environment] %s, compute %s graphics: %.1f%% of its gpu time overlapped a draw, "
+           "gpu busy %.1f%% of the time (draw %.3f ms on average)\n",
+           env_sync ? "lock-step (--env-sync)" : "overlapped",
+           compute.getfamily() == graphics.getfamily() ? "on the same queue family as" : "on its own queue family, next to",
+           env_total_ms > 0 ? 100. * overlap_total_ms / env_total_ms : 0.,
+           t > 0 ? 100. * (draw_total_ms + env_total_ms - overlap_total_ms) / (t * 1000.) : 0.,
+           draws_timed ? draw_total_ms / draws_timed : 0.);
+
     // cleanup
+    delete envref;
+    delete ref_frame;
+    delete ref_level;
+    delete &env;
+    delete &draw_stamps;
+    delete &blitted;
     delete &monke;
     delete &monke_mat;
     delete &monke_mesh;
@@ -568,11 +707,14 @@ auto end_time = std::chrono::high_resolution_clock::now();
     delete &plane_001;
     delete &checkerboard_mat;
     delete &plane_mesh;
+    delete &fallback_mat;
+
+    delete &cameras;
+    delete &heap;
 
     delete &drawpass;
 
-    delete &depth_buffer;
-    delete &draw_image;
+    delete &graph;
 
     probecam.stopStreaming();
     delete &probecam;
@@ -581,6 +723,7 @@ auto end_time = std::chrono::high_resolution_clock::now();
     delete &presentation;
     delete &compute;
     delete &transfer;
+    delete &upload;
 
     delete &dev;
     delete &instance;